@@ -0,0 +1,681 @@
+// File: Batch.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#pragma warning(disable: 4996)
+
+#include "Batch.h"
+#include "ConvertJpegToTiff.h"
+#include "GraphicsFile.h"
+#include "TiffSegments.h"
+#include "ThreadPool.h"
+#include "BoundedQueue.h"
+#include "Exception.h"
+#include "Util.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <stdio.h>
+#include <wctype.h>
+
+namespace // anonymous
+{
+	struct BatchJob
+	{
+		std::wstring infile;
+		std::wstring outfile;
+	};
+
+
+	bool HasJpegExtension(const std::wstring& filename)
+	{
+		auto pos = filename.find_last_of(L'.');
+		if (pos == std::wstring::npos)
+		{
+			return false;
+		}
+		std::wstring ext = filename.substr(pos + 1);
+		for (auto it = ext.begin(); it != ext.end(); ++it)
+		{
+			*it = static_cast<wchar_t>(towlower(*it));
+		}
+		return ext == L"jpg" || ext == L"jpeg";
+	}
+
+
+	// In name order, which is the order of the pages in a multi-page file
+
+	void AddDirectory(const std::wstring& directory, std::vector<std::wstring>& infiles)
+	{
+		std::vector<std::wstring> files;
+		std::vector<std::wstring> subdirectories;
+		vibo::ListDirectory(directory, files, subdirectories);
+		std::sort(files.begin(), files.end());
+		std::sort(subdirectories.begin(), subdirectories.end());
+		for (auto it = files.begin(); it != files.end(); ++it)
+		{
+			if (HasJpegExtension(*it))
+			{
+				infiles.push_back(*it);
+			}
+		}
+		for (auto it = subdirectories.begin(); it != subdirectories.end(); ++it)
+		{
+			AddDirectory(*it, infiles);
+		}
+	}
+
+
+	void AddListFile(const std::wstring& listfile, std::vector<std::wstring>& infiles)
+	{
+		vibo::File f(_wfopen(listfile.c_str(), L"rb")); // One UTF-8 file name per line
+		if (f == nullptr)
+		{
+			THROW(L"Cannot open the list file \'" + listfile + L"\'");
+		}
+		std::string line;
+		for (int c = fgetc(f); ; c = fgetc(f))
+		{
+			if (c == '\n' || c == '\r' || c == EOF)
+			{
+				if (!line.empty())
+				{
+					infiles.push_back(vibo::to_wstring(line));
+					line.clear();
+				}
+				if (c == EOF)
+				{
+					break;
+				}
+			}
+			else
+			{
+				line += static_cast<char>(c);
+			}
+		}
+	}
+
+
+	// Files, directories and @listfiles
+
+	std::vector<std::wstring> ExpandInputs(const std::vector<std::wstring>& inputs)
+	{
+		std::vector<std::wstring> infiles;
+		for (auto it = inputs.begin(); it != inputs.end(); ++it)
+		{
+			if (!it->empty() && (*it)[0] == L'@')
+			{
+				AddListFile(it->substr(1), infiles);
+			}
+			else if (vibo::is_directory(*it))
+			{
+				AddDirectory(*it, infiles);
+			}
+			else
+			{
+				infiles.push_back(*it);
+			}
+		}
+		return infiles;
+	}
+
+
+	// The output is the input's name with the extension .tif, in output_directory if given. Names that are already
+	// taken by another input in the batch get a number appended (photo.jpg and photo.jpeg).
+
+	std::wstring MakeOutputName(const std::wstring& infile, const std::wstring& output_directory, std::set<std::wstring>& taken)
+	{
+		auto slash = infile.find_last_of(L"\\/");
+		std::wstring directory = (slash == std::wstring::npos) ? std::wstring() : infile.substr(0, slash + 1);
+		std::wstring name = (slash == std::wstring::npos) ? infile : infile.substr(slash + 1);
+		auto dot = name.find_last_of(L'.');
+		if (dot != std::wstring::npos)
+		{
+			name = name.substr(0, dot);
+		}
+		if (!output_directory.empty())
+		{
+			directory = output_directory;
+			if (directory.back() != L'\\' && directory.back() != L'/')
+			{
+				directory += L'\\';
+			}
+		}
+		std::wstring outfile = directory + name + L".tif";
+		for (int n = 2; taken.count(outfile) > 0; ++n)
+		{
+			outfile = directory + name + L"_" + std::to_wstring(n) + L".tif";
+		}
+		taken.insert(outfile);
+		return outfile;
+	}
+
+
+	// Runs fn, and returns the error message if it throws (empty if it doesn't)
+
+	template<class Fn> std::wstring CatchErrors(Fn fn)
+	{
+		try
+		{
+			fn();
+		}
+		catch (vibo::Exception& e)
+		{
+			return e.widewhat();
+		}
+		catch (std::exception& e)
+		{
+			return vibo::to_wstring(e.what());
+		}
+		return std::wstring();
+	}
+
+
+	// Collects the results from all threads, and prints one line per file
+
+	class BatchReporter
+	{
+		BatchSummary& m_summary;
+		std::mutex m_mutex; // Protects m_summary and the console
+
+	public:
+		explicit BatchReporter(BatchSummary& summary) : m_summary(summary), m_mutex()
+		{
+		}
+
+		void Skipped(const BatchJob& job)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_summary.skipped;
+			std::wcerr << L"Skipped: " << job.infile << L" (" << job.outfile << L" exists)" << std::endl;
+		}
+
+		void Failed(const BatchJob& job, const std::wstring& error)
+		{
+			_wremove(job.outfile.c_str()); // Don't leave a partial file behind
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_summary.failed;
+			m_summary.failures.push_back(job.infile + L": " + error);
+			std::wcerr << L"FAILED:  " << job.infile << L": " << error << std::endl;
+		}
+
+		void Converted(const BatchJob& job, unsigned long long in_size, unsigned long long out_size)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_summary.converted;
+			m_summary.bytes_read += in_size;
+			m_summary.bytes_written += out_size;
+			std::wcerr << L"OK:      " << job.infile << L" -> " << job.outfile << std::endl;
+		}
+
+		void Warned(const BatchJob& job, const std::vector<std::wstring>& warnings)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto it = warnings.begin(); it != warnings.end(); ++it)
+			{
+				std::wcerr << L"Warning: " << job.infile << L": " << *it << std::endl;
+			}
+		}
+
+		BatchReporter() = delete;
+		BatchReporter(const BatchReporter&) = delete;
+		BatchReporter& operator=(const BatchReporter&) = delete;
+	};
+
+
+	int ThreadCount(int requested)
+	{
+		if (requested > 0)
+		{
+			return requested;
+		}
+		unsigned hardware = std::thread::hardware_concurrency();
+		return (hardware > 0) ? static_cast<int>(hardware) : 1;
+	}
+
+
+	void ConvertOnThreadPool(const std::vector<BatchJob>& jobs, int num_threads, const ConversionOptions& conversion, BatchReporter& reporter)
+	{
+		vibo::ThreadPool pool(num_threads);
+		std::wcerr << L"Converting " << jobs.size() << L" files on " << pool.Size() << L" threads" << std::endl;
+
+		for (auto it = jobs.begin(); it != jobs.end(); ++it)
+		{
+			const BatchJob* job = &*it;
+			pool.Submit([job, conversion, &reporter]()
+			{
+				if (vibo::file_exists(job->outfile))
+				{
+					reporter.Skipped(*job);
+					return;
+				}
+				unsigned long long in_size = 0;
+				unsigned long long out_size = 0;
+				std::vector<std::wstring> warnings;
+				std::wstring error = CatchErrors([job, conversion, &in_size, &out_size, &warnings]()
+				{
+					GraphicsVector G;
+					ReadFile(job->infile, G);
+					std::wstring outfile = job->outfile;
+					ConvertJpegToTiff(G, outfile, conversion, &warnings);
+					in_size = vibo::GetFileSize(job->infile);
+					out_size = vibo::GetFileSize(job->outfile);
+				});
+
+				if (!error.empty())
+				{
+					reporter.Failed(*job, error);
+				}
+				else
+				{
+					reporter.Warned(*job, warnings);
+					reporter.Converted(*job, in_size, out_size);
+				}
+			});
+		}
+		pool.Wait();
+	}
+
+
+	void PrintSummary(const BatchSummary& summary, const wchar_t* unit)
+	{
+		std::wcerr << std::endl;
+		std::wcerr << L"Converted: " << summary.converted << std::endl;
+		std::wcerr << L"Skipped:   " << summary.skipped << std::endl;
+		std::wcerr << L"Failed:    " << summary.failed << std::endl;
+		std::wcerr << L"Read " << summary.bytes_read << L" bytes, wrote " << summary.bytes_written << L" bytes in " << std::fixed << std::setprecision(2) << summary.seconds << L" s";
+		if (summary.seconds > 0)
+		{
+			std::wcerr << L" (" << std::setprecision(1) << summary.converted / summary.seconds << L" " << unit << L"/s)";
+		}
+		std::wcerr << std::endl;
+		for (auto it = summary.failures.begin(); it != summary.failures.end(); ++it)
+		{
+			std::wcerr << L"    " << *it << std::endl;
+		}
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------------------
+	//		Pipeline
+	// ----------------------------------------------------------------------------------------------------------------
+
+	struct PipelineItem
+	{
+		const BatchJob* job;
+		std::unique_ptr<vibo::File> input;  // From the read stage until the TIFF file is assembled
+		GraphicsVector jpeg;                // Parsed input
+		JpegIndex index;                    // Of jpeg, built while parsing
+		GraphicsVector tiff;                // Assembled output
+		std::vector<std::wstring> warnings; // Of the conversion, reported with the result
+	};
+
+	typedef vibo::BoundedQueue<std::unique_ptr<PipelineItem>> PipelineQueue;
+
+
+	// Starts the threads of one stage. Each takes items from the input queue, runs work on them and passes them on to
+	// the output queue (if any). An item that fails is reported and dropped.
+
+	template<class Work> void StartStage(int num_threads, PipelineQueue& in, PipelineQueue* out, BatchReporter& reporter, Work work, std::vector<std::thread>& threads)
+	{
+		for (int i = 0; i < num_threads; ++i)
+		{
+			threads.push_back(std::thread([&in, out, &reporter, work]()
+			{
+				std::unique_ptr<PipelineItem> item;
+				while (in.Pop(item))
+				{
+					PipelineItem* p = item.get();
+					bool keep = true;
+					std::wstring error = CatchErrors([p, &keep, &work]() { keep = work(*p); });
+					if (!error.empty())
+					{
+						reporter.Failed(*p->job, error);
+					}
+					else if (keep && out != nullptr)
+					{
+						out->Push(std::move(item));
+					}
+					item.reset();
+				}
+				if (out != nullptr)
+				{
+					out->ProducerDone();
+				}
+			}));
+		}
+	}
+
+
+	void ConvertInPipeline(const std::vector<BatchJob>& jobs, const BatchOptions& options, BatchReporter& reporter)
+	{
+		int read_threads = ThreadCount(options.read_threads);
+		int parse_threads = ThreadCount(options.parse_threads);
+		int assemble_threads = ThreadCount(options.assemble_threads);
+		int write_threads = ThreadCount(options.write_threads);
+		size_t capacity = static_cast<size_t>(options.queue_capacity > 0 ? options.queue_capacity : 1);
+
+		std::wcerr << L"Converting " << jobs.size() << L" files in a pipeline of " << read_threads << L" read, " << parse_threads << L" parse, "
+			<< assemble_threads << L" assemble and " << write_threads << L" write threads" << std::endl;
+
+		PipelineQueue to_read(jobs.size(), 1);
+		PipelineQueue to_parse(capacity, read_threads);
+		PipelineQueue to_assemble(capacity, parse_threads);
+		PipelineQueue to_write(capacity, assemble_threads);
+
+		for (auto it = jobs.begin(); it != jobs.end(); ++it)
+		{
+			std::unique_ptr<PipelineItem> item(new PipelineItem());
+			item->job = &*it;
+			to_read.Push(std::move(item));
+		}
+		to_read.ProducerDone();
+
+		std::vector<std::thread> threads;
+
+		StartStage(read_threads, to_read, &to_parse, reporter, [&reporter](PipelineItem& item)
+		{
+			if (vibo::file_exists(item.job->outfile))
+			{
+				reporter.Skipped(*item.job);
+				return false;
+			}
+			item.input = OpenGraphicsFile(item.job->infile, true);
+			return true;
+		}, threads);
+
+		StartStage(parse_threads, to_parse, &to_assemble, reporter, [](PipelineItem& item)
+		{
+			ParseGraphicsFile(*item.input, item.job->infile, item.jpeg, &item.index);
+			return true;
+		}, threads);
+
+		ConversionOptions conversion = options.conversion;
+		StartStage(assemble_threads, to_assemble, &to_write, reporter, [conversion](PipelineItem& item)
+		{
+			item.tiff = AssembleTiff(item.jpeg, item.index, conversion, &item.warnings);
+			item.index = JpegIndex();
+			item.jpeg.clear();
+			item.input.reset(); // The segments keep the mapping (or the file handle) alive
+			return true;
+		}, threads);
+
+		StartStage(write_threads, to_write, nullptr, reporter, [&reporter](PipelineItem& item)
+		{
+			WriteTiff(item.tiff, item.job->outfile);
+			item.tiff.clear();
+			reporter.Warned(*item.job, item.warnings);
+			reporter.Converted(*item.job, vibo::GetFileSize(item.job->infile), vibo::GetFileSize(item.job->outfile));
+			return true;
+		}, threads);
+
+		for (auto it = threads.begin(); it != threads.end(); ++it)
+		{
+			it->join();
+		}
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------------------
+	//		Multi-page file
+	// ----------------------------------------------------------------------------------------------------------------
+
+	struct PageItem
+	{
+		std::wstring infile;
+		GraphicsVector jpeg;                       // Parsed input
+		JpegIndex index;                           // Of jpeg, built while parsing
+		bool parsed;
+		std::exception_ptr error;                  // Thrown while parsing
+		std::shared_ptr<TiffDirectory> directory;  // Assembled, but written only when the next page's offset is known
+	};
+
+
+	// Parses the pages on a thread pool, at most window pages ahead of the last one taken
+
+	class PageParser
+	{
+		const std::vector<std::wstring>& m_infiles;
+		std::vector<std::unique_ptr<PageItem>> m_pages;
+		std::mutex m_mutex;                 // Protects PageItem::parsed and PageItem::error
+		std::condition_variable m_parsed;
+		vibo::ThreadPool m_pool;            // Declared after what its tasks use, so that it is destroyed first
+		size_t m_next;                      // The next page to parse
+		size_t m_window;
+
+	public:
+		PageParser(const std::vector<std::wstring>& infiles, int num_threads, int window) : m_infiles(infiles), m_pages(infiles.size()), m_mutex(), m_parsed(), m_pool(num_threads), m_next(0), m_window(window > 0 ? window : 2 * m_pool.Size())
+		{
+			while (m_next < m_pages.size() && m_next < m_window)
+			{
+				Submit();
+			}
+		}
+
+		int Threads() const
+		{
+			return m_pool.Size();
+		}
+
+		// Waits until page i has been parsed, and rethrows what the parsing threw. The pages must be taken in order.
+		std::unique_ptr<PageItem> Take(size_t i)
+		{
+			ASSERT(i < m_next && m_pages[i] != nullptr);
+			PageItem* p = m_pages[i].get();
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_parsed.wait(lock, [p]() { return p->parsed; });
+			}
+			std::unique_ptr<PageItem> page = std::move(m_pages[i]);
+			if (m_next < m_pages.size())
+			{
+				Submit();
+			}
+			if (page->error != nullptr)
+			{
+				std::rethrow_exception(page->error);
+			}
+			return page;
+		}
+
+		PageParser() = delete;
+		PageParser(const PageParser&) = delete;
+		PageParser& operator=(const PageParser&) = delete;
+
+	private:
+		void Submit()
+		{
+			PageItem* page = new PageItem();
+			page->infile = m_infiles[m_next];
+			m_pages[m_next++].reset(page);
+			m_pool.Submit([this, page]()
+			{
+				std::exception_ptr error;
+				try
+				{
+					std::unique_ptr<vibo::File> input = OpenGraphicsFile(page->infile, true);
+					ParseGraphicsFile(*input, page->infile, page->jpeg, &page->index); // The segments keep the mapping (or the file handle) alive
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+				std::lock_guard<std::mutex> lock(m_mutex);
+				page->error = error;
+				page->parsed = true;
+				m_parsed.notify_all();
+			});
+		}
+	};
+
+
+	// Assembles and writes the pages in order. current is the page being converted, for the error message.
+
+	void WriteMultiPageTiff(const std::vector<std::wstring>& infiles, const MultiPageOptions& options, BatchReporter& reporter, BatchJob& current)
+	{
+		if (infiles.empty())
+		{
+			THROW(L"No pages to convert!");
+		}
+
+		// The format can't change once the first page is written. Unless it is clear from the size of the input, the
+		// headers of the pages are read first, up to the image data, for an estimate of the size of each page (the
+		// preview and the restart markers can make a page larger than its JPEG file).
+
+		std::vector<unsigned long long> file_sizes;
+		unsigned long long input_size = 0;
+		for (auto it = infiles.begin(); it != infiles.end(); ++it)
+		{
+			current.infile = *it;
+			file_sizes.push_back(vibo::GetFileSize(*it));
+			input_size += file_sizes.back();
+		}
+		bool bigtiff = options.conversion.bigtiff || input_size > 0xffffffffULL;
+		if (!bigtiff)
+		{
+			unsigned long long estimate = 0;
+			for (size_t i = 0; i < infiles.size() && estimate <= 0xffffffffULL; ++i)
+			{
+				current.infile = infiles[i];
+				GraphicsVector header;
+				JpegIndex index;
+				ReadJpegHeader(infiles[i], header, index);
+				estimate += EstimateTiffPageSize(index, file_sizes[i], options.conversion);
+			}
+			bigtiff = estimate > 0xffffffffULL;
+		}
+
+		vibo::File out(_wfopen(options.output_file.c_str(), L"wb"));
+		if (out == nullptr)
+		{
+			THROW(L"Error opening output file!");
+		}
+
+		PageParser parser(infiles, options.num_threads, options.pages_in_flight);
+		std::wcerr << L"Converting " << infiles.size() << L" pages to " << options.output_file << L", parsing on " << parser.Threads() << L" threads" << std::endl;
+
+		int count = vibo::size(infiles);
+		Endianness endianness = Endianness::Little;
+		Offset_t offset = 0;
+		std::unique_ptr<PageItem> previous; // Its directory hasn't been written
+		for (int i = 0; i < count; ++i)
+		{
+			current.infile = infiles[i];
+			std::unique_ptr<PageItem> page = parser.Take(i);
+			if (i == 0)
+			{
+				endianness = GetTiffEndianness(page->index, options.conversion);
+			}
+
+			TiffPage position{ offset, i, count, endianness, bigtiff };
+			std::vector<std::wstring> warnings;
+			GraphicsVector tiff = AssembleTiffPage(page->jpeg, page->index, options.conversion, position, &warnings);
+			reporter.Warned(current, warnings);
+			page->index = JpegIndex();
+			page->jpeg.clear();
+			page->directory = std::dynamic_pointer_cast<TiffDirectory>(tiff.back());
+			ASSERT(page->directory != nullptr);
+			tiff.pop_back();
+
+			if (previous != nullptr)
+			{
+				previous->directory->SetNextDirectoryOffset(page->directory->GetOffset());
+				previous->directory->RebuildBinaryData();
+				WriteGraphicsVector(GraphicsVector{ previous->directory }, out);
+			}
+			WriteGraphicsVector(tiff, out);
+			tiff.clear();
+
+			Offset_t end = vibo::CheckedAdd(page->directory->GetOffset(), page->directory->GetSize());
+			reporter.Converted(current, vibo::GetFileSize(page->infile), end - offset);
+			offset = end;
+			previous = std::move(page);
+		}
+		WriteGraphicsVector(GraphicsVector{ previous->directory }, out); // The last page has no next page
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		ConvertBatch()
+// --------------------------------------------------------------------------------------------------------------------
+
+BatchSummary ConvertBatch(const BatchOptions& options)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::wstring> infiles = ExpandInputs(options.inputs);
+
+	std::vector<BatchJob> jobs;
+	std::set<std::wstring> taken;
+	for (auto it = infiles.begin(); it != infiles.end(); ++it)
+	{
+		BatchJob job;
+		job.infile = *it;
+		job.outfile = MakeOutputName(*it, options.output_directory, taken);
+		jobs.push_back(job);
+	}
+
+	BatchSummary summary;
+	{
+		BatchReporter reporter(summary);
+		if (options.pipeline)
+		{
+			ConvertInPipeline(jobs, options, reporter);
+		}
+		else
+		{
+			ConvertOnThreadPool(jobs, options.num_threads, options.conversion, reporter);
+		}
+	}
+
+	summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	PrintSummary(summary, L"files");
+	return summary;
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		ConvertToMultiPageTiff()
+// --------------------------------------------------------------------------------------------------------------------
+
+BatchSummary ConvertToMultiPageTiff(const MultiPageOptions& options)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::wstring> infiles = ExpandInputs(options.inputs);
+
+	BatchSummary summary;
+	{
+		BatchReporter reporter(summary);
+		BatchJob current{ infiles.empty() ? std::wstring() : infiles.front(), options.output_file };
+		if (vibo::file_exists(options.output_file))
+		{
+			reporter.Skipped(current);
+		}
+		else
+		{
+			std::wstring error = CatchErrors([&infiles, &options, &reporter, &current]()
+			{
+				WriteMultiPageTiff(infiles, options, reporter, current);
+			});
+			if (!error.empty())
+			{
+				reporter.Failed(current, error); // Removes the file
+				summary.converted = 0;
+				summary.bytes_written = 0;
+			}
+		}
+	}
+
+	summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	PrintSummary(summary, L"pages");
+	return summary;
+}
@@ -0,0 +1,95 @@
+// File: Batch.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef BATCH_H_INCLUDED
+#define BATCH_H_INCLUDED
+
+#include "ConvertJpegToTiff.h"
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Batch conversion
+//
+//		Converts many files on a pool of worker threads (see ThreadPool.h). The inputs can be files, directories
+//		(searched recursively for .jpg and .jpeg files) and list files, written as @listfile, with one file name per line.
+//		Each output is named after its input, with the extension .tif, and is placed next to the input or in
+//		output_directory. Existing files are not overwritten; those inputs are skipped.
+//
+//		With pipeline set, the files go through four stages instead: read (open, map and fault in the input), parse
+//		(the JPEG segments), assemble (the TIFF file in memory) and write. Every stage has its own threads, and the stages
+//		are connected by queues of queue_capacity files; a stage that gets ahead waits for the next one, so the memory
+//		in use is bounded whatever the size of the batch.
+// --------------------------------------------------------------------------------------------------------------------
+
+struct BatchOptions
+{
+	std::vector<std::wstring> inputs;
+	std::wstring output_directory; // Empty: next to each input
+	int num_threads;               // 0: one per hardware thread
+	ConversionOptions conversion;
+
+	bool pipeline;
+	int read_threads;              // Threads per pipeline stage; 0 means one per hardware thread
+	int parse_threads;
+	int assemble_threads;
+	int write_threads;
+	int queue_capacity;            // Files waiting between two stages
+
+	BatchOptions() : inputs(), output_directory(), num_threads(0), conversion(), pipeline(false), read_threads(1), parse_threads(0), assemble_threads(1), write_threads(1), queue_capacity(4)
+	{
+	}
+};
+
+
+struct BatchSummary
+{
+	int converted;
+	int failed;
+	int skipped;
+	unsigned long long bytes_read;
+	unsigned long long bytes_written;
+	double seconds;
+	std::vector<std::wstring> failures; // "file: reason"
+
+	BatchSummary() : converted(0), failed(0), skipped(0), bytes_read(0), bytes_written(0), seconds(0), failures()
+	{
+	}
+};
+
+
+BatchSummary ConvertBatch(const BatchOptions& options); // Prints one line per file, and the summary at the end
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Multi-page conversion
+//
+//		Converts the inputs (as for a batch; the files of a directory in name order) into the pages of one TIFF file,
+//		in the order given. The pages are parsed on a pool of threads, and assembled and written one at a time, in
+//		order, as soon as their turn comes. Only pages_in_flight pages are parsed ahead of the one being written, so the
+//		memory in use doesn't grow with the number of pages. The directory of a page is written last, after the next
+//		page has been assembled, since it points to the next page's directory.
+//		The format of the file is decided before the first page is written: BigTIFF if conversion.bigtiff is set or the
+//		inputs are larger than 4 GB together, and the byte order of the first page (see ConversionOptions). A page
+//		that fails stops the conversion, and the output file is removed.
+// --------------------------------------------------------------------------------------------------------------------
+
+struct MultiPageOptions
+{
+	std::vector<std::wstring> inputs;
+	std::wstring output_file;      // Not overwritten if it exists
+	int num_threads;               // For the parsing. 0: one per hardware thread
+	int pages_in_flight;           // 0: two per thread
+	ConversionOptions conversion;
+
+	MultiPageOptions() : inputs(), output_file(), num_threads(0), pages_in_flight(0), conversion()
+	{
+	}
+};
+
+
+BatchSummary ConvertToMultiPageTiff(const MultiPageOptions& options); // Prints one line per page, and the summary at the end
+
+#endif
@@ -0,0 +1,88 @@
+// File: BoundedQueue.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef BOUNDEDQUEUE_H_INCLUDED
+#define BOUNDEDQUEUE_H_INCLUDED
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace vibo
+{
+	// --------------------------------------------------------------------------------------------------------------------
+	//		BoundedQueue -- blocking queue with a fixed capacity, for passing work between the stages of a pipeline
+	//
+	//		Push() waits while the queue is full, which holds back a stage that runs ahead of the next one.
+	//		Pop() waits while the queue is empty, and returns false when it is empty and every producer has called
+	//		ProducerDone().
+	// --------------------------------------------------------------------------------------------------------------------
+
+	template<class T> class BoundedQueue
+	{
+		std::mutex m_mutex;
+		std::condition_variable m_notFull;
+		std::condition_variable m_notEmpty;
+		std::deque<T> m_items;
+		size_t m_capacity;
+		int m_producers; // Producers that have not called ProducerDone()
+
+	public:
+		BoundedQueue(size_t capacity, int producers);
+
+		void Push(T item);
+		bool Pop(T& item);
+		void ProducerDone();
+
+		BoundedQueue() = delete;
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+	};
+
+
+	template<class T> BoundedQueue<T>::BoundedQueue(size_t capacity, int producers) : m_mutex(), m_notFull(), m_notEmpty(), m_items(), m_capacity(capacity > 0 ? capacity : 1), m_producers(producers)
+	{
+	}
+
+
+	template<class T> void BoundedQueue<T>::Push(T item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this]() { return m_items.size() < m_capacity; });
+		m_items.push_back(std::move(item));
+		lock.unlock();
+		m_notEmpty.notify_one();
+	}
+
+
+	template<class T> bool BoundedQueue<T>::Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [this]() { return !m_items.empty() || m_producers == 0; });
+		if (m_items.empty())
+		{
+			return false; // Closed
+		}
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		lock.unlock();
+		m_notFull.notify_one();
+		return true;
+	}
+
+
+	template<class T> void BoundedQueue<T>::ProducerDone()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		--m_producers;
+		if (m_producers == 0)
+		{
+			lock.unlock();
+			m_notEmpty.notify_all();
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,82 @@
+// File: ByteOrder.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef BYTEORDER_H_INCLUDED
+#define BYTEORDER_H_INCLUDED
+
+#include "Util.h"
+#include <stdint.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <stdlib.h> // _byteswap_ushort, _byteswap_ulong, _byteswap_uint64
+#endif
+
+namespace vibo
+{
+	// --------------------------------------------------------------------------------------------------------------------
+	//		Endian-specialized loads and stores
+	//
+	//		Load<E, T>() and Store<E, T>() read and write an unsigned integer stored with byte order E. The byte order is a
+	//		template argument, so the test against the machine's byte order is resolved at compile time: the result is a
+	//		plain load or store, or one followed by a single byte swap (bswap, or movbe where the compiler uses it).
+	//		Code that only knows the byte order at run time should dispatch once, outside its loop, to a function
+	//		templated on E, rather than call the Endianness versions in Util.h per value.
+	// --------------------------------------------------------------------------------------------------------------------
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM) || defined(_M_ARM64) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	constexpr Endianness HostEndianness = Endianness::Little;
+#else
+	constexpr Endianness HostEndianness = Endianness::Big;
+#endif
+
+
+	inline uint8_t ByteSwap(uint8_t v)
+	{
+		return v;
+	}
+
+	inline uint16_t ByteSwap(uint16_t v)
+	{
+#ifdef _MSC_VER
+		return _byteswap_ushort(v);
+#else
+		return __builtin_bswap16(v);
+#endif
+	}
+
+	inline uint32_t ByteSwap(uint32_t v)
+	{
+#ifdef _MSC_VER
+		return _byteswap_ulong(v);
+#else
+		return __builtin_bswap32(v);
+#endif
+	}
+
+	inline uint64_t ByteSwap(uint64_t v)
+	{
+#ifdef _MSC_VER
+		return _byteswap_uint64(v);
+#else
+		return __builtin_bswap64(v);
+#endif
+	}
+
+
+	template<Endianness E, class T> inline T Load(const unsigned char* p)
+	{
+		T v;
+		memcpy(&v, p, sizeof(T)); // Unaligned load
+		return (E == HostEndianness) ? v : ByteSwap(v);
+	}
+
+	template<Endianness E, class T> inline void Store(unsigned char* p, T v)
+	{
+		v = (E == HostEndianness) ? v : ByteSwap(v);
+		memcpy(p, &v, sizeof(T)); // Unaligned store
+	}
+}
+
+#endif
@@ -0,0 +1,223 @@
+// File: ByteReader.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "ByteReader.h"
+#include "Exception.h"
+#include <string.h>
+#include <algorithm>
+
+namespace vibo
+{
+	namespace // anonymous
+	{
+		const size_t BlockSize = 256 * 1024;
+	}
+
+
+	ByteReader::ByteReader(File& f, unsigned long long offset) : m_file(&f), m_stream(f), m_seekable(true), m_buffer(), m_memory(), m_owner(), m_cur(nullptr), m_end(nullptr), m_position(offset), m_eof(false), m_warnings()
+	{
+		if (f.IsMapped())
+		{
+			const std::shared_ptr<const MappedFile>& mapping = f.Mapping();
+			m_memory = mapping->View(0, mapping->Size());
+			m_owner = mapping;
+			m_cur = mapping->View(offset, mapping->Size() - offset).begin();
+			m_end = m_memory.end();
+			m_stream = nullptr;
+			m_eof = true; // Everything is available already
+		}
+		else
+		{
+			Seek(f, offset);
+		}
+	}
+
+
+	ByteReader::ByteReader(const ByteSpan& data, const std::shared_ptr<const void>& owner, unsigned long long offset) : m_file(nullptr), m_stream(nullptr), m_seekable(true), m_buffer(), m_memory(data), m_owner(owner), m_cur(nullptr), m_end(nullptr), m_position(offset), m_eof(true), m_warnings()
+	{
+		if (offset > data.size())
+		{
+			THROW(L"ByteReader: offset past the end of the data!");
+		}
+		m_cur = m_memory.begin() + offset;
+		m_end = m_memory.end();
+	}
+
+
+	ByteReader::ByteReader(FILE* stream) : m_file(nullptr), m_stream(stream), m_seekable(false), m_buffer(), m_memory(), m_owner(), m_cur(nullptr), m_end(nullptr), m_position(0), m_eof(false), m_warnings()
+	{
+		ASSERT(stream != nullptr);
+	}
+
+
+	unsigned long long ByteReader::Position() const
+	{
+		return m_position;
+	}
+
+
+	bool ByteReader::InMemory() const
+	{
+		return m_stream == nullptr;
+	}
+
+
+	bool ByteReader::IsSeekable() const
+	{
+		return m_seekable;
+	}
+
+
+	File& ByteReader::GetFile()
+	{
+		ASSERT(m_file != nullptr);
+		return *m_file;
+	}
+
+
+	ByteSpan ByteReader::View(unsigned long long offset, unsigned long long size) const
+	{
+		ASSERT(InMemory());
+		if (offset > m_memory.size() || size > m_memory.size() - offset)
+		{
+			THROW(L"ByteReader::View: range exceeds the end of the data!");
+		}
+		return ByteSpan(m_memory.data() + offset, static_cast<size_t>(size));
+	}
+
+
+	const std::shared_ptr<const void>& ByteReader::Owner() const
+	{
+		return m_owner;
+	}
+
+
+	bool ByteReader::Ensure(size_t n)
+	{
+		while (Available() < n && !m_eof)
+		{
+			Refill(n);
+		}
+		return Available() >= n;
+	}
+
+
+	const unsigned char* ByteReader::Current() const
+	{
+		return m_cur;
+	}
+
+
+	size_t ByteReader::Available() const
+	{
+		return static_cast<size_t>(m_end - m_cur);
+	}
+
+
+	void ByteReader::Advance(size_t n)
+	{
+		ASSERT(n <= Available());
+		m_cur += n;
+		m_position += n;
+	}
+
+
+	int ByteReader::GetByte()
+	{
+		if (!Ensure(1))
+		{
+			THROW(L"ByteReader::GetByte: Read error!");
+		}
+		int retval = *m_cur;
+		Advance(1);
+		return retval;
+	}
+
+
+	void ByteReader::Read(unsigned char* destination, size_t n)
+	{
+		size_t chunk = std::min(n, Available());
+		memcpy(destination, m_cur, chunk);
+		Advance(chunk);
+		n -= chunk;
+		if (n > 0)
+		{
+			// The buffer is drained; read the rest directly, without going through the buffer
+			if (m_eof || fread(destination + chunk, 1, n, m_stream) != n)
+			{
+				THROW(L"ByteReader::Read: Read error!");
+			}
+			m_position += n;
+		}
+	}
+
+
+	void ByteReader::Skip(unsigned long long n)
+	{
+		size_t chunk = static_cast<size_t>(std::min<unsigned long long>(n, Available()));
+		Advance(chunk);
+		n -= chunk;
+		if (n > 0)
+		{
+			if (m_eof)
+			{
+				THROW(L"ByteReader::Skip: Skipping past the end of the file!");
+			}
+			if (m_seekable)
+			{
+				m_position = CheckedAdd(m_position, n);
+				Seek(m_stream, m_position);
+			}
+			else
+			{
+				while (n > 0)
+				{
+					if (!Ensure(1))
+					{
+						THROW(L"ByteReader::Skip: Skipping past the end of the stream!");
+					}
+					chunk = static_cast<size_t>(std::min<unsigned long long>(n, Available()));
+					Advance(chunk);
+					n -= chunk;
+				}
+			}
+		}
+	}
+
+
+	void ByteReader::Refill(size_t n)
+	{
+		ASSERT(!InMemory());
+		size_t keep = Available();
+		if (keep > 0 && m_cur != m_buffer.data())
+		{
+			memmove(&m_buffer[0], m_cur, keep);
+		}
+		size_t capacity = std::max(BlockSize, n);
+		if (m_buffer.size() < capacity)
+		{
+			m_buffer.resize(capacity);
+		}
+		size_t got = fread(&m_buffer[keep], 1, m_buffer.size() - keep, m_stream);
+		if (got == 0)
+		{
+			m_eof = true;
+		}
+		m_cur = m_buffer.data();
+		m_end = m_cur + keep + got;
+	}
+
+
+	void ByteReader::Warn(const std::wstring& message)
+	{
+		m_warnings.push_back(message);
+	}
+
+
+	const std::vector<std::wstring>& ByteReader::Warnings() const
+	{
+		return m_warnings;
+	}
+}
@@ -0,0 +1,76 @@
+// File: ByteReader.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef BYTEREADER_H_INCLUDED
+#define BYTEREADER_H_INCLUDED
+
+#include "Util.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vibo
+{
+	// --------------------------------------------------------------------------------------------------------------------
+	//		ByteReader -- forward-only cursor over a vibo::File or a buffer in memory
+	//
+	//		Unmapped files are read in large blocks into a refillable buffer, so the parser never calls the C library per byte.
+	//		For a memory-mapped file or a memory buffer the cursor walks the bytes directly, and nothing is copied.
+	//		Current() / Available() expose the bytes that are buffered at the cursor; Ensure(n) makes at least n of them available.
+	//		A stream (a pipe, stdin) is read the same way, but never seeked: Skip() reads and discards, and there is no file to
+	//		refer back to, so the parser must keep whatever it needs (IsSeekable() is false).
+	//		The parser reports recoverable problems with Warn(); the caller decides whether and where to show them.
+	// --------------------------------------------------------------------------------------------------------------------
+
+	class ByteReader
+	{
+		File* m_file;                       // Null when reading from memory or a stream
+		FILE* m_stream;                     // What the block buffer is read from; null when the input is in memory
+		bool m_seekable;
+		ByteVector m_buffer;                // Block buffer, only used for an unmapped file or a stream
+		ByteSpan m_memory;                  // All of the input, when it is in memory (mapped file or memory buffer)
+		std::shared_ptr<const void> m_owner; // Keeps m_memory alive; may be null for a buffer owned by the caller
+		const unsigned char* m_cur;
+		const unsigned char* m_end;
+		unsigned long long m_position;      // Input offset of m_cur
+		bool m_eof;
+		std::vector<std::wstring> m_warnings;
+
+	public:
+		ByteReader(File& f, unsigned long long offset);
+		ByteReader(const ByteSpan& data, const std::shared_ptr<const void>& owner, unsigned long long offset);
+		explicit ByteReader(FILE* stream); // Forward only, from the current position of the stream, which counts as offset 0
+
+		unsigned long long Position() const;
+		bool InMemory() const;
+		bool IsSeekable() const;
+		File& GetFile(); // Only for a vibo::File
+
+		// When InMemory(): the bytes at [offset, offset+size) of the input, and the object that keeps them alive
+		ByteSpan View(unsigned long long offset, unsigned long long size) const;
+		const std::shared_ptr<const void>& Owner() const;
+
+		bool Ensure(size_t n); // Returns false if the input ends before n bytes are available
+		const unsigned char* Current() const;
+		size_t Available() const;
+		void Advance(size_t n); // n <= Available()
+
+		int GetByte();
+		void Read(unsigned char* destination, size_t n);
+		void Skip(unsigned long long n);
+
+		void Warn(const std::wstring& message);
+		const std::vector<std::wstring>& Warnings() const;
+
+		ByteReader() = delete;
+		ByteReader(const ByteReader&) = delete;
+		ByteReader& operator=(const ByteReader&) = delete;
+
+	private:
+		void Refill(size_t n);
+	};
+}
+
+#endif
@@ -0,0 +1,144 @@
+// File: ByteSwap.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "ByteSwap.h"
+#include "ByteOrder.h"
+#include "CpuFeatures.h"
+#include "Exception.h"
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define BYTESWAP_X86
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+
+namespace // anonymous
+{
+	template<class T> void SwapElements(unsigned char* data, size_t size)
+	{
+		for (size_t i = 0; i + sizeof(T) <= size; i += sizeof(T))
+		{
+			T v;
+			memcpy(&v, data + i, sizeof(T));
+			v = vibo::ByteSwap(v);
+			memcpy(data + i, &v, sizeof(T));
+		}
+	}
+
+
+	void SwapScalarFrom(unsigned char* data, size_t size, size_t i, int element_size)
+	{
+		switch (element_size)
+		{
+		case 1: break;
+		case 2: SwapElements<uint16_t>(data + i, size - i); break;
+		case 4: SwapElements<uint32_t>(data + i, size - i); break;
+		case 8: SwapElements<uint64_t>(data + i, size - i); break;
+		default: THROW(L"SwapBytes: The element size must be 1, 2, 4 or 8");
+		}
+	}
+
+
+#ifdef BYTESWAP_X86
+	// pshufb control that reverses each element_size group of bytes within 16 bytes
+
+	__m128i ShuffleMask(int element_size)
+	{
+		alignas(16) unsigned char mask[16];
+		for (int j = 0; j < 16; ++j)
+		{
+			mask[j] = static_cast<unsigned char>((j / element_size) * element_size + element_size - 1 - j % element_size);
+		}
+		return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+	}
+#endif
+
+
+	typedef void(*SwapFunction)(unsigned char*, size_t, int);
+
+	SwapFunction SelectSwapFunction()
+	{
+#ifdef BYTESWAP_X86
+		if (vibo::CpuHasAVX2())
+		{
+			return &vibo::SwapBytesAVX2;
+		}
+		if (vibo::CpuHasSSSE3())
+		{
+			return &vibo::SwapBytesSSSE3;
+		}
+#endif
+		return &vibo::SwapBytesScalar;
+	}
+}
+
+
+namespace vibo
+{
+	// --------------------------------------------------------------------------------------------------------------------
+	//		SwapBytes()
+	// --------------------------------------------------------------------------------------------------------------------
+
+	void SwapBytes(unsigned char* data, size_t size, int element_size)
+	{
+		static const SwapFunction swap = SelectSwapFunction();
+		ASSERT(element_size > 0 && size % element_size == 0);
+		if (element_size != 1)
+		{
+			swap(data, size, element_size);
+		}
+	}
+
+
+	void SwapBytesScalar(unsigned char* data, size_t size, int element_size)
+	{
+		SwapScalarFrom(data, size, 0, element_size);
+	}
+
+
+	// --------------------------------------------------------------------------------------------------------------------
+	//		SIMD versions
+	//
+	//		One byte shuffle per vector. The vector sizes are multiples of every element size, so elements never straddle
+	//		two vectors, and the same 16-byte control serves both lanes of an AVX2 register. The remainder that does not
+	//		fill a vector is handled by the scalar loop.
+	// --------------------------------------------------------------------------------------------------------------------
+
+	void SwapBytesSSSE3(unsigned char* data, size_t size, int element_size)
+	{
+		size_t i = 0;
+#ifdef BYTESWAP_X86
+		if (element_size == 2 || element_size == 4 || element_size == 8)
+		{
+			const __m128i mask = ShuffleMask(element_size);
+			for (; i + 16 <= size; i += 16)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_shuffle_epi8(v, mask));
+			}
+		}
+#endif
+		SwapScalarFrom(data, size, i, element_size);
+	}
+
+
+	void SwapBytesAVX2(unsigned char* data, size_t size, int element_size)
+	{
+		size_t i = 0;
+#ifdef BYTESWAP_X86
+		if (element_size == 2 || element_size == 4 || element_size == 8)
+		{
+			const __m256i mask = _mm256_broadcastsi128_si256(ShuffleMask(element_size));
+			for (; i + 32 <= size; i += 32)
+			{
+				__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_shuffle_epi8(v, mask));
+			}
+		}
+#endif
+		SwapScalarFrom(data, size, i, element_size);
+	}
+}
@@ -0,0 +1,30 @@
+// File: ByteSwap.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef BYTESWAP_H_INCLUDED
+#define BYTESWAP_H_INCLUDED
+
+#include <stddef.h>
+
+namespace vibo
+{
+	// --------------------------------------------------------------------------------------------------------------------
+	//		In-place byte swapping of arrays
+	//
+	//		Reverses the byte order of each element of data[0..size), 16 (SSSE3) or 32 (AVX2) bytes at a time.
+	//		element_size is 1, 2, 4 or 8; 1 leaves the data as it is. size must be a multiple of element_size.
+	//		A TIFF rational is two 4-byte values, and is swapped with element_size 4.
+	//		The implementation is chosen at runtime; there is a scalar fallback.
+	// --------------------------------------------------------------------------------------------------------------------
+
+	void SwapBytes(unsigned char* data, size_t size, int element_size);
+
+	// The implementations, exposed so that they can be compared with each other. Use SwapBytes().
+	void SwapBytesScalar(unsigned char* data, size_t size, int element_size);
+	void SwapBytesSSSE3(unsigned char* data, size_t size, int element_size);
+	void SwapBytesAVX2(unsigned char* data, size_t size, int element_size);
+}
+
+#endif
@@ -13,105 +13,424 @@
 #include "Exception.h"
 #include <iostream>
 #include "ReadJpegMetadata.h"
+#include "TiffLayout.h"
+#include "ByteSwap.h"
+#include "JpegRestart.h"
+#include "JpegPreview.h"
 #include <memory>
+#include <functional>
+#include <algorithm>
 
 
-std::shared_ptr<TiffHeader> FindTiffHeader(std::vector<std::shared_ptr<FileSegment>>& vec)
+std::shared_ptr<FileSegment> MakeTiffHeader(Endianness e, Offset_t offset, Offset_t directory_offset, bool bigtiff)
 {
-	for (auto it = vec.begin(); it != vec.end(); ++it)
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffHeader, e, offset, bigtiff ? 16 : 8);
+	std::shared_ptr<TiffHeader> hdr = std::dynamic_pointer_cast<TiffHeader>(S);
+	ASSERT(hdr != nullptr);
+	hdr->SetDirectoryOffset(directory_offset);
+	hdr->SetBigTiff(bigtiff);
+	hdr->RebuildBinaryData();
+	return S;
+}
+
+
+std::shared_ptr<FileSegment> MakeJpegStartOfImage(Offset_t offset)
+{
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegStartOfImage, Endianness::Big, offset, 2); // Jpeg always Big-endian
+	ASSERT(S != nullptr);
+	S->RebuildBinaryData();
+	return S;
+}
+
+
+std::shared_ptr<FileSegment> MakeJpegEndOfImage(Offset_t offset)
+{
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegEndOfImage, Endianness::Big, offset, 2); // Jpeg always Big-endian
+	ASSERT(S != nullptr);
+	S->RebuildBinaryData();
+	return S;
+}
+
+
+std::shared_ptr<FileSegment> MakeJpegStartOfFrame(const JpegStartOfFrame& sof, int image_length)
+{
+	vibo::ByteSpan D = sof.Data();
+	ByteVector data(D.begin(), D.end());
+	vibo::PutUShort(&data[5], static_cast<uint16_t>(image_length), Endianness::Big); // Jpeg always Big-endian
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegStartOfFrame, Endianness::Big, 0, vibo::size(data));
+	S->AssignData(std::move(data));
+	return S;
+}
+
+
+std::shared_ptr<FileSegment> MakeJpegRestartMarker(int n)
+{
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegRestartMarker, Endianness::Big, 0, 2);
+	S->AssignData(ByteVector{ 0xff, static_cast<unsigned char>(0xd0 + n % 8) });
+	return S;
+}
+
+
+std::shared_ptr<FileSegment> MakeTiffLongTable(Segmenttype seg, const std::vector<uint32_t>& values, Endianness e)
+{
+	std::shared_ptr<FileSegment> S = CreateSegment(seg, e, 0, 0);
+	std::shared_ptr<TiffNumericVectorT<uint32_t, Datatype::Ulong>> table = std::dynamic_pointer_cast<TiffNumericVectorT<uint32_t, Datatype::Ulong>>(S);
+	ASSERT(table != nullptr);
+	table->assign(values);
+	return S;
+}
+
+
+std::shared_ptr<FileSegment> MakeTiffLong8Table(Segmenttype seg, const std::vector<uint64_t>& values, Endianness e)
+{
+	std::shared_ptr<FileSegment> S = CreateSegment(seg, e, 0, 0);
+	std::shared_ptr<TiffNumericVectorT<uint64_t, Datatype::Long8>> table = std::dynamic_pointer_cast<TiffNumericVectorT<uint64_t, Datatype::Long8>>(S);
+	ASSERT(table != nullptr);
+	table->assign(values);
+	return S;
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Offsets and sizes
+//
+//		Values that are offsets into the file, or sizes of parts of it, are LONG in a TIFF file. In a BigTIFF file
+//		they are LONG8 (IFD8 for a directory), so that they can go beyond 4 GB.
+// --------------------------------------------------------------------------------------------------------------------
+
+int OffsetSize(const TiffLayout& L)
+{
+	return L.IsBigTiff() ? 8 : 4;
+}
+
+
+int OffsetDatatype(const TiffLayout& L, bool directory = false)
+{
+	if (!L.IsBigTiff())
 	{
-		if ((*it)->GetSegmenttype() == Segmenttype::TiffHeader)
+		return Datatype::Ulong;
+	}
+	return directory ? Datatype::IFD8 : Datatype::Long8;
+}
+
+
+// A single offset or size, in the entry
+
+TiffDirEntry FileOffsetEntry(int tag, unsigned long long value, const TiffLayout& L, Endianness e, bool directory = false)
+{
+	if (L.IsBigTiff())
+	{
+		return TiffDirEntry(tag, OffsetDatatype(L, directory), 1, AsLong8(value), e);
+	}
+	return TiffDirEntry(tag, Datatype::Ulong, 1, AsOffset(value), e);
+}
+
+
+std::shared_ptr<FileSegment> MakeTiffOffsetTable(Segmenttype seg, const std::vector<uint64_t>& values, const TiffLayout& L, Endianness e)
+{
+	if (L.IsBigTiff())
+	{
+		return MakeTiffLong8Table((seg == Segmenttype::TiffBytecountTable) ? Segmenttype::TiffBytecountTable8 : Segmenttype::TiffOffsetTable8, values, e);
+	}
+	return MakeTiffLongTable(seg, std::vector<uint32_t>(values.begin(), values.end()), e);
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Strips
+//
+//		A JPEG image with restart markers can be cut at the markers into strips of whole MCU rows. Each strip is then a
+//		JPEG image of its own (its tables are in JPEGTables), and a reader can decode the strips independently of each
+//		other. Nothing is re-encoded: a strip gets a copy of the frame segments, with the height of the strip, and its
+//		part of the entropy-coded data. The restart markers inside a strip are renumbered to start at 0.
+// --------------------------------------------------------------------------------------------------------------------
+
+StripPlan PlanStrips(const JpegIndex& index)
+{
+	StripPlan plan{ 1, 0, 0 };
+	if (index.sof == nullptr || index.dri == nullptr || vibo::size(index.sos) != 1 || vibo::size(index.image_data) != 1)
+	{
+		return plan;
+	}
+	const JpegStartOfFrame& sof = *index.sof;
+	int interval = index.dri->GetRestartInterval();
+	int numComponents = sof.GetNumComponents();
+	if (interval <= 0 || sof.GetImageWidth() <= 0 || sof.GetImageLength() <= 0 || index.sos.front()->GetNumComponents() != numComponents)
+	{
+		return plan; // No restart markers, the height is given later (in a DNL segment), or not one interleaved scan
+	}
+
+	// A single component is coded in 8x8 blocks whatever its sampling factors
+	int mcu_width = 8;
+	int mcu_height = 8;
+	if (numComponents > 1)
+	{
+		for (int i = 0; i < numComponents; ++i)
 		{
-			std::shared_ptr<TiffHeader> hdr = std::dynamic_pointer_cast<TiffHeader>(*it);
-			ASSERT(hdr != nullptr);
-			return hdr;
+			mcu_width = std::max(mcu_width, 8 * sof.GetHorizontalSamplingFactor(i));
+			mcu_height = std::max(mcu_height, 8 * sof.GetVerticalSamplingFactor(i));
 		}
 	}
-	ASSERT(false);
-	return std::shared_ptr<TiffHeader>{}; // Not reached
+	long long mcus_per_row = (sof.GetImageWidth() + mcu_width - 1) / mcu_width;
+	long long mcu_rows = (sof.GetImageLength() + mcu_height - 1) / mcu_height;
+	long long num_intervals = (mcus_per_row * mcu_rows + interval - 1) / interval;
+	if (vibo::size(index.image_data.front()->GetRestartOffsets()) + 1 != num_intervals)
+	{
+		return plan; // Missing or extra markers. Not safe to cut.
+	}
+
+	// A strip must end both at a restart marker and at the end of an MCU row
+	long long a = interval;
+	long long b = mcus_per_row;
+	while (b != 0)
+	{
+		long long t = a % b;
+		a = b;
+		b = t;
+	}
+	long long intervals_per_strip = mcus_per_row / a;
+	long long mcu_rows_per_strip = intervals_per_strip * interval / mcus_per_row;
+	if (mcu_rows_per_strip >= mcu_rows)
+	{
+		return plan;
+	}
+	plan.num_strips = static_cast<int>((mcu_rows + mcu_rows_per_strip - 1) / mcu_rows_per_strip);
+	plan.intervals_per_strip = static_cast<int>(intervals_per_strip);
+	plan.rows_per_strip = static_cast<int>(mcu_rows_per_strip * mcu_height);
+	return plan;
 }
 
 
-ByteVector change_endianness(const ByteVector& data, int elementsize)
+std::pair<TiffLayout::Slot, TiffLayout::Slot> AddJpegStrip(TiffLayout& L, const JpegIndex& index, const StripPlan& plan, int s)
 {
-	if (elementsize == 1)
+	const JpegImageData& data = *index.image_data.front();
+	const std::vector<Offset_t>& restarts = data.GetRestartOffsets();
+	int num_intervals = vibo::size(restarts) + 1;
+	int first = s * plan.intervals_per_strip;
+	int last = std::min(first + plan.intervals_per_strip, num_intervals); // One past the last interval of the strip
+	int length = std::min(plan.rows_per_strip, index.sof->GetImageLength() - s * plan.rows_per_strip);
+
+	// Interval i runs from the marker before it (or the start of the data) to the marker after it (or the end)
+	auto begin = [&](int i) { return (i == 0) ? 0 : restarts[i - 1] + 2; };
+	auto end = [&](int i) { return (i == num_intervals - 1) ? data.GetSize() : restarts[i]; };
+
+	// No padding inside the strip; it would end up in the JPEG data
+	TiffLayout::Slot first_slot = L.Add(MakeJpegStartOfImage(0), false);
+	for (auto it = index.frame.begin(); it != index.frame.end(); ++it)
 	{
-		return data;
+		Segmenttype seg = (*it)->GetSegmenttype();
+		if (seg == Segmenttype::JpegStartOfFrame)
+		{
+			L.Add(MakeJpegStartOfFrame(*index.sof, length), false);
+		}
+		else if (seg == Segmenttype::JpegImageData)
+		{
+			if (first % 8 == 0)
+			{
+				L.Add(data.Part(begin(first), end(last - 1) - begin(first)), false); // The markers already count from 0
+			}
+			else
+			{
+				for (int i = first; i < last; ++i)
+				{
+					if (i > first)
+					{
+						L.Add(MakeJpegRestartMarker(i - 1 - first), false);
+					}
+					L.Add(data.Part(begin(i), end(i) - begin(i)), false);
+				}
+			}
+		}
+		else
+		{
+			L.Add((*it)->Clone(), false);
+		}
 	}
-	int size = vibo::size(data);
-	ByteVector retval(size);
-	for (int i = 0; i < size; i += elementsize)
+	TiffLayout::Slot last_slot = L.Add(MakeJpegEndOfImage(0));
+	return std::make_pair(first_slot, last_slot);
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		EstimateTiffFileSize()
+//
+//		An upper bound of the size of the TIFF file, which decides if it must be a BigTIFF file. It is needed before the
+//		file is planned, as the format decides the sizes of the header and the directories, and as planning moves the
+//		image data out of G.
+// --------------------------------------------------------------------------------------------------------------------
+
+unsigned long long EstimateStripOverhead(const JpegIndex& index) // Each strip gets a copy of the other frame segments
+{
+	unsigned long long frame = 0;
+	for (auto it = index.frame.begin(); it != index.frame.end(); ++it)
 	{
-		for (int j = 0; j < elementsize; ++j)
+		if ((*it)->GetSegmenttype() != Segmenttype::JpegImageData)
 		{
-			retval[i + j] = data[i + elementsize - j - 1];
+			frame += (*it)->GetSize();
 		}
 	}
-	return retval;
+	return frame + 4 + 1 + 16; // SOI and EOI, padding, and the strip tables
 }
 
 
-std::shared_ptr<FileSegment> MakeTiffHeader(Endianness e, Offset_t offset)
+unsigned long long EstimateTiffFileSize(const JpegIndex& index, const DcPreview* preview)
 {
-	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffHeader, e, offset, 8);
-	S->RebuildBinaryData();
-	return S;
+	unsigned long long image_data = 0;
+	for (auto it = index.frame.begin(); it != index.frame.end(); ++it)
+	{
+		if ((*it)->GetSegmenttype() == Segmenttype::JpegImageData)
+		{
+			image_data += (*it)->GetSize();
+		}
+	}
+
+	// The metadata, and the EXIF thumbnail, are copied from the APP segments
+	unsigned long long other = 0;
+	for (auto it = index.tables.begin(); it != index.tables.end(); ++it)
+	{
+		other += (*it)->GetSize() + 1;
+	}
+	for (auto it = index.app1.begin(); it != index.app1.end(); ++it)
+	{
+		other += (*it)->GetSize();
+	}
+	for (auto it = index.app2.begin(); it != index.app2.end(); ++it)
+	{
+		other += (*it)->GetSize();
+	}
+	if (preview != nullptr)
+	{
+		other += preview->pixels.size();
+	}
+
+	unsigned long long num_strips = PlanStrips(index).num_strips;
+	const unsigned long long slack = 0x10000; // The header, the directories, and the padding
+	return image_data + num_strips * EstimateStripOverhead(index) + other + slack;
 }
 
 
-std::shared_ptr<FileSegment> MakeJpegStartOfImage(Offset_t offset)
+// --------------------------------------------------------------------------------------------------------------------
+//		EstimateTiffPageSize()
+//
+//		As EstimateTiffFileSize(), but from the segments before the image data (see ReadJpegHeader()) and the size of the
+//		file, so that the image data is not read: it is bounded by the size of the file. The preview is not made, and the
+//		restart markers are not inserted; their sizes, and the number of strips, are bounded from the dimensions in the
+//		SOF segment.
+// --------------------------------------------------------------------------------------------------------------------
+
+unsigned long long EstimateTiffPageSize(const JpegIndex& header, unsigned long long file_size, const ConversionOptions& options)
 {
-	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegStartOfImage, Endianness::Big, offset, 2); // Jpeg always Big-endian
-	ASSERT(S != nullptr);
-	S->RebuildBinaryData();
-	return S;
+	unsigned long long size = EstimateTiffFileSize(header, nullptr) + file_size;
+	if (header.sof == nullptr || header.sof->GetImageWidth() <= 0 || header.sof->GetImageLength() <= 0)
+	{
+		return size;
+	}
+
+	// An MCU is at least 8x8 pixels
+	unsigned long long blocks_per_row = (header.sof->GetImageWidth() + 7) / 8;
+	unsigned long long block_rows = (header.sof->GetImageLength() + 7) / 8;
+	unsigned long long num_components = header.sof->GetNumComponents();
+
+	if (options.preview)
+	{
+		size += blocks_per_row * block_rows * num_components; // A sample of each component for each 8x8 block, see MakeDcPreview()
+	}
+	if (header.dri != nullptr && header.dri->GetRestartInterval() != 0)
+	{
+		size += block_rows * EstimateStripOverhead(header); // At most a strip for each MCU row
+	}
+	else if (options.restart_rows > 0)
+	{
+		// A new strip at each marker. The marker itself, the padding before it, and the first DC differences after it,
+		// which are coded again, add at most 2 + 2 + 8 bytes for each component (with byte stuffing).
+		unsigned long long num_markers = block_rows / options.restart_rows;
+		size += num_markers * (EstimateStripOverhead(header) + 4 + 8 * num_components);
+	}
+	return size;
 }
 
 
-std::shared_ptr<FileSegment> MakeJpegEndOfImage(Offset_t offset)
+// --------------------------------------------------------------------------------------------------------------------
+//		Planned directory entries
+//
+//		The value of many entries is an offset into the output file, which is not known until the layout is planned.
+//		The number of entries must be known when planning (it decides the size of the directory), so the entries are
+//		collected as functions that make the entry from the planned layout.
+// --------------------------------------------------------------------------------------------------------------------
+
+typedef std::function<TiffDirEntry(const TiffLayout&)> PlannedEntry;
+
+
+PlannedEntry FixedEntry(const TiffDirEntry& e)
 {
-	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegEndOfImage, Endianness::Big, offset, 2); // Jpeg always Big-endian
-	ASSERT(S != nullptr);
-	S->RebuildBinaryData();
+	return [e](const TiffLayout&) { return e; };
+}
+
+
+std::shared_ptr<FileSegment> MakeTiffDirectory(const std::vector<PlannedEntry>& entries, const TiffLayout& L, Endianness e, bool sort_entries)
+{
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffDirectory, e, 0, 0);
+	std::shared_ptr<TiffDirectory> dir = std::dynamic_pointer_cast<TiffDirectory>(S);
+	ASSERT(dir != nullptr);
+	dir->SetBigTiff(L.IsBigTiff());
+	for (auto it = entries.begin(); it != entries.end(); ++it)
+	{
+		dir->AddEntry((*it)(L));
+	}
+	if (sort_entries)
+	{
+		dir->SortEntries();
+	}
+	dir->RebuildBinaryData();
 	return S;
 }
 
 
 // --------------------------------------------------------------------------------------------------------------------
-//		Write_Selected_Entries()
+//		Plan_Selected_Entries()
 // --------------------------------------------------------------------------------------------------------------------
 
 typedef bool selector_function(int, int);
 
-// Writes data corresponding to the entries to outfile if sizeof(data) > 4
-// Stores TIFF directory entries in dir_entries, which is returned, and must be written by the caller.
+// Adds the data corresponding to the entries to the layout if sizeof(data) > 4 (8 in a BigTIFF file)
+// Returns the TIFF directory entries, which must be placed in a directory by the caller.
 
-std::vector<TiffDirEntry> Write_Selected_Entries(std::vector<std::tuple<TiffDirEntry, ByteVector>>& dir_info, GraphicsVector& outfile, Endianness exif_endianness, Endianness outfile_endianness, selector_function foo)
+std::vector<PlannedEntry> Plan_Selected_Entries(const std::vector<std::tuple<TiffDirEntry, ByteVector>>& dir_info, TiffLayout& L, Endianness exif_endianness, Endianness outfile_endianness, selector_function foo)
 {
-	std::vector<TiffDirEntry> dir_entries;
-	Offset_t offset = outfile.back()->GetOffset() + outfile.back()->GetSize();
+	std::vector<PlannedEntry> dir_entries;
+	Offset_t inline_size = L.IsBigTiff() ? 8 : 4;
 
 	if (vibo::size(dir_info) > 0)
 	{
-		// Write data, build vector of TiffDirEntries
+		// Add data, build vector of TiffDirEntries
 
 		for (int i = 0; i < vibo::size(dir_info); ++i)
 		{
-			TiffDirEntry& E = std::get<TiffDirEntry>(dir_info[i]);
-			ByteVector  V = std::get<ByteVector>(dir_info[i]); // NOT reference!
-			std::vector<TiffDirEntry> vv;
+			const TiffDirEntry& E = std::get<TiffDirEntry>(dir_info[i]);
+			const ByteVector& source = std::get<ByteVector>(dir_info[i]);
 
 			int tag = E.Tag();
 			int datatype = E.GetDataType();
-			int datacount = E.GetDataCount();
-			int datasize = E.GetDataSize();
+			ULong_t datacount = E.GetDataCount();
+			Offset_t datasize = E.GetDataSize();
 			int elementsize = E.GetElementSize();
 
+			if (datasize > 4 && source.size() != datasize)
+			{
+				continue; // The data was outside the App1 segment, see ReadDirectory()
+			}
+
 			if (foo(tag, datatype))
 			{
-				if (datasize > 4)
+				if (datasize > inline_size)
 				{
-					if (outfile_endianness != exif_endianness)
+					std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffByteVector, outfile_endianness, 0, datasize);
+					std::shared_ptr<TiffByteVector> bv = std::dynamic_pointer_cast<TiffByteVector>(S);
+					if (outfile_endianness == exif_endianness)
+					{
+						bv->assign(source); // Copied as it is
+					}
+					else
 					{
 						int elementsize_for_change_endianness = elementsize;
 						if (datatype == Datatype::Rational || datatype == Datatype::SRational)
@@ -119,39 +438,51 @@ std::vector<TiffDirEntry> Write_Selected_Entries(std::vector<std::tuple<TiffDirE
 							// Rationals are 8 bytes, but consist of two values. When changing endianness treat as 4 bytes!
 							elementsize_for_change_endianness = 4;
 						}
-						V = change_endianness(V, elementsize_for_change_endianness);
+						ByteVector V = source;
+						vibo::SwapBytes(&V[0], V.size(), elementsize_for_change_endianness);
+						bv->assign(V);
 					}
-					Offset_t data_offset = offset;
-					std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffByteVector, outfile_endianness, offset, datasize);
-					std::shared_ptr<TiffByteVector> bv = std::dynamic_pointer_cast<TiffByteVector>(S);
-					bv->assign(V);
-					offset = AddSegmentPadded(outfile, S);
-					TiffDirEntry e(tag, datatype, datacount, AsOffset(data_offset), outfile_endianness);
-					dir_entries.push_back(e);
+					TiffLayout::Slot data_slot = L.Add(S);
+					dir_entries.push_back([=](const TiffLayout& layout) { return TiffDirEntry(tag, datatype, datacount, AsOffset(layout.GetOffset(data_slot)), outfile_endianness); });
+				}
+				else if (datasize > 4)
+				{
+					// BigTIFF: the value is in the entry
+					ByteVector V = source;
+					if (outfile_endianness != exif_endianness)
+					{
+						bool rational = (datatype == Datatype::Rational || datatype == Datatype::SRational);
+						vibo::SwapBytes(&V[0], V.size(), rational ? 4 : elementsize);
+					}
+					dir_entries.push_back(FixedEntry(TiffDirEntry(tag, datatype, datacount, V)));
+				}
+				else if (outfile_endianness == exif_endianness)
+				{
+					dir_entries.push_back(FixedEntry(E)); // The value is in the entry, already in the right byte order
 				}
 				else if (elementsize == 2 && datacount == 2)
 				{
 					AsShort ts = E.GetTwoShorts();
 					TiffDirEntry e(tag, E.GetDataType(), E.GetDataCount(), ts, outfile_endianness);
-					dir_entries.push_back(e);
+					dir_entries.push_back(FixedEntry(e));
 				}
 				else if (elementsize == 1)
 				{
 					AsByte fb = E.GetFourBytes();
 					TiffDirEntry e(tag, E.GetDataType(), E.GetDataCount(), fb, outfile_endianness);
-					dir_entries.push_back(e);
+					dir_entries.push_back(FixedEntry(e));
 				}
 				else if (elementsize == 2)// datacount == 1, elementsize == 4 or 2
 				{
 					AsShort ts = E.GetTwoShorts();
 					TiffDirEntry e(tag, E.GetDataType(), E.GetDataCount(), ts, outfile_endianness);
-					dir_entries.push_back(e);
+					dir_entries.push_back(FixedEntry(e));
 				}
 				else if (elementsize == 4)
 				{
 					uint32_t longval = E.GetLongValue();
 					TiffDirEntry e(tag, E.GetDataType(), E.GetDataCount(), longval, outfile_endianness);
-					dir_entries.push_back(e);
+					dir_entries.push_back(FixedEntry(e));
 				}
 				else
 				{
@@ -165,6 +496,133 @@ std::vector<TiffDirEntry> Write_Selected_Entries(std::vector<std::tuple<TiffDirE
 }
 
 
+// --------------------------------------------------------------------------------------------------------------------
+//		Subimages
+//
+//		Reduced-resolution images (NewSubfileType 1) in SubIFDs of the main directory. Each function adds the data of
+//		the image to the layout, and returns the entries of its directory; no entries if there is no image.
+// --------------------------------------------------------------------------------------------------------------------
+
+// BitsPerSample. For more than two samples the values do not fit in the entry, unless it is a BigTIFF file and there
+// are up to four.
+
+PlannedEntry Plan_Bits_Per_Sample(int samples_per_pixel, int bits, TiffLayout& L, Endianness e)
+{
+	if (samples_per_pixel <= 2)
+	{
+		return FixedEntry(TiffDirEntry(TiffTag::BitsPerSample, Datatype::Ushort, samples_per_pixel, (samples_per_pixel == 1) ? AsShort(bits) : AsShort(bits, bits), e));
+	}
+	if (L.IsBigTiff() && samples_per_pixel <= 4)
+	{
+		ByteVector V(2 * samples_per_pixel);
+		for (int i = 0; i < samples_per_pixel; ++i)
+		{
+			vibo::PutUShort(&V[2 * i], static_cast<uint16_t>(bits), e);
+		}
+		return FixedEntry(TiffDirEntry(TiffTag::BitsPerSample, Datatype::Ushort, samples_per_pixel, V));
+	}
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffUShortVector, e, 0, 0);
+	std::shared_ptr<TiffUShortVector> usv = std::dynamic_pointer_cast<TiffUShortVector>(S);
+	ASSERT(usv != nullptr);
+	usv->assign(std::vector<uint16_t>(samples_per_pixel, static_cast<uint16_t>(bits)));
+	TiffLayout::Slot slot = L.Add(S);
+	return [=](const TiffLayout& layout) { return TiffDirEntry(TiffTag::BitsPerSample, Datatype::Ushort, samples_per_pixel, AsOffset(layout.GetOffset(slot)), e); };
+}
+
+
+// The DC preview: uncompressed, in one strip
+
+std::vector<PlannedEntry> Plan_Dc_Preview(DcPreview& preview, TiffLayout& L, Endianness e)
+{
+	std::vector<PlannedEntry> entries;
+	int spp = preview.samples_per_pixel;
+	uint32_t bytecount = static_cast<uint32_t>(preview.pixels.size());
+
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffImageData, e, 0, bytecount);
+	S->AssignData(std::move(preview.pixels));
+	TiffLayout::Slot pixels_slot = L.Add(S);
+
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::NewSubfileType, Datatype::Ulong, 1, 1u, e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::ImageWidth, Datatype::Ulong, 1, static_cast<uint32_t>(preview.width), e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::ImageLength, Datatype::Ulong, 1, static_cast<uint32_t>(preview.length), e)));
+	entries.push_back(Plan_Bits_Per_Sample(spp, 8, L, e));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::Compression, Datatype::Ushort, 1, AsShort(1), e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::PhotometricInterpretation, Datatype::Ushort, 1, AsShort((spp == 1) ? 1 : 2), e))); // Min is black, or RGB
+	entries.push_back([=](const TiffLayout& layout) { return FileOffsetEntry(TiffTag::StripOffsets, layout.GetOffset(pixels_slot), layout, e); });
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::SamplesPerPixel, Datatype::Ushort, 1, AsShort(spp), e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::RowsPerStrip, Datatype::Ulong, 1, static_cast<uint32_t>(preview.length), e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::StripByteCounts, Datatype::Ulong, 1, bytecount, e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::PlanarConfig, Datatype::Ushort, 1, AsShort(1), e)));
+	return entries;
+}
+
+
+// The thumbnail of the EXIF block (IFD1): the JPEG file is copied as it is into one strip. It is only parsed for the
+// size and the sampling factors, and is left out if it is not a baseline JPEG image that the main image could be.
+
+std::vector<PlannedEntry> Plan_Exif_Thumbnail(const ByteVector& thumbnail, TiffLayout& L, Endianness e)
+{
+	std::vector<PlannedEntry> entries;
+	GraphicsVector T;
+	JpegIndex index;
+	try
+	{
+		vibo::ByteReader r(vibo::ByteSpan(thumbnail), nullptr, 0);
+		ReadJpegFileOrEmbeddedSection(r, T, 0, vibo::size(thumbnail), L"EXIF thumbnail", &index);
+	}
+	catch (vibo::Exception&)
+	{
+		return entries;
+	}
+	if (index.sof == nullptr || index.sof->GetDataByte(1) != 0xc0 || index.sof->GetPrecision() != 8)
+	{
+		return entries;
+	}
+	const JpegStartOfFrame& sof = *index.sof;
+	int spp = sof.GetNumComponents();
+	int photometric = 1; // Min is black
+	AsShort subsampling(0, 0);
+	if (spp == 3)
+	{
+		photometric = 6; // YCbCr
+		int h = sof.GetHorizontalSamplingFactor(0);
+		int v = sof.GetVerticalSamplingFactor(0);
+		bool chroma_ok = sof.GetHorizontalSamplingFactor(1) == 1 && sof.GetVerticalSamplingFactor(1) == 1 && sof.GetHorizontalSamplingFactor(2) == 1 && sof.GetVerticalSamplingFactor(2) == 1;
+		if (!chroma_ok || (h != 1 && h != 2 && h != 4) || (v != 1 && v != 2 && v != 4))
+		{
+			return entries;
+		}
+		subsampling = AsShort(h, v);
+	}
+	else if (spp != 1)
+	{
+		return entries;
+	}
+
+	uint32_t bytecount = static_cast<uint32_t>(thumbnail.size());
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffImageData, e, 0, bytecount);
+	S->AssignData(ByteVector(thumbnail));
+	TiffLayout::Slot data_slot = L.Add(S);
+
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::NewSubfileType, Datatype::Ulong, 1, 1u, e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::ImageWidth, Datatype::Ulong, 1, static_cast<uint32_t>(sof.GetImageWidth()), e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::ImageLength, Datatype::Ulong, 1, static_cast<uint32_t>(sof.GetImageLength()), e)));
+	entries.push_back(Plan_Bits_Per_Sample(spp, 8, L, e));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::Compression, Datatype::Ushort, 1, AsShort(7), e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::PhotometricInterpretation, Datatype::Ushort, 1, AsShort(photometric), e)));
+	entries.push_back([=](const TiffLayout& layout) { return FileOffsetEntry(TiffTag::StripOffsets, layout.GetOffset(data_slot), layout, e); });
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::SamplesPerPixel, Datatype::Ushort, 1, AsShort(spp), e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::RowsPerStrip, Datatype::Ulong, 1, static_cast<uint32_t>(sof.GetImageLength()), e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::StripByteCounts, Datatype::Ulong, 1, bytecount, e)));
+	entries.push_back(FixedEntry(TiffDirEntry(TiffTag::PlanarConfig, Datatype::Ushort, 1, AsShort(1), e)));
+	if (spp == 3)
+	{
+		entries.push_back(FixedEntry(TiffDirEntry(TiffTag::YCbCrSubSampling, Datatype::Ushort, 2, subsampling, e)));
+	}
+	return entries;
+}
+
+
 // --------------------------------------------------------------------------------------------------------------------
 //		Selector functions
 // --------------------------------------------------------------------------------------------------------------------
@@ -205,55 +663,139 @@ bool relevant_main_directory_tags(int tag, int datatype)
 
 // --------------------------------------------------------------------------------------------------------------------
 //		Convert Jpeg to TIFF
+//
+//		AssembleTiff() builds the TIFF file in memory; the image data is moved out of G. WriteTiff() writes it to disk.
 // --------------------------------------------------------------------------------------------------------------------
 
-void ConvertJpegToTiff(GraphicsVector& G, std::wstring& outfilename)
+void ConvertJpegToTiff(GraphicsVector& G, std::wstring& outfilename, const ConversionOptions& options, std::vector<std::wstring>* warnings)
 {
-	Endianness TiffFileEndianness = Endianness::Little;
+	GraphicsVector TiffFile = AssembleTiff(G, options, warnings);
+	WriteTiff(TiffFile, outfilename);
+}
+
 
+// --------------------------------------------------------------------------------------------------------------------
+//		In-memory conversion
+//
+//		The segments are views into the caller's buffer, which only has to live until the function returns.
+// --------------------------------------------------------------------------------------------------------------------
+
+void ConvertJpegToTiff(const unsigned char* jpeg, size_t jpeg_size, ByteVector& tiff, std::vector<std::wstring>& warnings, const ConversionOptions& options)
+{
+	if (jpeg == nullptr || jpeg_size < 4 || jpeg[0] != 0xff || jpeg[1] != 0xd8 || jpeg[2] != 0xff)
+	{
+		THROW(L"Not a jpeg file!");
+	}
+
+	GraphicsVector G;
+	JpegIndex index;
+	vibo::ByteReader r(vibo::ByteSpan(jpeg, jpeg_size), nullptr, 0);
+	ReadJpegFileOrEmbeddedSection(r, G, 0, jpeg_size, L"JPEG buffer", &index);
+	warnings = r.Warnings();
+
+	GraphicsVector TiffFile = AssembleTiff(G, index, options, &warnings);
+	WriteGraphicsVector(TiffFile, tiff);
+}
+
+
+// page: null for a file of its own. warnings: null if the caller doesn't want them
+
+GraphicsVector AssembleTiff(GraphicsVector& G, const JpegIndex& index, const ConversionOptions& options, const TiffPage* page, std::vector<std::wstring>* warnings)
+{
 	// Check if the GraphicsVector contains a jpeg image
 
-	auto check_jpeg = G.begin();
-	if ((*check_jpeg)->GetSegmenttype() != Segmenttype::JpegStartOfImage)
+	if (G.empty() || G.front()->GetSegmenttype() != Segmenttype::JpegStartOfImage)
 	{
 		THROW(L"Error: the input file was not a JPEG image!");
 	}
 
 	// Check if the start-of-frame segment is a baseline DCT segment (marker: ff c0)
 
-	for (auto it = G.begin(); it != G.end(); ++it)
+	if (index.sof != nullptr)
 	{
-		Segmenttype seg = (*it)->GetSegmenttype();
-		if (seg == Segmenttype::JpegStartOfFrame)
+		int b1 = index.sof->GetDataByte(0);
+		int b2 = index.sof->GetDataByte(1);
+		ASSERT(b1 == 0xff);
+		if (b2 != 0xc0)
 		{
-			int b1 = (*it)->GetDataByte(0);
-			int b2 = (*it)->GetDataByte(1);
-			ASSERT(b1 == 0xff);
-			if (b2 != 0xc0)
-			{
-				THROW(L"Sorry, this JPEG cannot be processed. The start-of-frame marker needs to be ff c0 (baseline DCT).");
-			}
+			THROW(L"Sorry, this JPEG cannot be processed. The start-of-frame marker needs to be ff c0 (baseline DCT).");
+		}
+	}
+
+	// Restart markers are inserted in a copy of the index, which then refers to the new image data
+
+	if (options.restart_rows > 0)
+	{
+		JpegIndex restarted = index;
+		RestartResult result = InsertRestartMarkers(restarted, options.restart_rows);
+		if (result == RestartResult::Inserted)
+		{
+			ConversionOptions rest = options;
+			rest.restart_rows = 0;
+			return AssembleTiff(G, restarted, rest, page, warnings);
+		}
+		if (warnings != nullptr && result == RestartResult::NotDecodable)
+		{
+			warnings->push_back(L"-restart is ignored, as the image is not a baseline JPEG image with one scan that can be decoded");
+		}
+		else if (warnings != nullptr && result == RestartResult::NoDcCode)
+		{
+			warnings->push_back(L"-restart is ignored, as the Huffman tables of the image are optimized, and have no code for a DC difference that restart markers need");
 		}
 	}
 
-	std::vector<std::shared_ptr<FileSegment>> TiffFile;
-	Offset_t offset = 0;
+	// The preview is made before the image data is moved out of G
+
+	DcPreview preview;
+	bool has_preview = options.preview && MakeDcPreview(index, preview);
+
+	// The EXIF block is read first, as it may decide the byte order of the file
+
+	exif_info Exif_Info;
+
+	if (vibo::size(index.app1) > 0)
+	{
+		Exif_Info = ReadApp1Metadata(index.app1); // Only read, so no need for a copy
+	}
+	Endianness exif_endianness = Exif_Info.endianness;
+
+	Endianness TiffFileEndianness = GetTiffEndianness(index, options); // The same choice as for the pages of a multi-page file
+
+	// A BigTIFF file if asked for, or if the file could be too large for TIFF
+
+	bool bigtiff = options.bigtiff || EstimateTiffFileSize(index, has_preview ? &preview : nullptr) > 0xffffffffULL;
+
+	// A page of a multi-page file is in the file's format, and only the first one has the header
+
+	Offset_t start = 0;
+	if (page != nullptr)
+	{
+		TiffFileEndianness = page->endianness;
+		bigtiff = page->bigtiff;
+		start = page->offset;
+	}
+
+	// The file is planned first (sizes only), then the offsets are assigned, and only then are the header and the
+	// directories built. See TiffLayout.h.
+
+	TiffLayout L(TiffFileEndianness, bigtiff, start);
 
 	// ____________________________________________________________________________________________________________________________________
 	//
 	//		TIFF HEADER
 	// ____________________________________________________________________________________________________________________________________
 
-	std::shared_ptr<FileSegment> hdr = MakeTiffHeader(TiffFileEndianness, offset);
-	offset = AddSegmentPadded(TiffFile, hdr);
+	TiffLayout::Slot header_slot = -1;
+	if (start == 0)
+	{
+		header_slot = L.Reserve(bigtiff ? 16 : 8); // Points to the main directory, so it is built after planning
+	}
 
 	// ____________________________________________________________________________________________________________________________________
 	//
 	//		EMBEDDED IMAGE
 	// ____________________________________________________________________________________________________________________________________
 
-	Offset_t embedded_image_offset = offset;
-
 	int imageWidth = 0;
 	int imageLength = 0;
 	int numComponents = 0;
@@ -266,197 +808,155 @@ void ConvertJpegToTiff(GraphicsVector& G, std::wstring& outfilename)
 	int verticalSampleFactor_Cr = 0;
 	int horizontalSampleFactor_Cr = 0;
 
-	std::shared_ptr<FileSegment> soi = MakeJpegStartOfImage(offset);
-	offset = AddSegmentPadded(TiffFile, soi);
-
-
-	for (auto it = G.begin(); it != G.end(); ++it)
+	if (index.sof != nullptr)
 	{
-		Segmenttype seg = (*it)->GetSegmenttype();
+		const JpegStartOfFrame& sof = *index.sof;
 
-		if (seg == Segmenttype::JpegStartOfFrame || seg == Segmenttype::JpegStartOfScan || seg == Segmenttype::JpegRestartInterval || seg == Segmenttype::JpegImageData)
+		imageWidth = sof.GetImageWidth();
+		imageLength = sof.GetImageLength();
+		bitsPerSample = sof.GetPrecision();
+		numComponents = sof.GetNumComponents();
+		if (numComponents > 2)
 		{
-			std::shared_ptr<FileSegment> S = (*it)->Clone();
-			if (seg == Segmenttype::JpegStartOfFrame)
-			{
-				std::shared_ptr<JpegStartOfFrame> sof = std::dynamic_pointer_cast<JpegStartOfFrame>(S);
-				ASSERT(sof != nullptr);
-
-				sof->SetOffset(offset);
-				imageWidth = sof->GetImageWidth();
-				imageLength = sof->GetImageLength();
-				bitsPerSample = sof->GetPrecision();
-				numComponents = sof->GetNumComponents();
-				if (numComponents > 2)
-				{
-					horizontalSampleFactor_Y = sof->GetHorizontalSamplingFactor(0);
-					horizontalSampleFactor_Cb = sof->GetHorizontalSamplingFactor(1);
-					horizontalSampleFactor_Cr = sof->GetHorizontalSamplingFactor(2);
-					verticalSampleFactor_Y = sof->GetVerticalSamplingFactor(0);
-					verticalSampleFactor_Cb = sof->GetVerticalSamplingFactor(1);
-					verticalSampleFactor_Cr = sof->GetVerticalSamplingFactor(2);
-				}
-			}
-			S->SetOffset(offset);
-			offset = AddSegmentPadded(TiffFile, S);
+			horizontalSampleFactor_Y = sof.GetHorizontalSamplingFactor(0);
+			horizontalSampleFactor_Cb = sof.GetHorizontalSamplingFactor(1);
+			horizontalSampleFactor_Cr = sof.GetHorizontalSamplingFactor(2);
+			verticalSampleFactor_Y = sof.GetVerticalSamplingFactor(0);
+			verticalSampleFactor_Cb = sof.GetVerticalSamplingFactor(1);
+			verticalSampleFactor_Cr = sof.GetVerticalSamplingFactor(2);
 		}
 	}
 
-	std::shared_ptr<FileSegment> eoi = MakeJpegEndOfImage(offset);
-	offset = AddSegmentPadded(TiffFile, eoi);
+	StripPlan strip_plan = PlanStrips(index);
 
-	Offset_t embedded_image_end = offset;
+	TiffLayout::Slot embedded_image_slot = -1;
+	TiffLayout::Slot embedded_image_last = -1;
+	std::vector<std::pair<TiffLayout::Slot, TiffLayout::Slot>> strips;
+	TiffLayout::Slot strip_offsets_slot = -1;
+	TiffLayout::Slot strip_bytecounts_slot = -1;
 
-	Offset_t jpeg_tables_start = offset;
+	if (strip_plan.num_strips == 1)
+	{
+		embedded_image_slot = L.Add(MakeJpegStartOfImage(0));
+
+		for (auto it = index.frame.begin(); it != index.frame.end(); ++it)
+		{
+			L.Add((*it)->MoveOut()); // Not needed in G any more. Avoids holding the image data twice.
+		}
+
+		embedded_image_last = L.Add(MakeJpegEndOfImage(0));
+	}
+	else
+	{
+		for (int s = 0; s < strip_plan.num_strips; ++s)
+		{
+			strips.push_back(AddJpegStrip(L, index, strip_plan, s));
+		}
+		strip_offsets_slot = L.Reserve(OffsetSize(L) * strips.size());
+		strip_bytecounts_slot = L.Reserve(OffsetSize(L) * strips.size());
+	}
 
 	// ____________________________________________________________________________________________________________________________________
 	//
 	//		JPEG TABLES
 	// ____________________________________________________________________________________________________________________________________
 
-	std::shared_ptr<FileSegment> soi2 = MakeJpegStartOfImage(offset);
-	offset = AddSegmentPadded(TiffFile, soi2);
+	TiffLayout::Slot jpeg_tables_slot = L.Add(MakeJpegStartOfImage(0));
 
-	for (auto it = G.begin(); it != G.end(); ++it)
+	for (auto it = index.tables.begin(); it != index.tables.end(); ++it)
 	{
-		Segmenttype seg = (*it)->GetSegmenttype();
-
-		if (seg ==Segmenttype::JpegQuantizationTable || seg == Segmenttype::JpegHuffmanTable)
-		{
-			std::shared_ptr<FileSegment> S = (*it)->Clone();
-			S->SetOffset(offset);
-			offset = AddSegmentPadded(TiffFile, S);
-		}
+		L.Add((*it)->Clone());
 	}
 
-	std::shared_ptr<FileSegment> eoi2 = MakeJpegEndOfImage(offset);
-	offset = AddSegmentPadded(TiffFile, eoi2);
-
-	Offset_t jpeg_tables_end = offset;
+	TiffLayout::Slot jpeg_tables_last = L.Add(MakeJpegEndOfImage(0));
 
 	// ____________________________________________________________________________________________________________________________________
 	//
 	//		ICC PROFILE
 	// ____________________________________________________________________________________________________________________________________
 
-	Offset_t icc_profile_begin = offset;
-
-	std::vector<std::shared_ptr<JpegApp2Segment>> App2Segments;
 	ByteVector ICCProfile;
-	for (auto it = G.begin(); it != G.end(); ++it)
-	{
-		Segmenttype seg = (*it)->GetSegmenttype();
-		
-		if (seg == Segmenttype::JpegApp2Segment)
-		{
-			std::shared_ptr<FileSegment> S = (*it)->Clone();
-			std::shared_ptr<JpegApp2Segment> P = std::dynamic_pointer_cast<JpegApp2Segment>(S);
-			if (P != nullptr)
-			{
-				App2Segments.push_back(P);
-			}
-		}
-	}
-	if (vibo::size(App2Segments) > 0)
+	if (vibo::size(index.app2) > 0)
 	{
-		ICCProfile = ReadIccProfile(App2Segments);
+		ICCProfile = ReadIccProfile(index.app2); // Only read, so no need for a copy
 	}
 
+	TiffLayout::Slot icc_profile_slot = -1;
 	if (vibo::size(ICCProfile) > 0)
 	{
-		std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffByteVector, TiffFileEndianness, offset, 0);
+		std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffByteVector, TiffFileEndianness, 0, 0);
 		std::shared_ptr<TiffByteVector> bv = std::dynamic_pointer_cast<TiffByteVector>(S);
 		ASSERT(bv != nullptr);
 		bv->assign(ICCProfile);
 		bv->RebuildBinaryData();
-		offset = AddSegmentPadded(TiffFile, S);
+		icc_profile_slot = L.Add(S);
 	}
 
-	Offset_t icc_profile_end = offset;
-
 	// ____________________________________________________________________________________________________________________________________
 	//
-	//		APP 1 METADATA
+	//		SUBIMAGES
 	// ____________________________________________________________________________________________________________________________________
 
-	std::vector<std::shared_ptr<JpegApp1Segment>> App1Segments;
+	// Reduced-resolution images, in SubIFDs of the main directory
 
-	for (auto it = G.begin(); it != G.end(); ++it)
+	std::vector<std::pair<TiffLayout::Slot, std::vector<PlannedEntry>>> subifds;
+	if (has_preview)
 	{
-		Segmenttype seg = (*it)->GetSegmenttype();
-
-		if (seg == Segmenttype::JpegApp1Segment)
+		std::vector<PlannedEntry> entries = Plan_Dc_Preview(preview, L, TiffFileEndianness);
+		TiffLayout::Slot slot = L.Reserve(TiffDirectory::BinarySize(vibo::size(entries), bigtiff));
+		subifds.push_back(std::make_pair(slot, entries));
+	}
+	if (options.exif_thumbnail && !Exif_Info.thumbnail.empty())
+	{
+		std::vector<PlannedEntry> entries = Plan_Exif_Thumbnail(Exif_Info.thumbnail, L, TiffFileEndianness);
+		if (!entries.empty())
 		{
-			std::shared_ptr<FileSegment> S = (*it)->Clone();
-			std::shared_ptr<JpegApp1Segment> P = std::dynamic_pointer_cast<JpegApp1Segment>(S);
-			if (P != nullptr)
-			{
-				App1Segments.push_back(P);
-			}
+			TiffLayout::Slot slot = L.Reserve(TiffDirectory::BinarySize(vibo::size(entries), bigtiff));
+			subifds.push_back(std::make_pair(slot, entries));
 		}
 	}
 
-	exif_info Exif_Info;
-
-	if (vibo::size(App1Segments) > 0)
+	TiffLayout::Slot subifd_offsets_slot = -1;
+	if (vibo::size(subifds) > 1)
 	{
-		Exif_Info = ReadApp1Metadata(App1Segments);
+		subifd_offsets_slot = L.Reserve(OffsetSize(L) * subifds.size());
 	}
-	Endianness exif_endianness = Exif_Info.endianness;
 
-	ASSERT(offset == TiffFile.back()->GetOffset() + TiffFile.back()->GetSize());
+	// ____________________________________________________________________________________________________________________________________
+	//
+	//		APP 1 METADATA
+	// ____________________________________________________________________________________________________________________________________
 
-	// Write exif directory
+	// Exif directory
 
-	std::vector<std::tuple<TiffDirEntry, ByteVector>> exif_dir = Exif_Info.exif_dir;
-	Offset_t exifdir_offset = 0;
+	const std::vector<std::tuple<TiffDirEntry, ByteVector>>& exif_dir = Exif_Info.exif_dir;
+	std::vector<PlannedEntry> exif_entries;
+	TiffLayout::Slot exifdir_slot = -1;
 	if (vibo::size(exif_dir) > 0)
 	{
-		auto vec = Write_Selected_Entries(exif_dir, TiffFile, exif_endianness, TiffFileEndianness, relevant_exif_tags);
-		offset = TiffFile.back()->GetOffset() + TiffFile.back()->GetSize();
-		
-		exifdir_offset = offset;
-		std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffDirectory, TiffFileEndianness, offset, 0);
-		std::shared_ptr<TiffDirectory> exifdir = std::dynamic_pointer_cast<TiffDirectory> (S);
-		for (auto it = vec.begin(); it != vec.end(); ++it)
-		{
-			exifdir->AddEntry(*it);
-		}
-		exifdir->RebuildBinaryData();
-		offset = AddSegmentPadded(TiffFile, S);
+		exif_entries = Plan_Selected_Entries(exif_dir, L, exif_endianness, TiffFileEndianness, relevant_exif_tags);
+		exifdir_slot = L.Reserve(TiffDirectory::BinarySize(vibo::size(exif_entries), bigtiff));
 	}
 
-	// Write GPS directory
+	// GPS directory
 
-	std::vector<std::tuple<TiffDirEntry, ByteVector>> gps_dir = Exif_Info.gps_dir;
-	Offset_t gpsdir_offset = 0;
+	const std::vector<std::tuple<TiffDirEntry, ByteVector>>& gps_dir = Exif_Info.gps_dir;
+	std::vector<PlannedEntry> gps_entries;
+	TiffLayout::Slot gpsdir_slot = -1;
 	if (vibo::size(gps_dir) > 0)
 	{
-		auto vec = Write_Selected_Entries(gps_dir, TiffFile, exif_endianness, TiffFileEndianness, relevant_gps_tags);
-		offset = TiffFile.back()->GetOffset() + TiffFile.back()->GetSize();
-
-		gpsdir_offset = offset;
-
-		std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffDirectory, TiffFileEndianness, offset, 0);
-		std::shared_ptr<TiffDirectory> gpsdir_ptr = std::dynamic_pointer_cast<TiffDirectory> (S);
-
-		for (auto it = vec.begin(); it != vec.end(); ++it)
-		{
-			gpsdir_ptr->AddEntry(*it);
-		}
-		gpsdir_ptr->RebuildBinaryData();
-		offset = AddSegmentPadded(TiffFile, S);
+		gps_entries = Plan_Selected_Entries(gps_dir, L, exif_endianness, TiffFileEndianness, relevant_gps_tags);
+		gpsdir_slot = L.Reserve(TiffDirectory::BinarySize(vibo::size(gps_entries), bigtiff));
 	}
 
-	// Write the external data corresponding to relevant entries in the  jpeg's exif main directory
-	// The return value will be inserted in the main TIFF directory of the output image
+	// The external data corresponding to relevant entries in the  jpeg's exif main directory
+	// The entries will be inserted in the main TIFF directory of the output image
 
-	std::vector<std::tuple<TiffDirEntry, ByteVector>> main_dir = Exif_Info.main_dir;
-	std::vector<TiffDirEntry> main_dir_entries_from_exif;
+	const std::vector<std::tuple<TiffDirEntry, ByteVector>>& main_dir = Exif_Info.main_dir;
+	std::vector<PlannedEntry> main_dir_entries_from_exif;
 	if (vibo::size(main_dir) > 0)
 	{
-		main_dir_entries_from_exif = Write_Selected_Entries(main_dir, TiffFile, exif_endianness, TiffFileEndianness, relevant_main_directory_tags);
-		offset = TiffFile.back()->GetOffset() + TiffFile.back()->GetSize();
+		main_dir_entries_from_exif = Plan_Selected_Entries(main_dir, L, exif_endianness, TiffFileEndianness, relevant_main_directory_tags);
 	}
 
 	// ____________________________________________________________________________________________________________________________________
@@ -466,46 +966,17 @@ void ConvertJpegToTiff(GraphicsVector& G, std::wstring& outfilename)
 
 	ASSERT(numComponents == 1 || numComponents > 2); // We do not allow 2 components!
 
-	Offset_t bitsPerSample_offset = offset;
+	PlannedEntry bitsPerSample_entry = Plan_Bits_Per_Sample(numComponents, bitsPerSample, L, TiffFileEndianness);
 
-	if (numComponents > 2)
-	{
-		std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffUShortVector, TiffFileEndianness, offset, 0);
-		std::shared_ptr<TiffUShortVector> usv = std::dynamic_pointer_cast<TiffUShortVector>(S);
-		ASSERT(usv != nullptr);
-		for (int i = 0; i < numComponents; ++i)
-		{
-			usv->push_back(bitsPerSample);
-		}
-		offset = AddSegmentPadded(TiffFile, S);
-	}
-
-	// Update header to point to main TIFF directory
-	
-	std::shared_ptr<TiffHeader> hh = FindTiffHeader(TiffFile);
-	hh->SetDirectoryOffset(offset);
-	hh->RebuildBinaryData();
-
-	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffDirectory, TiffFileEndianness, offset, 0);
-	std::shared_ptr<TiffDirectory> tiffdir = std::dynamic_pointer_cast<TiffDirectory> (S);
-	ASSERT(tiffdir != nullptr);
+	std::vector<PlannedEntry> tiffdir_entries;
 
 	TiffDirEntry e1(TiffTag::ImageWidth, Datatype::Ulong, 1, imageWidth, TiffFileEndianness);
-	tiffdir->AddEntry(e1);
+	tiffdir_entries.push_back(FixedEntry(e1));
 	TiffDirEntry e2(TiffTag::ImageLength, Datatype::Ulong, 1, imageLength, TiffFileEndianness);
-	tiffdir->AddEntry(e2);
-	if (numComponents > 2)
-	{
-		TiffDirEntry e3(TiffTag::BitsPerSample, Datatype::Ushort, 3, AsOffset(bitsPerSample_offset), TiffFileEndianness);
-		tiffdir->AddEntry(e3);
-	}
-	else if (numComponents == 1)
-	{
-		TiffDirEntry e3(TiffTag::BitsPerSample, Datatype::Ushort, 1, AsShort(bitsPerSample), TiffFileEndianness);
-		tiffdir->AddEntry(e3);
-	}
+	tiffdir_entries.push_back(FixedEntry(e2));
+	tiffdir_entries.push_back(bitsPerSample_entry);
 	TiffDirEntry e4(TiffTag::Compression, Datatype::Ushort, 1, AsShort(7), TiffFileEndianness);
-	tiffdir->AddEntry(e4);
+	tiffdir_entries.push_back(FixedEntry(e4));
 
 	int photometric = 0;
 	if (numComponents == 1)
@@ -517,22 +988,43 @@ void ConvertJpegToTiff(GraphicsVector& G, std::wstring& outfilename)
 		photometric = 6; // YCbCr
 	}
 	TiffDirEntry e5(TiffTag::PhotometricInterpretation, Datatype::Ushort, 1, AsShort(photometric), TiffFileEndianness);
-	tiffdir->AddEntry(e5);
+	tiffdir_entries.push_back(FixedEntry(e5));
 
-	TiffDirEntry e6(TiffTag::StripOffsets, Datatype::Ulong, 1, AsOffset(embedded_image_offset), TiffFileEndianness);
-	tiffdir->AddEntry(e6);
+	if (strips.empty())
+	{
+		tiffdir_entries.push_back([=](const TiffLayout& layout) { return FileOffsetEntry(TiffTag::StripOffsets, layout.GetOffset(embedded_image_slot), layout, TiffFileEndianness); });
+	}
+	else
+	{
+		int num_strips = vibo::size(strips);
+		tiffdir_entries.push_back([=](const TiffLayout& layout) { return TiffDirEntry(TiffTag::StripOffsets, OffsetDatatype(layout), num_strips, AsOffset(layout.GetOffset(strip_offsets_slot)), TiffFileEndianness); });
+		TiffDirEntry rows(TiffTag::RowsPerStrip, Datatype::Ulong, 1, static_cast<uint32_t>(strip_plan.rows_per_strip), TiffFileEndianness);
+		tiffdir_entries.push_back(FixedEntry(rows));
+	}
 
 	TiffDirEntry e7(TiffTag::SamplesPerPixel, Datatype::Ushort, 1, AsShort(numComponents), TiffFileEndianness);
-	tiffdir->AddEntry(e7);
+	tiffdir_entries.push_back(FixedEntry(e7));
 
-	TiffDirEntry e8(TiffTag::StripByteCounts, Datatype::Ulong, 1, embedded_image_end - embedded_image_offset, TiffFileEndianness);
-	tiffdir->AddEntry(e8);
+	if (strips.empty())
+	{
+		tiffdir_entries.push_back([=](const TiffLayout& layout) { return FileOffsetEntry(TiffTag::StripByteCounts, layout.GetNextOffset(embedded_image_last) - layout.GetOffset(embedded_image_slot), layout, TiffFileEndianness); });
+	}
+	else
+	{
+		int num_strips = vibo::size(strips);
+		tiffdir_entries.push_back([=](const TiffLayout& layout) { return TiffDirEntry(TiffTag::StripByteCounts, OffsetDatatype(layout), num_strips, AsOffset(layout.GetOffset(strip_bytecounts_slot)), TiffFileEndianness); });
+	}
 
 	TiffDirEntry e9(TiffTag::PlanarConfig, Datatype::Ushort, 1, AsShort(1), TiffFileEndianness); // 1 betyr at alle data er i samme plan
-	tiffdir->AddEntry(e9);
+	tiffdir_entries.push_back(FixedEntry(e9));
+
+	if (page != nullptr && page->count <= 0xffff)
+	{
+		TiffDirEntry pagenumber(TiffTag::PageNumber, Datatype::Ushort, 2, AsShort(page->number, page->count), TiffFileEndianness);
+		tiffdir_entries.push_back(FixedEntry(pagenumber));
+	}
 
-	TiffDirEntry e10(TiffTag::JPEGTables, Datatype::Xbyte, jpeg_tables_end - jpeg_tables_start, AsOffset(jpeg_tables_start), TiffFileEndianness);
-	tiffdir->AddEntry(e10);
+	tiffdir_entries.push_back([=](const TiffLayout& layout) { return TiffDirEntry(TiffTag::JPEGTables, Datatype::Xbyte, layout.GetNextOffset(jpeg_tables_last) - layout.GetOffset(jpeg_tables_slot), AsOffset(layout.GetOffset(jpeg_tables_slot)), TiffFileEndianness); });
 
 	// TIFFTAG YCbCrSubSampling
 	int horizontal_divisor = 0;
@@ -551,7 +1043,7 @@ void ConvertJpegToTiff(GraphicsVector& G, std::wstring& outfilename)
 	{
 		AsShort subsampling_factors(horizontal_divisor, vertical_divisor);
 		TiffDirEntry e12(TiffTag::YCbCrSubSampling, Datatype::Ushort, 2, subsampling_factors, TiffFileEndianness);
-		tiffdir->AddEntry(e12);
+		tiffdir_entries.push_back(FixedEntry(e12));
 	}
 	else if (numComponents > 2)
 	{
@@ -561,34 +1053,83 @@ void ConvertJpegToTiff(GraphicsVector& G, std::wstring& outfilename)
 
 	// Insert stuff from Exif here!
 
-	for (auto it = main_dir_entries_from_exif.begin(); it != main_dir_entries_from_exif.end(); ++it)
+	tiffdir_entries.insert(tiffdir_entries.end(), main_dir_entries_from_exif.begin(), main_dir_entries_from_exif.end());
+
+	if (icc_profile_slot >= 0)
 	{
-		tiffdir->AddEntry(*it);
+		tiffdir_entries.push_back([=](const TiffLayout& layout) { return TiffDirEntry(TiffTag::IccProfile, Datatype::Xbyte, layout.GetNextOffset(icc_profile_slot) - layout.GetOffset(icc_profile_slot), AsOffset(layout.GetOffset(icc_profile_slot)), TiffFileEndianness); });
 	}
 
-	if (icc_profile_end > icc_profile_begin)
+	if (exifdir_slot >= 0)
 	{
-		Offset_t iccprofile_size = icc_profile_end - icc_profile_begin;
-		TiffDirEntry e13(TiffTag::IccProfile, Datatype::Xbyte, iccprofile_size, AsOffset(icc_profile_begin), TiffFileEndianness);
-		tiffdir->AddEntry(e13);
+		tiffdir_entries.push_back([=](const TiffLayout& layout) { return FileOffsetEntry(TiffTag::ExifIFD, layout.GetOffset(exifdir_slot), layout, TiffFileEndianness, true); });
 	}
 
-	if (exifdir_offset > 0)
+	if (gpsdir_slot >= 0)
 	{
-		TiffDirEntry e14(TiffTag::ExifIFD, Datatype::Ulong, 1, AsOffset(exifdir_offset), TiffFileEndianness);
-		tiffdir->AddEntry(e14);
+		tiffdir_entries.push_back([=](const TiffLayout& layout) { return FileOffsetEntry(TiffTag::GPSIFD, layout.GetOffset(gpsdir_slot), layout, TiffFileEndianness, true); });
 	}
 
-	if (gpsdir_offset > 0)
+	if (vibo::size(subifds) == 1)
 	{
-		TiffDirEntry e15(TiffTag::GPSIFD, Datatype::Ulong, 1, AsOffset(gpsdir_offset), TiffFileEndianness);
-		tiffdir->AddEntry(e15);
+		TiffLayout::Slot slot = subifds.front().first;
+		tiffdir_entries.push_back([=](const TiffLayout& layout) { return FileOffsetEntry(TiffTag::SubIFDs, layout.GetOffset(slot), layout, TiffFileEndianness, true); });
 	}
+	else if (vibo::size(subifds) > 1)
+	{
+		int num_subifds = vibo::size(subifds);
+		tiffdir_entries.push_back([=](const TiffLayout& layout) { return TiffDirEntry(TiffTag::SubIFDs, OffsetDatatype(layout, true), num_subifds, AsOffset(layout.GetOffset(subifd_offsets_slot)), TiffFileEndianness); });
+	}
+
+	TiffLayout::Slot tiffdir_slot = L.Reserve(TiffDirectory::BinarySize(vibo::size(tiffdir_entries), bigtiff), false); // This is the end-of-file.  No need for padding at eof.
 
-	tiffdir->SortEntries();
+	// ____________________________________________________________________________________________________________________________________
+	//
+	//		PLAN, THEN BUILD THE HEADER AND THE DIRECTORIES
+	// ____________________________________________________________________________________________________________________________________
 
-	tiffdir->RebuildBinaryData();
-	AddSegmentNopad(TiffFile, S); // This is the end-of-file.  No need for padding at eof.
+	L.Plan(); // Throws if the file would be too large
+
+	if (header_slot >= 0)
+	{
+		L.Fill(header_slot, MakeTiffHeader(TiffFileEndianness, 0, L.GetOffset(tiffdir_slot), bigtiff));
+	}
+	if (!strips.empty())
+	{
+		std::vector<uint64_t> offsets;
+		std::vector<uint64_t> bytecounts;
+		for (auto it = strips.begin(); it != strips.end(); ++it)
+		{
+			offsets.push_back(L.GetOffset(it->first));
+			bytecounts.push_back(L.GetOffset(it->second) + 2 - L.GetOffset(it->first)); // Up to the end of the end-of-image marker, without the padding
+		}
+		L.Fill(strip_offsets_slot, MakeTiffOffsetTable(Segmenttype::TiffOffsetTable, offsets, L, TiffFileEndianness));
+		L.Fill(strip_bytecounts_slot, MakeTiffOffsetTable(Segmenttype::TiffBytecountTable, bytecounts, L, TiffFileEndianness));
+	}
+	if (exifdir_slot >= 0)
+	{
+		L.Fill(exifdir_slot, MakeTiffDirectory(exif_entries, L, TiffFileEndianness, false));
+	}
+	if (gpsdir_slot >= 0)
+	{
+		L.Fill(gpsdir_slot, MakeTiffDirectory(gps_entries, L, TiffFileEndianness, false));
+	}
+	if (!subifds.empty())
+	{
+		std::vector<uint64_t> offsets;
+		for (auto it = subifds.begin(); it != subifds.end(); ++it)
+		{
+			offsets.push_back(L.GetOffset(it->first));
+			L.Fill(it->first, MakeTiffDirectory(it->second, L, TiffFileEndianness, true));
+		}
+		if (subifd_offsets_slot >= 0)
+		{
+			L.Fill(subifd_offsets_slot, MakeTiffOffsetTable(Segmenttype::TiffOffsetTable, offsets, L, TiffFileEndianness));
+		}
+	}
+	L.Fill(tiffdir_slot, MakeTiffDirectory(tiffdir_entries, L, TiffFileEndianness, true));
+
+	GraphicsVector TiffFile = L.Materialize();
 
 	// std::wcout << L"______________________________________________\n\n";
 	//
@@ -598,10 +1139,43 @@ void ConvertJpegToTiff(GraphicsVector& G, std::wstring& outfilename)
 	//	  std::wcout << std::endl;
 	// }
 
-	// ____________________________________________________________________________________________________________________________________
-	//
-	//		WRITE FILE
-	// ____________________________________________________________________________________________________________________________________
+	return TiffFile;
+}
+
+
+GraphicsVector AssembleTiff(GraphicsVector& G, const ConversionOptions& options, std::vector<std::wstring>* warnings)
+{
+	return AssembleTiff(G, BuildJpegIndex(G), options, warnings);
+}
+
+
+GraphicsVector AssembleTiff(GraphicsVector& G, const JpegIndex& index, const ConversionOptions& options, std::vector<std::wstring>* warnings)
+{
+	return AssembleTiff(G, index, options, nullptr, warnings);
+}
+
+
+GraphicsVector AssembleTiffPage(GraphicsVector& G, const JpegIndex& index, const ConversionOptions& options, const TiffPage& page, std::vector<std::wstring>* warnings)
+{
+	return AssembleTiff(G, index, options, &page, warnings);
+}
+
+
+Endianness GetTiffEndianness(const JpegIndex& index, const ConversionOptions& options)
+{
+	if (options.byte_order == TiffByteOrder::FromExif && vibo::size(index.app1) > 0)
+	{
+		return ReadApp1Metadata(index.app1).endianness;
+	}
+	return Endianness::Little;
+}
+
+
+void WriteTiff(const GraphicsVector& TiffFile, const std::wstring& outfilename)
+{
+	ASSERT(!TiffFile.empty());
+	const std::shared_ptr<FileSegment>& last = TiffFile.back();
+	Offset_t filesize = vibo::CheckedAdd(last->GetOffset(), last->GetSize());
 
 	FILE* outfile = nullptr;
 	errno_t err = _wfopen_s(&outfile, outfilename.c_str(), L"wb");
@@ -611,11 +1185,8 @@ void ConvertJpegToTiff(GraphicsVector& G, std::wstring& outfilename)
 	}
 	else
 	{
-		for (auto p = TiffFile.begin(); p != TiffFile.end(); ++p)
-		{
-			(*p)->WriteToFile(outfile);
-		}
+		vibo::PreallocateFile(outfile, filesize);
+		WriteGraphicsVector(TiffFile, outfile);
 		fclose(outfile);
 	}
 }
-
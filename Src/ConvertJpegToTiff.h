@@ -7,8 +7,78 @@
 #define CONVERTJPEGTOTIFF_H_INCLUDED
 
 #include "GraphicsFile.h"
+#include "JpegSegments.h"
+#include "TiffLayout.h"
+#include <utility>
 
-void ConvertJpegToTiff(GraphicsVector& G, std::wstring& outfilename);
+// The byte order of the TIFF file
+enum class TiffByteOrder
+{
+	Little,     // Always little-endian
+	FromExif    // That of the source's EXIF block, so that the EXIF and GPS values are copied without swapping. Little-endian if there is none.
+};
+
+// How a JPEG file is converted
+struct ConversionOptions
+{
+	TiffByteOrder byte_order;
+	int restart_rows;           // > 0: a JPEG without restart markers gets one every restart_rows MCU rows, so that it can be cut into strips (see JpegRestart.h)
+	bool preview;               // Add a 1/8 scale preview, made from the DC coefficients, as a SubIFD (see JpegPreview.h)
+	bool exif_thumbnail;        // Add the JPEG thumbnail of the EXIF block, as it is, as a SubIFD
+	bool bigtiff;               // Always write a BigTIFF file. Otherwise only when the file would be too large for TIFF (4 GB).
+
+	ConversionOptions() : byte_order(TiffByteOrder::Little), restart_rows(0), preview(false), exif_thumbnail(false), bigtiff(false)
+	{
+	}
+};
+
+// warnings: if not null, gets what could not be done as the options ask (such as -restart), for the caller to report
+void ConvertJpegToTiff(GraphicsVector& G, std::wstring& outfilename, const ConversionOptions& options = ConversionOptions(), std::vector<std::wstring>* warnings = nullptr);
+
+// Library entry point: converts a JPEG file in memory to a TIFF file in memory. Nothing is read from or written to
+// disk, and nothing is printed; the parser's and the conversion's warnings are returned in warnings. Throws
+// vibo::Exception on failure.
+void ConvertJpegToTiff(const unsigned char* jpeg, size_t jpeg_size, ByteVector& tiff, std::vector<std::wstring>& warnings, const ConversionOptions& options = ConversionOptions());
+
+// The two stages of ConvertJpegToTiff(), for callers that run them separately
+GraphicsVector AssembleTiff(GraphicsVector& G, const ConversionOptions& options = ConversionOptions(), std::vector<std::wstring>* warnings = nullptr);
+GraphicsVector AssembleTiff(GraphicsVector& G, const JpegIndex& index, const ConversionOptions& options = ConversionOptions(), std::vector<std::wstring>* warnings = nullptr); // index: of G, usually built by the parser
+void WriteTiff(const GraphicsVector& TiffFile, const std::wstring& outfilename);
+
+// Where a page of a multi-page TIFF file goes (see ConvertToMultiPageTiff() in Batch.h). The pages share the byte order
+// and the format of the file.
+struct TiffPage
+{
+	Offset_t offset;        // Where the page starts. The first page, at 0, starts with the TIFF header.
+	int number;             // From 0
+	int count;
+	Endianness endianness;
+	bool bigtiff;
+};
+
+// A page of a multi-page file. Its directory is the last segment, and has no next directory; the caller sets that
+// (TiffDirectory::SetNextDirectoryOffset()) when the offset of the next page's directory is known.
+GraphicsVector AssembleTiffPage(GraphicsVector& G, const JpegIndex& index, const ConversionOptions& options, const TiffPage& page, std::vector<std::wstring>* warnings = nullptr);
+
+// The byte order AssembleTiff() gives the file of a JPEG file
+Endianness GetTiffEndianness(const JpegIndex& index, const ConversionOptions& options);
+
+// An upper bound of the size of the file or the page AssembleTiff() makes of a JPEG file, with its header and directories.
+// header: the index of the segments before the image data (see ReadJpegHeader()). file_size: of the JPEG file.
+unsigned long long EstimateTiffPageSize(const JpegIndex& header, unsigned long long file_size, const ConversionOptions& options);
+
+// How an image with restart markers is cut into strips (see ConvertJpegToTiff.cpp)
+struct StripPlan
+{
+	int num_strips;             // 1: the image data is not cut
+	int intervals_per_strip;
+	int rows_per_strip;
+};
+
+StripPlan PlanStrips(const JpegIndex& index);
+
+// Adds strip number s to the layout. Returns the slots of its first and last segment.
+std::pair<TiffLayout::Slot, TiffLayout::Slot> AddJpegStrip(TiffLayout& L, const JpegIndex& index, const StripPlan& plan, int s);
 
 
 #endif
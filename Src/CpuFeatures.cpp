@@ -0,0 +1,62 @@
+// File: CpuFeatures.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define CPUFEATURES_X86
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace vibo
+{
+	bool CpuHasSSE2()
+	{
+#ifdef CPUFEATURES_X86
+		int info[4];
+		__cpuid(info, 1);
+		return (info[3] & (1 << 26)) != 0;
+#else
+		return false;
+#endif
+	}
+
+
+	bool CpuHasSSSE3()
+	{
+#ifdef CPUFEATURES_X86
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 9)) != 0;
+#else
+		return false;
+#endif
+	}
+
+
+	bool CpuHasAVX2()
+	{
+#ifdef CPUFEATURES_X86
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) // The OS must save the ymm registers
+		{
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return false;
+#endif
+	}
+}
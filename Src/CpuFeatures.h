@@ -0,0 +1,23 @@
+// File: CpuFeatures.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef CPUFEATURES_H_INCLUDED
+#define CPUFEATURES_H_INCLUDED
+
+namespace vibo
+{
+	// --------------------------------------------------------------------------------------------------------------------
+	//		CPU features
+	//
+	//		Which of the instruction sets used by the SIMD code the processor supports. AVX2 also needs the OS to save the
+	//		ymm registers. Always false when not compiled for x86 or x64.
+	// --------------------------------------------------------------------------------------------------------------------
+
+	bool CpuHasSSE2();
+	bool CpuHasSSSE3();
+	bool CpuHasAVX2();
+}
+
+#endif
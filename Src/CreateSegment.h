@@ -13,9 +13,10 @@
 
 class FileSegment; // Forward declaration
 
-std::shared_ptr<FileSegment> CreateSegment(Segmenttype seg, Endianness e, Offset_t offset, int size);
+std::shared_ptr<FileSegment> CreateSegment(Segmenttype seg, Endianness e, Offset_t offset, Offset_t size);
 Segmenttype GetSegmenttype(const FileSegment& fs);
 std::wstring GetSegmentName(const FileSegment& fs);
+const wchar_t* GetSegmenttypeName(Segmenttype seg);
 
 
 #endif
@@ -16,50 +16,114 @@
 //		class FileSegment
 // --------------------------------------------------------------------------------------------------------------------
 
-FileSegment::FileSegment(int offset, int size) : m_offset(offset), m_size(size), m_data(), m_label()
+FileSegment::FileSegment(Offset_t offset, Offset_t size) : m_segmenttype(Segmenttype::Undefined), m_offset(offset), m_size(size), m_data(), m_label(), m_view(), m_viewOwner(), m_rangeSource(), m_rangeOffset(0)
 {
 }
 
 
 Segmenttype FileSegment::GetSegmenttype() const
 {
-	return ::GetSegmenttype(*this);
+	return m_segmenttype;
 }
 
 
-int FileSegment::GetSize() const
+Offset_t FileSegment::GetSize() const
 {
-	int datasiz = vibo::size(m_data);
-	if (m_size != datasiz)
+	if (IsRange())
 	{
-		ASSERT(false);
+		return m_size;
 	}
-	ASSERT(m_size == datasiz);
+	ASSERT(m_size == Data().size());
 	return  m_size;
 }
 
-int FileSegment::GetOffset() const
+Offset_t FileSegment::GetOffset() const
 {
 	return m_offset;
 }
 
 
-void FileSegment::SetOffset(int offset)
+void FileSegment::SetOffset(Offset_t offset)
 {
 	m_offset = offset;
 }
 
 
-void FileSegment::ReadData(FILE* f)
+void FileSegment::ReadData(vibo::File& f)
 {
 	ASSERT(m_size > 0);
-	int check = fseek(f, m_offset, SEEK_SET);
-	ASSERT(check == 0);
-	m_data = vibo::GetBytes(f, m_size);
+	if (f.IsMapped())
+	{
+		m_view = f.Mapping()->View(m_offset, m_size);
+		m_viewOwner = f.Mapping();
+		m_data.clear();
+		vibo::Seek(f, vibo::CheckedAdd(m_offset, m_size)); // Leave the file position where an fread would have left it
+	}
+	else
+	{
+		if (m_offset > f.Size() || m_size > f.Size() - m_offset)
+		{
+			THROW(L"The segment exceeds the end of the file!");
+		}
+		vibo::Seek(f, m_offset);
+		m_data = vibo::GetBytes(f, vibo::CheckedSize(m_size));
+	}
+	InterpretData();
+}
+
+
+void FileSegment::ReadData(vibo::ByteReader& r)
+{
+	ASSERT(m_size > 0);
+	ASSERT(r.Position() == m_offset);
+	if (r.InMemory())
+	{
+		r.Skip(m_size);
+		AssignView(r.View(m_offset, m_size), r.Owner());
+	}
+	else
+	{
+		ByteVector data(vibo::CheckedSize(m_size));
+		r.Read(&data[0], data.size());
+		AssignData(std::move(data));
+	}
+}
+
+
+void FileSegment::AssignData(ByteVector&& data)
+{
+	ASSERT(data.size() == m_size);
+	m_data = std::move(data);
+	m_view = vibo::ByteSpan();
+	m_viewOwner.reset();
+	m_rangeSource.reset();
 	InterpretData();
 }
 
 
+void FileSegment::AssignView(const vibo::ByteSpan& view, const std::shared_ptr<const void>& owner)
+{
+	ASSERT(view.size() == m_size);
+	m_data.clear();
+	m_view = view;
+	m_viewOwner = owner;
+	m_rangeSource.reset();
+	InterpretData();
+}
+
+
+void FileSegment::AssignRange(const std::shared_ptr<FILE>& source, unsigned long long offset)
+{
+	ASSERT(source != nullptr);
+	m_data.clear();
+	m_view = vibo::ByteSpan();
+	m_viewOwner.reset();
+	m_rangeSource = source;
+	m_rangeOffset = offset;
+	// Nothing to interpret; the data is not loaded
+}
+
+
 void FileSegment::RebuildBinaryData()
 {
 	std::wstring msg = L"RebuildBinaryData() is not implemented for ";
@@ -72,8 +136,9 @@ void FileSegment::RebuildBinaryData()
 
 int FileSegment::GetDataByte(int idx) const
 {
-	ASSERT(vibo::size(m_data) > idx);
-	return m_data[idx];
+	vibo::ByteSpan D = Data();
+	ASSERT(vibo::size(D) > idx);
+	return D[idx];
 }
 
 
@@ -105,10 +170,66 @@ std::shared_ptr<FileSegment> FileSegment::Clone()
 {
 	std::shared_ptr<FileSegment> theclone = CreateSegment(GetSegmenttype(), FileEndianness(), GetOffset(), GetSize());
 	theclone->m_data = this->m_data;
-	theclone->InterpretData();
+	theclone->m_view = this->m_view; // A view is shared, not copied
+	theclone->m_viewOwner = this->m_viewOwner;
+	theclone->m_rangeSource = this->m_rangeSource;
+	theclone->m_rangeOffset = this->m_rangeOffset;
+	if (!IsRange())
+	{
+		theclone->InterpretData();
+	}
 	return theclone;
 }
 
+
+std::shared_ptr<FileSegment> FileSegment::MoveOut()
+{
+	std::shared_ptr<FileSegment> target = CreateSegment(GetSegmenttype(), FileEndianness(), GetOffset(), GetSize());
+	target->m_data = std::move(m_data);
+	target->m_view = m_view;
+	target->m_viewOwner = std::move(m_viewOwner);
+	target->m_rangeSource = std::move(m_rangeSource);
+	target->m_rangeOffset = m_rangeOffset;
+	if (!target->IsRange())
+	{
+		target->InterpretData();
+	}
+	MoveStateTo(*target);
+
+	m_size = 0;
+	m_data.clear();
+	m_view = vibo::ByteSpan();
+	m_viewOwner.reset();
+	m_rangeSource.reset();
+	return target;
+}
+
+
+std::shared_ptr<FileSegment> FileSegment::Part(Offset_t start, Offset_t size) const
+{
+	ASSERT(start <= m_size && size <= m_size - start);
+	std::shared_ptr<FileSegment> part = CreateSegment(GetSegmenttype(), FileEndianness(), GetOffset() + start, size);
+	if (IsRange())
+	{
+		part->AssignRange(m_rangeSource, m_rangeOffset + start);
+	}
+	else if (IsView())
+	{
+		part->AssignView(vibo::ByteSpan(m_view.data() + start, size), m_viewOwner);
+	}
+	else
+	{
+		part->AssignData(ByteVector(m_data.begin() + start, m_data.begin() + start + size));
+	}
+	return part;
+}
+
+
+void FileSegment::MoveStateTo(FileSegment&)
+{
+	// No action in base class
+}
+
 void FileSegment::Dump() const
 {
 	std::vector<std::wstring> vec = StringRepresentation();
@@ -132,20 +253,21 @@ std::vector<std::wstring> FileSegment::StringRepresentation() const
 	}
 
 	std::wstringstream s;
-	s << std::dec << std::setfill(L'0') << std::setw(8) << std::right << m_offset << std::setfill(L' ') << L" " << std::setw(0) << title << " Size:" << m_data.size();
+	vibo::ByteSpan D = Data();
+	s << std::dec << std::setfill(L'0') << std::setw(8) << std::right << m_offset << std::setfill(L' ') << L" " << std::setw(0) << title << " Size:" << m_size;
 
 	std::vector<std::wstring> retval;
 	retval.push_back(s.str());
 	
-	if (!m_data.empty())
+	if (!D.empty())
 	{
-		std::wstring md5str = vibo::GetMD5Hash(m_data);
+		std::wstring md5str = vibo::GetMD5Hash(D);
 		retval.push_back(md5str);
 	}
 	if (GetSegmenttype() == Segmenttype::JpegStartOfFrame)
 	{
 		std::wstringstream s2;
-		s2 << L"DEBUG Start of frame: " << std::hex << m_data[0] << L" " << m_data[1];
+		s2 << L"DEBUG Start of frame: " << std::hex << D[0] << L" " << D[1];
 	}
 	return retval;
 }
@@ -153,16 +275,57 @@ std::vector<std::wstring> FileSegment::StringRepresentation() const
 
 void FileSegment::WriteToFile(FILE* f) const
 {
-	int siz = vibo::size(m_data);
-	ASSERT(siz == m_size);
-	size_t check = fwrite(&m_data[0], 1, m_size, f);
-	ASSERT(check == m_size);
+	if (IsRange())
+	{
+		vibo::CopyFileRange(m_rangeSource.get(), m_rangeOffset, m_size, f);
+		return;
+	}
+	vibo::ByteSpan D = Data();
+	ASSERT(D.size() == m_size);
+	size_t check = fwrite(D.data(), 1, D.size(), f);
+	ASSERT(check == D.size());
+}
+
+
+vibo::ByteSpan FileSegment::Data() const
+{
+	if (IsView())
+	{
+		return m_view;
+	}
+	return vibo::ByteSpan(m_data);
+}
+
+
+ByteVector FileSegment::CopyData() const
+{
+	if (IsRange())
+	{
+		ByteVector data(vibo::CheckedSize(m_size));
+		if (m_size > 0)
+		{
+			vibo::Seek(m_rangeSource.get(), m_rangeOffset);
+			if (fread(&data[0], 1, data.size(), m_rangeSource.get()) != m_size)
+			{
+				THROW(L"FileSegment::CopyData: Read error!");
+			}
+		}
+		return data;
+	}
+	vibo::ByteSpan D = Data();
+	return ByteVector(D.begin(), D.end());
+}
+
+
+bool FileSegment::IsView() const
+{
+	return m_view.data() != nullptr;
 }
 
 
-const ByteVector& FileSegment::Data() const
+bool FileSegment::IsRange() const
 {
-	return m_data;
+	return m_rangeSource != nullptr;
 }
 
 
@@ -170,10 +333,10 @@ const ByteVector& FileSegment::Data() const
 //		class Padding
 // --------------------------------------------------------------------------------------------------------------------
 
-Padding::Padding(int offset, int size, Endianness e) : FileSegment(offset, size), m_Endianness(e)
+Padding::Padding(Offset_t offset, Offset_t size, Endianness e) : FileSegment(offset, size), m_Endianness(e)
 {
-	m_data.resize(size);
-	memset(&m_data[0], 0, size);
+	m_data.resize(vibo::CheckedSize(size));
+	memset(&m_data[0], 0, m_data.size());
 }
 
 Endianness Padding::FileEndianness() const
@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <string>
 #include "Util.h"
+#include "ByteReader.h"
 #include <memory>
 
 enum class Segmenttype
@@ -44,6 +45,8 @@ enum class Segmenttype
 	TiffUShortVector,
 	TiffOffsetTable,
 	TiffBytecountTable,
+	TiffOffsetTable8,       // BigTIFF
+	TiffBytecountTable8,
 	TiffImageData
 };
 
@@ -54,19 +57,30 @@ enum class Segmenttype
 
 class FileSegment
 {
+	Segmenttype  m_segmenttype; // Set by CreateSegment()
+	friend std::shared_ptr<FileSegment> CreateSegment(Segmenttype seg, Endianness e, Offset_t offset, Offset_t size);
+
 protected:
 	Offset_t     m_offset;
-	ULong_t      m_size;
-	ByteVector   m_data;
+	Offset_t     m_size;
+	ByteVector   m_data;        // Owned data. Not used when the segment is a view (see below).
 	std::wstring m_label;
 
+	// Segments read from a memory-mapped file do not copy their bytes; m_view points into the mapping, and m_viewOwner keeps the mapping alive.
+	vibo::ByteSpan              m_view;
+	std::shared_ptr<const void> m_viewOwner;
+
+	// A segment can also refer to a range of an input file that is never loaded. The bytes are copied from the input when the segment is written.
+	std::shared_ptr<FILE>       m_rangeSource;
+	unsigned long long          m_rangeOffset;
+
 public:
-	FileSegment(int offset, int size);
-	int GetSize() const;
+	FileSegment(Offset_t offset, Offset_t size);
+	Offset_t GetSize() const;
 	virtual void RebuildBinaryData(); // Create m_data from scratch. Only defined when needed; otherwise throws exceptrion.
 
-	int GetOffset() const;
-	void SetOffset(int offset);
+	Offset_t GetOffset() const;
+	void SetOffset(Offset_t offset);
 
 	void Dump() const;
 	virtual std::vector<std::wstring> StringRepresentation() const;
@@ -81,21 +95,37 @@ public:
 	bool HasLabel() const;
 
 	// Read from file
-	void ReadData(FILE* f);
+	void ReadData(vibo::File& f);
+	void ReadData(vibo::ByteReader& r); // Reads m_size bytes at the reader's position, which must be m_offset
+
+	// Take over data that the caller has already read (m_size must match)
+	void AssignData(ByteVector&& data);
+	void AssignView(const vibo::ByteSpan& view, const std::shared_ptr<const void>& owner);
+	void AssignRange(const std::shared_ptr<FILE>& source, unsigned long long offset); // m_size bytes from offset in source
 
 	// Clone
 	std::shared_ptr<FileSegment> Clone();
 
+	// Like Clone(), but the data is transferred to the new segment instead of copied. This segment is left empty (size 0).
+	std::shared_ptr<FileSegment> MoveOut();
+
+	// Like Clone(), but of size bytes starting at start. A view or a range is narrowed, not copied.
+	std::shared_ptr<FileSegment> Part(Offset_t start, Offset_t size) const;
+
 	// Write to disk
 	void WriteToFile(FILE* f) const;
 
-	// Copying of data
-	const ByteVector& Data() const;
+	// Access to the data (either owned or a view into a mapped file). Empty for a range segment.
+	vibo::ByteSpan Data() const;
+	ByteVector CopyData() const; // A copy of the data. A range segment is read from its input file.
+	bool IsView() const;
+	bool IsRange() const;
 
 	virtual ~FileSegment() = default; // Should have been protected, but shared_ptr<FileSegment> fails to compile when dtor is protected.
 
 protected:
 	virtual void InterpretData(); // Interpret m_data, i.e. initialize member variables from the information in m_data. Called from ReadData() and Clone().
+	virtual void MoveStateTo(FileSegment& target); // Transfer state that is not derived from the data. Called from MoveOut().
 
 private: // Disallowed
 	FileSegment() = delete;
@@ -109,7 +139,7 @@ class Padding : public FileSegment
 	Endianness m_Endianness;
 
 public:
-	Padding(int offset, int size, Endianness e);
+	Padding(Offset_t offset, Offset_t size, Endianness e);
 	Endianness FileEndianness() const override;
 };
 
@@ -10,7 +10,7 @@
 
 namespace vibo
 {
-	std::wstring GetMD5Hash(const ByteVector& vec)
+	std::wstring GetMD5Hash(const ByteSpan& vec)
 	{
 		MD5_CTX ctx;
 		unsigned char result[100];
@@ -18,7 +18,7 @@ namespace vibo
 		memset(result, 0, 100);
 
 		MD5_Init(&ctx);
-		MD5_Update(&ctx, &vec[0], static_cast<unsigned long>(vec.size())); // cast to silence error message in 64-bit build.
+		MD5_Update(&ctx, vec.data(), static_cast<unsigned long>(vec.size())); // cast to silence error message in 64-bit build.
 		MD5_Final(result, &ctx);
 
 		static const std::wstring hexdigit(L"0123456789ABCDEF");
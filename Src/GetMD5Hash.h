@@ -11,7 +11,7 @@
 
 namespace vibo
 {
-	std::wstring GetMD5Hash(const ByteVector& vec);
+	std::wstring GetMD5Hash(const ByteSpan& vec);
 }
 
 #endif
\ No newline at end of file
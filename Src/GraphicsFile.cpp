@@ -7,11 +7,15 @@
 #include "Exception.h"
 #include "FileSegment.h"
 #include "CreateSegment.h"
+#include "TiffSegments.h"
+#include "JpegSegments.h"
+#include <iostream>
+#include <limits>
 
 Offset_t AddSegmentNopad(GraphicsVector& vec, std::shared_ptr<FileSegment> seg)
 {
 	vec.push_back(seg);
-	return vec.back()->GetOffset() + vec.back()->GetSize();
+	return vibo::CheckedAdd(vec.back()->GetOffset(), vec.back()->GetSize());
 }
 
 
@@ -19,7 +23,7 @@ Offset_t AddSegmentPadded(GraphicsVector& vec, std::shared_ptr<FileSegment> seg)
 {
 	Endianness e = seg->FileEndianness();
 	vec.push_back(seg);
-	Offset_t next_offset = vec.back()->GetOffset() + vec.back()->GetSize();
+	Offset_t next_offset = vibo::CheckedAdd(vec.back()->GetOffset(), vec.back()->GetSize());
 
 	int pad_bytes = next_offset % 2;
 	if (pad_bytes != 0)
@@ -27,7 +31,7 @@ Offset_t AddSegmentPadded(GraphicsVector& vec, std::shared_ptr<FileSegment> seg)
 		std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::Padding, e, next_offset, pad_bytes);
 		vec.push_back(S);
 	}
-	return vec.back()->GetOffset() + vec.back()->GetSize();
+	return vibo::CheckedAdd(vec.back()->GetOffset(), vec.back()->GetSize());
 }
 
 
@@ -40,6 +44,199 @@ void Dump(const GraphicsVector& vec)
 }
 
 
+// --------------------------------------------------------------------------------------------------------------------
+//		Free function: WriteGraphicsVector()
+//
+//		Writes the segments in order. The segments must be contiguous. They start at offset 0, except for a file that is
+//		written in pieces (the pages of a multi-page file), where each piece starts where the previous one ended.
+//		Small segments (headers, markers, padding, directories) are gathered in a staging buffer, so that they are written
+//		together. Large segments are written directly from where their data is, without being copied to the buffer,
+//		and range segments are copied from their input file.
+// --------------------------------------------------------------------------------------------------------------------
+
+void WriteGraphicsVector(const GraphicsVector& vec, FILE* f)
+{
+	const size_t StagingSize = 64 * 1024;
+
+	ByteVector staging;
+	staging.reserve(StagingSize);
+
+	auto flush = [&staging, f]()
+	{
+		if (!staging.empty())
+		{
+			size_t check = fwrite(staging.data(), 1, staging.size(), f);
+			if (check != staging.size())
+			{
+				THROW(L"WriteGraphicsVector: Write error!");
+			}
+			staging.clear();
+		}
+	};
+
+	Offset_t position = vec.empty() ? 0 : vec.front()->GetOffset();
+	for (auto it = vec.cbegin(); it != vec.cend(); ++it)
+	{
+		const FileSegment& S = **it;
+		ASSERT(S.GetOffset() == position);
+		Offset_t size = S.GetSize();
+		position += size;
+
+		if (S.IsRange() || size >= StagingSize)
+		{
+			flush();
+			S.WriteToFile(f);
+		}
+		else
+		{
+			if (size > StagingSize - staging.size())
+			{
+				flush();
+			}
+			vibo::ByteSpan D = S.Data();
+			staging.insert(staging.end(), D.begin(), D.end());
+		}
+	}
+	flush();
+}
+
+
+// Same, into memory. out is replaced by the file's bytes. Range segments refer to an input file and can't be written this way.
+
+void WriteGraphicsVector(const GraphicsVector& vec, ByteVector& out)
+{
+	out.clear();
+	if (!vec.empty())
+	{
+		out.reserve(vibo::CheckedSize(vec.back()->GetOffset() + vec.back()->GetSize()));
+	}
+	for (auto it = vec.cbegin(); it != vec.cend(); ++it)
+	{
+		const FileSegment& S = **it;
+		ASSERT(S.GetOffset() == out.size());
+		if (S.IsRange())
+		{
+			THROW(L"WriteGraphicsVector: A range segment can't be written to memory!");
+		}
+		vibo::ByteSpan D = S.Data();
+		out.insert(out.end(), D.begin(), D.end());
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Free function: ReadFile()
+//
+//		Reads a TIFF or JPEG file into G. Throws if the file cannot be opened or is neither.
+//		OpenGraphicsFile() and ParseGraphicsFile() are the two halves, for callers that do them in different stages.
+// --------------------------------------------------------------------------------------------------------------------
+
+void ReadFile(const std::wstring& fn, GraphicsVector& G)
+{
+	std::unique_ptr<vibo::File> f = OpenGraphicsFile(fn, false);
+	ParseGraphicsFile(*f, fn, G);
+}
+
+
+std::unique_ptr<vibo::File> OpenGraphicsFile(const std::wstring& fn, bool prefetch)
+{
+	std::unique_ptr<vibo::File> f(new vibo::File(_wfopen(fn.c_str(), L"rb")));
+	if (*f == nullptr)
+	{
+		THROW(L"Error opening file \'" + fn + L"\'");
+	}
+
+	// Segments become views into the mapped file; their bytes are not copied. If mapping fails, the image data refers to a range of the input.
+	if (f->Map() && prefetch)
+	{
+		f->Mapping()->Prefetch();
+	}
+	return f;
+}
+
+
+void ParseGraphicsFile(vibo::File& f, const std::wstring& fn, GraphicsVector& G, JpegIndex* index)
+{
+	vibo::Seek(f, 0);
+	ByteVector vec = vibo::GetBytes(f, 4);
+	Filetype ft = Filetype::Unknown;
+	if (vec == ByteVector{0x49, 0x49, 0x2a, 00})
+	{
+		ft = Filetype::TIFF_Little_endian;
+	}
+	else if (vec == ByteVector{0x4d, 0x4d, 00, 0x2a})
+	{
+		ft = Filetype::TIFF_Big_endian;
+	}
+	else if (vec == ByteVector{ 0xff, 0xd8, 0xff, 0xe0 })
+	{
+		ft = Filetype::JPEG; // JPEG-Jfif
+	}
+	else if (vec == ByteVector{ 0xff, 0xd8, 0xff, 0xe1 })
+	{
+		ft = Filetype::JPEG; // JPEG-Exif
+	}
+	else
+	{
+		THROW(L"Not a tiff or jpeg file: \'" + fn + L"\'");
+	}
+
+	if (ft == Filetype::TIFF_Big_endian || ft == Filetype::TIFF_Little_endian)
+	{
+		Offset_t first_directory_offset = ReadTiffHeader(f, ft, G, 0);
+		ReadTiffDirectories(f, ft, G, first_directory_offset);
+	}
+	else if (ft == Filetype::JPEG)
+	{
+		Offset_t filesize = static_cast<Offset_t> (vibo::GetFileSize(f));
+		ReadJpegFileOrEmbeddedSection(f, G, 0, filesize, L"JPEG file", index);
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Free function: ReadJpegStream()
+//
+//		Reads a JPEG file from a stream that can't seek, such as stdin or a pipe, in one forward pass. Only JPEG input;
+//		a TIFF file has to be read with random access.
+// --------------------------------------------------------------------------------------------------------------------
+
+void ReadJpegStream(FILE* stream, GraphicsVector& G, JpegIndex* index)
+{
+	vibo::ByteReader r(stream);
+	if (!r.Ensure(3) || r.Current()[0] != 0xff || r.Current()[1] != 0xd8 || r.Current()[2] != 0xff)
+	{
+		THROW(L"Not a jpeg stream!");
+	}
+	ReadJpegFileOrEmbeddedSection(r, G, 0, (std::numeric_limits<Offset_t>::max)(), L"JPEG stream", index); // The length of the stream is not known, so it has no end to check against
+
+	const std::vector<std::wstring>& warnings = r.Warnings();
+	for (auto it = warnings.begin(); it != warnings.end(); ++it)
+	{
+		std::wcerr << L"Warning: " << *it << std::endl;
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Free function: ReadJpegHeader()
+//
+//		Reads the segments of a JPEG file up to the start of the scan, for what can be known of the file before its
+//		image data is read. The warnings of the parser are not printed; the file is read in full later.
+// --------------------------------------------------------------------------------------------------------------------
+
+void ReadJpegHeader(const std::wstring& fn, GraphicsVector& G, JpegIndex& index)
+{
+	std::unique_ptr<vibo::File> f = OpenGraphicsFile(fn, false);
+	vibo::ByteReader r(*f, 0);
+	if (!r.Ensure(3) || r.Current()[0] != 0xff || r.Current()[1] != 0xd8 || r.Current()[2] != 0xff)
+	{
+		THROW(L"Not a jpeg file: \'" + fn + L"\'");
+	}
+	ReadJpegFileOrEmbeddedSection(r, G, 0, vibo::GetFileSize(*f), L"JPEG file", &index, true);
+}
+
+
 // --------------------------------------------------------------------------------------------------------------------
 //		Free function: GetEndianness()
 // --------------------------------------------------------------------------------------------------------------------
@@ -22,6 +22,8 @@ enum class Filetype
 
 typedef std::vector<std::shared_ptr<FileSegment>> GraphicsVector;
 
+struct JpegIndex; // See JpegSegments.h
+
 // --------------------------------------------------------------------------------------------------------------------
 //		Free functions
 // --------------------------------------------------------------------------------------------------------------------
@@ -31,6 +33,14 @@ Endianness GetEndianness(Filetype t);
 Offset_t AddSegmentNopad(GraphicsVector& vec, std::shared_ptr<FileSegment> seg);
 Offset_t AddSegmentPadded(GraphicsVector& vec, std::shared_ptr<FileSegment> seg);
 
+void ReadFile(const std::wstring& fn, GraphicsVector& G);
+std::unique_ptr<vibo::File> OpenGraphicsFile(const std::wstring& fn, bool prefetch);
+void ParseGraphicsFile(vibo::File& f, const std::wstring& fn, GraphicsVector& G, JpegIndex* index = nullptr); // index: filled in for a JPEG file
+void ReadJpegStream(FILE* stream, GraphicsVector& G, JpegIndex* index = nullptr);
+void ReadJpegHeader(const std::wstring& fn, GraphicsVector& G, JpegIndex& index);
 void Dump(const GraphicsVector& vec);
 
+void WriteGraphicsVector(const GraphicsVector& vec, FILE* f);
+void WriteGraphicsVector(const GraphicsVector& vec, ByteVector& out);
+
 #endif
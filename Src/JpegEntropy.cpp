@@ -0,0 +1,164 @@
+// File: JpegEntropy.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "JpegEntropy.h"
+#include <algorithm>
+
+
+HuffmanCode::HuffmanCode() : defined(false)
+{
+	std::fill(mincode, mincode + 17, 0);
+	std::fill(maxcode, maxcode + 17, -1);
+	std::fill(valptr, valptr + 17, 0);
+	std::fill(values, values + 256, 0);
+	std::fill(code, code + 256, 0);
+	std::fill(size, size + 256, 0);
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		ReadHuffmanCodes()
+//
+//		A DHT segment has one or more tables: class and id, the number of codes of each length 1..16, and the symbols
+//		in the order of their codes. The codes themselves are canonical: the next code of a length is the previous
+//		one + 1, and one bit longer for the next length.
+// --------------------------------------------------------------------------------------------------------------------
+
+bool ReadHuffmanCodes(const JpegHuffmanTable& dht, HuffmanCode codes[8])
+{
+	vibo::ByteSpan D = dht.Data();
+	size_t pos = 4; // Past ff c4 and the length
+	while (pos < D.size())
+	{
+		if (pos + 17 > D.size())
+		{
+			return false;
+		}
+		int table_class = D[pos] >> 4;
+		int id = D[pos] & 15;
+		int count = 0;
+		for (int l = 1; l <= 16; ++l)
+		{
+			count += D[pos + l];
+		}
+		if (table_class > 1 || id > 3 || count > 256 || pos + 17 + count > D.size())
+		{
+			return false;
+		}
+
+		HuffmanCode& T = codes[4 * table_class + id];
+		T = HuffmanCode();
+		T.defined = true;
+		int code = 0;
+		int k = 0;
+		for (int l = 1; l <= 16; ++l)
+		{
+			int n = D[pos + l];
+			T.valptr[l] = k;
+			T.mincode[l] = code;
+			T.maxcode[l] = (n > 0) ? code + n - 1 : -1;
+			for (int i = 0; i < n; ++i, ++k, ++code)
+			{
+				unsigned char symbol = D[pos + 17 + k];
+				T.values[k] = symbol;
+				T.code[symbol] = static_cast<uint16_t>(code);
+				T.size[symbol] = static_cast<unsigned char>(l);
+			}
+			if (code > (1 << l))
+			{
+				return false; // More codes than there is room for
+			}
+			code <<= 1;
+		}
+		pos += 17 + count;
+	}
+	return true;
+}
+
+
+vibo::ByteSpan GetEntropyCodedData(const JpegImageData& data, ByteVector& buffer)
+{
+	if (data.IsRange())
+	{
+		buffer = data.CopyData();
+		return vibo::ByteSpan(buffer);
+	}
+	return data.Data();
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		GetScanLayout()
+// --------------------------------------------------------------------------------------------------------------------
+
+bool GetScanLayout(const JpegIndex& index, ScanLayout& layout)
+{
+	if (index.sof == nullptr || vibo::size(index.sos) != 1 || vibo::size(index.image_data) != 1)
+	{
+		return false;
+	}
+	const JpegStartOfFrame& sof = *index.sof;
+	vibo::ByteSpan SOS = index.sos.front()->Data();
+	int numComponents = sof.GetNumComponents();
+	if (sof.GetImageWidth() <= 0 || sof.GetImageLength() <= 0 || index.sos.front()->GetNumComponents() != numComponents)
+	{
+		return false; // The height is given later (in a DNL segment), or not one interleaved scan
+	}
+	if (vibo::size(SOS) < 5 + 2 * numComponents + 3)
+	{
+		return false;
+	}
+
+	for (auto it = index.dht.begin(); it != index.dht.end(); ++it)
+	{
+		if (!ReadHuffmanCodes(**it, layout.codes))
+		{
+			return false;
+		}
+	}
+
+	layout.hmax = 1;
+	layout.vmax = 1;
+	if (numComponents > 1)
+	{
+		for (int i = 0; i < numComponents; ++i)
+		{
+			layout.hmax = std::max(layout.hmax, sof.GetHorizontalSamplingFactor(i));
+			layout.vmax = std::max(layout.vmax, sof.GetVerticalSamplingFactor(i));
+		}
+	}
+
+	layout.components.clear();
+	for (int i = 0; i < numComponents; ++i)
+	{
+		int selector = SOS[5 + 2 * i];
+		int dc = SOS[6 + 2 * i] >> 4;
+		int ac = SOS[6 + 2 * i] & 15;
+		if (dc > 3 || ac > 3 || !layout.codes[dc].defined || !layout.codes[4 + ac].defined)
+		{
+			return false;
+		}
+		int j = 0;
+		while (j < numComponents && sof.GetComponentId(j) != selector)
+		{
+			++j;
+		}
+		if (j == numComponents)
+		{
+			return false;
+		}
+		ScanComponent C{ j, 1, 1, dc, 4 + ac };
+		if (numComponents > 1)
+		{
+			C.h = sof.GetHorizontalSamplingFactor(j);
+			C.v = sof.GetVerticalSamplingFactor(j);
+		}
+		layout.components.push_back(C);
+	}
+
+	layout.mcus_per_row = (sof.GetImageWidth() + 8 * layout.hmax - 1) / (8 * layout.hmax);
+	layout.mcu_rows = (sof.GetImageLength() + 8 * layout.vmax - 1) / (8 * layout.vmax);
+	return true;
+}
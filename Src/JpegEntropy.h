@@ -0,0 +1,276 @@
+// File: JpegEntropy.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef JPEGENTROPY_H_INCLUDED
+#define JPEGENTROPY_H_INCLUDED
+
+#include "JpegSegments.h"
+
+// --------------------------------------------------------------------------------------------------------------------
+//		The entropy-coded data of a baseline JPEG image
+//
+//		Huffman decoding and coding, for the code that works on the coefficients themselves (JpegRestart.cpp,
+//		JpegPreview.cpp). There is no IDCT here.
+// --------------------------------------------------------------------------------------------------------------------
+
+// A DC or AC table of a DHT segment, for decoding and for coding
+
+struct HuffmanCode
+{
+	bool defined;
+	int mincode[17];            // By code length. The codes of length l are mincode[l]..maxcode[l].
+	int maxcode[17];            // -1: no codes of this length
+	int valptr[17];             // Index in values of the first code of each length
+	unsigned char values[256];
+	uint16_t code[256];         // By symbol
+	unsigned char size[256];    // By symbol. 0: the symbol has no code.
+
+	HuffmanCode();
+};
+
+
+// Reads the tables of a DHT segment into codes[4 * class + id]. Returns false if the segment is malformed.
+bool ReadHuffmanCodes(const JpegHuffmanTable& dht, HuffmanCode codes[8]);
+
+
+// The entropy-coded data of an image. A range segment is read into buffer.
+vibo::ByteSpan GetEntropyCodedData(const JpegImageData& data, ByteVector& buffer);
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		ScanLayout -- the MCUs of a single baseline scan of all the components of the frame
+// --------------------------------------------------------------------------------------------------------------------
+
+struct ScanComponent
+{
+	int component;   // In the frame (see JpegStartOfFrame)
+	int h;           // Blocks in an MCU, horizontally and vertically. A single component is coded in single blocks.
+	int v;
+	int dc;          // In ScanLayout::codes
+	int ac;
+};
+
+
+struct ScanLayout
+{
+	HuffmanCode codes[8];                   // DC tables 0-3, then AC tables 0-3
+	std::vector<ScanComponent> components;  // In the order of the scan
+	int hmax;                               // Largest sampling factors; 1 for a single component
+	int vmax;
+	long long mcus_per_row;
+	long long mcu_rows;
+};
+
+// Returns false if index does not have a single scan of all the components that can be decoded
+bool GetScanLayout(const JpegIndex& index, ScanLayout& layout);
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		BitReader -- reads the bits of entropy-coded data, and removes the stuffed zero bytes
+//
+//		Past the end of the data, or at a marker, it reads zeros; Overrun() tells if any of those were used.
+// --------------------------------------------------------------------------------------------------------------------
+
+class BitReader
+{
+	const unsigned char* m_data;
+	size_t m_size;
+	size_t m_pos;
+	uint64_t m_bits;  // The next bits, starting at the most significant bit
+	int m_count;
+	int m_padding;    // Bits added past the end of the data
+
+	void Fill()
+	{
+		while (m_count <= 56)
+		{
+			unsigned int b = 0;
+			if (m_pos < m_size && m_data[m_pos] != 0xff)
+			{
+				b = m_data[m_pos++];
+			}
+			else if (m_pos + 1 < m_size && m_data[m_pos + 1] == 0x00)
+			{
+				b = 0xff;
+				m_pos += 2;
+			}
+			else
+			{
+				m_padding += 8; // The end of the data, or a marker
+			}
+			m_bits |= static_cast<uint64_t>(b) << (56 - m_count);
+			m_count += 8;
+		}
+	}
+
+public:
+	BitReader(const vibo::ByteSpan& data) : m_data(data.data()), m_size(data.size()), m_pos(0), m_bits(0), m_count(0), m_padding(0)
+	{
+		Fill();
+	}
+
+	// Continues at pos, e.g. after a restart marker
+	void Restart(size_t pos)
+	{
+		m_pos = pos;
+		m_bits = 0;
+		m_count = 0;
+		m_padding = 0;
+		Fill();
+	}
+
+	unsigned int Peek16() const
+	{
+		return static_cast<unsigned int>(m_bits >> 48);
+	}
+
+	void Skip(int n) // n <= 16
+	{
+		m_bits <<= n;
+		m_count -= n;
+		Fill();
+	}
+
+	unsigned int Get(int n) // n <= 16
+	{
+		if (n == 0)
+		{
+			return 0;
+		}
+		unsigned int value = static_cast<unsigned int>(m_bits >> (64 - n));
+		Skip(n);
+		return value;
+	}
+
+	bool Overrun() const
+	{
+		return m_count < m_padding;
+	}
+};
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		BitWriter -- writes entropy-coded data, with a zero byte stuffed after every ff
+// --------------------------------------------------------------------------------------------------------------------
+
+class BitWriter
+{
+	ByteVector& m_out;
+	uint32_t m_bits;
+	int m_count;
+
+public:
+	explicit BitWriter(ByteVector& out) : m_out(out), m_bits(0), m_count(0)
+	{
+	}
+
+	void Put(unsigned int value, int n) // n <= 16
+	{
+		m_bits = (m_bits << n) | (value & ((1u << n) - 1));
+		m_count += n;
+		while (m_count >= 8)
+		{
+			unsigned char b = static_cast<unsigned char>(m_bits >> (m_count - 8));
+			m_out.push_back(b);
+			if (b == 0xff)
+			{
+				m_out.push_back(0x00);
+			}
+			m_count -= 8;
+		}
+	}
+
+	void PadToByte() // With 1-bits, as the standard says
+	{
+		if (m_count > 0)
+		{
+			Put(0x7f, 8 - m_count);
+		}
+	}
+};
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Symbols and values
+// --------------------------------------------------------------------------------------------------------------------
+
+// Returns the next symbol, or -1 if the bits are not a code of the table
+inline int DecodeSymbol(BitReader& r, const HuffmanCode& T)
+{
+	unsigned int bits = r.Peek16();
+	for (int l = 1; l <= 16; ++l)
+	{
+		int code = static_cast<int>(bits >> (16 - l));
+		if (code <= T.maxcode[l])
+		{
+			r.Skip(l);
+			return T.values[T.valptr[l] + code - T.mincode[l]];
+		}
+	}
+	return -1;
+}
+
+
+// The value of the s extra bits that follow a DC difference or an AC coefficient of category s
+inline int Extend(unsigned int bits, int s)
+{
+	if (s == 0)
+	{
+		return 0;
+	}
+	int v = static_cast<int>(bits);
+	return (v < (1 << (s - 1))) ? v - (1 << s) + 1 : v;
+}
+
+
+// The category of a value, and its extra bits: the reverse of Extend()
+inline int Category(int value)
+{
+	int magnitude = (value < 0) ? -value : value;
+	int s = 0;
+	while (magnitude > 0)
+	{
+		magnitude >>= 1;
+		++s;
+	}
+	return s;
+}
+
+
+inline unsigned int ExtraBits(int value, int s)
+{
+	return static_cast<unsigned int>((value < 0) ? value + (1 << s) - 1 : value);
+}
+
+
+// Decodes the AC coefficients of a block without keeping them. Returns false on a bad code.
+inline bool SkipAcCoefficients(BitReader& r, const HuffmanCode& ac)
+{
+	int k = 1;
+	while (k < 64)
+	{
+		int rs = DecodeSymbol(r, ac);
+		if (rs < 0)
+		{
+			return false;
+		}
+		int run = rs >> 4;
+		int size = rs & 15;
+		if (size == 0)
+		{
+			if (run != 15)
+			{
+				break; // End of block
+			}
+			k += 16;
+			continue;
+		}
+		r.Skip(size);
+		k += run + 1;
+	}
+	return k <= 64;
+}
+
+#endif
@@ -0,0 +1,173 @@
+// File: JpegPreview.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "JpegPreview.h"
+#include "JpegEntropy.h"
+#include <algorithm>
+
+
+namespace // anonymous
+{
+	unsigned char Clamp(int v)
+	{
+		return static_cast<unsigned char>(std::min(std::max(v, 0), 255));
+	}
+
+
+	// The average of the 64 samples of a block. The DC coefficient is 8 times the average, level shifted by -128.
+	unsigned char BlockAverage(int dc, int quantizer)
+	{
+		int v = dc * quantizer;
+		int average = (v >= 0) ? (v + 4) / 8 : -((4 - v) / 8);
+		return Clamp(128 + average);
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		MakeDcPreview()
+// --------------------------------------------------------------------------------------------------------------------
+
+bool MakeDcPreview(const JpegIndex& index, DcPreview& preview)
+{
+	ScanLayout layout;
+	if (!GetScanLayout(index, layout))
+	{
+		return false;
+	}
+	const JpegStartOfFrame& sof = *index.sof;
+	const std::vector<ScanComponent>& components = layout.components;
+	int numComponents = vibo::size(components);
+	if ((numComponents != 1 && numComponents != 3) || sof.GetPrecision() != 8)
+	{
+		return false;
+	}
+
+	// The DC quantizer of each component (by its number in the frame). A table may be defined more than once; the last one counts.
+
+	std::vector<int> quantizer(numComponents, 0);
+	for (int f = 0; f < numComponents; ++f)
+	{
+		int table = sof.GetQuantizationTableNumber(f);
+		for (auto it = index.dqt.begin(); it != index.dqt.end(); ++it)
+		{
+			int q = (*it)->GetDcQuantizer(table);
+			if (q > 0)
+			{
+				quantizer[f] = q;
+			}
+		}
+		if (quantizer[f] == 0)
+		{
+			return false;
+		}
+	}
+
+	const JpegImageData& image_data = *index.image_data.front();
+	const std::vector<Offset_t>& restarts = image_data.GetRestartOffsets();
+	long long num_mcus = layout.mcus_per_row * layout.mcu_rows;
+	int interval = (index.dri != nullptr) ? index.dri->GetRestartInterval() : 0;
+	if (interval > 0 && vibo::size(restarts) + 1 != (num_mcus + interval - 1) / interval)
+	{
+		return false; // Missing or extra markers
+	}
+
+	// One sample per block, in a plane for each component
+
+	std::vector<ByteVector> planes(numComponents);
+	std::vector<long long> plane_width(numComponents);
+	int h[3];
+	int v[3];
+	for (auto it = components.begin(); it != components.end(); ++it)
+	{
+		h[it->component] = it->h;
+		v[it->component] = it->v;
+		plane_width[it->component] = layout.mcus_per_row * it->h;
+		planes[it->component].resize(static_cast<size_t>(plane_width[it->component] * layout.mcu_rows * it->v));
+	}
+
+	ByteVector buffer;
+	BitReader r(GetEntropyCodedData(image_data, buffer));
+	std::vector<int> predictor(numComponents, 0);
+	for (long long m = 0; m < num_mcus; ++m)
+	{
+		if (interval > 0 && m > 0 && m % interval == 0)
+		{
+			if (r.Overrun())
+			{
+				return false;
+			}
+			r.Restart(restarts[static_cast<size_t>(m / interval - 1)] + 2);
+			std::fill(predictor.begin(), predictor.end(), 0);
+		}
+		long long mcu_x = m % layout.mcus_per_row;
+		long long mcu_y = m / layout.mcus_per_row;
+		for (auto it = components.begin(); it != components.end(); ++it)
+		{
+			const HuffmanCode& dc = layout.codes[it->dc];
+			const HuffmanCode& ac = layout.codes[it->ac];
+			int f = it->component;
+			for (int y = 0; y < it->v; ++y)
+			{
+				for (int x = 0; x < it->h; ++x)
+				{
+					int s = DecodeSymbol(r, dc);
+					if (s < 0 || s > 11)
+					{
+						return false;
+					}
+					predictor[f] += Extend(r.Get(s), s);
+					if (!SkipAcCoefficients(r, ac))
+					{
+						return false;
+					}
+					planes[f][static_cast<size_t>((mcu_y * it->v + y) * plane_width[f] + mcu_x * it->h + x)] = BlockAverage(predictor[f], quantizer[f]);
+				}
+			}
+		}
+	}
+	if (r.Overrun())
+	{
+		return false;
+	}
+
+	// One pixel per block of the components with the largest sampling factors
+
+	int width = (sof.GetImageWidth() + 7) / 8;
+	int length = (sof.GetImageLength() + 7) / 8;
+	ByteVector pixels(static_cast<size_t>(width) * length * numComponents);
+	unsigned char* p = pixels.data();
+	for (int y = 0; y < length; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			int sample[3];
+			for (int f = 0; f < numComponents; ++f)
+			{
+				sample[f] = planes[f][static_cast<size_t>((y * v[f] / layout.vmax) * plane_width[f] + x * h[f] / layout.hmax)];
+			}
+			if (numComponents == 1)
+			{
+				*p++ = static_cast<unsigned char>(sample[0]);
+			}
+			else
+			{
+				// YCbCr to RGB, in 16-bit fixed point
+				int Y = sample[0] << 16;
+				int Cb = sample[1] - 128;
+				int Cr = sample[2] - 128;
+				*p++ = Clamp((Y + 91881 * Cr + 32768) >> 16);
+				*p++ = Clamp((Y - 22554 * Cb - 46802 * Cr + 32768) >> 16);
+				*p++ = Clamp((Y + 116130 * Cb + 32768) >> 16);
+			}
+		}
+	}
+
+	preview.width = width;
+	preview.length = length;
+	preview.samples_per_pixel = numComponents;
+	preview.pixels = std::move(pixels);
+	return true;
+}
@@ -0,0 +1,33 @@
+// File: JpegPreview.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef JPEGPREVIEW_H_INCLUDED
+#define JPEGPREVIEW_H_INCLUDED
+
+#include "JpegSegments.h"
+
+// --------------------------------------------------------------------------------------------------------------------
+//		DC preview
+//
+//		A 1/8 scale image of a baseline JPEG image, made from the DC coefficients alone: the DC coefficient of a block
+//		is 8 times the average of its 64 samples, so each 8x8 block becomes one pixel. Only the Huffman decoding is done
+//		(the AC coefficients are decoded to find the next block, and thrown away); there is no IDCT.
+//
+//		The samples are 8-bit: one per pixel for a single component, or RGB for three components, converted from YCbCr
+//		as in JFIF. Returns false, and leaves preview as it is, if the image can't be decoded or has another number of
+//		components.
+// --------------------------------------------------------------------------------------------------------------------
+
+struct DcPreview
+{
+	int width;
+	int length;
+	int samples_per_pixel;
+	ByteVector pixels;      // Row by row, with the samples of a pixel together
+};
+
+bool MakeDcPreview(const JpegIndex& index, DcPreview& preview);
+
+#endif
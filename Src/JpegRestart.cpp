@@ -0,0 +1,143 @@
+// File: JpegRestart.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "JpegRestart.h"
+#include "JpegEntropy.h"
+#include "CreateSegment.h"
+#include "Exception.h"
+#include <algorithm>
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		InsertRestartMarkers()
+// --------------------------------------------------------------------------------------------------------------------
+
+RestartResult InsertRestartMarkers(JpegIndex& index, int mcu_rows)
+{
+	if (mcu_rows <= 0 || (index.dri != nullptr && index.dri->GetRestartInterval() != 0))
+	{
+		return RestartResult::NotNeeded; // Has restart markers already
+	}
+	ScanLayout layout;
+	if (!GetScanLayout(index, layout))
+	{
+		return RestartResult::NotDecodable;
+	}
+
+	long long interval = std::min<long long>(mcu_rows, 0xffff / layout.mcus_per_row) * layout.mcus_per_row; // The interval is a 16-bit number
+	if (interval == 0 || interval >= layout.mcus_per_row * layout.mcu_rows)
+	{
+		return RestartResult::NotNeeded; // One interval is the whole image
+	}
+
+	// Decode, and code again
+
+	const std::shared_ptr<JpegImageData>& image_data = index.image_data.front();
+	ByteVector buffer;
+	vibo::ByteSpan source = GetEntropyCodedData(*image_data, buffer);
+	BitReader r(source);
+	ByteVector out;
+	out.reserve(source.size() + source.size() / 64 + 64);
+	BitWriter w(out);
+	std::vector<Offset_t> restart_offsets;
+	const std::vector<ScanComponent>& components = layout.components;
+	std::vector<int> dc_value(components.size(), 0);     // The DC predictor of the source
+	std::vector<int> dc_predictor(components.size(), 0); // The DC predictor of the new data, reset at each marker
+
+	long long num_mcus = layout.mcus_per_row * layout.mcu_rows;
+	for (long long m = 0; m < num_mcus; ++m)
+	{
+		if (m > 0 && m % interval == 0)
+		{
+			w.PadToByte();
+			restart_offsets.push_back(vibo::size(out));
+			out.push_back(0xff);
+			out.push_back(static_cast<unsigned char>(0xd0 + (restart_offsets.size() - 1) % 8));
+			std::fill(dc_predictor.begin(), dc_predictor.end(), 0);
+		}
+		for (size_t c = 0; c < components.size(); ++c)
+		{
+			const HuffmanCode& dc = layout.codes[components[c].dc];
+			const HuffmanCode& ac = layout.codes[components[c].ac];
+			for (int b = 0; b < components[c].h * components[c].v; ++b)
+			{
+				// DC: the difference from the predictor, which may be a different one now
+				int s = DecodeSymbol(r, dc);
+				if (s < 0 || s > 11)
+				{
+					return RestartResult::NotDecodable;
+				}
+				dc_value[c] += Extend(r.Get(s), s);
+				int difference = dc_value[c] - dc_predictor[c];
+				dc_predictor[c] = dc_value[c];
+				int category = Category(difference);
+				if (category > 11 || dc.size[category] == 0)
+				{
+					return RestartResult::NoDcCode; // Can't be coded with this table
+				}
+				w.Put(dc.code[category], dc.size[category]);
+				w.Put(ExtraBits(difference, category), category);
+
+				// AC: coded exactly as in the source
+				int k = 1;
+				while (k < 64)
+				{
+					int rs = DecodeSymbol(r, ac);
+					if (rs < 0)
+					{
+						return RestartResult::NotDecodable;
+					}
+					w.Put(ac.code[rs], ac.size[rs]);
+					int run = rs >> 4;
+					int size = rs & 15;
+					if (size == 0)
+					{
+						if (run != 15)
+						{
+							break; // End of block
+						}
+						k += 16;
+						continue;
+					}
+					w.Put(r.Get(size), size);
+					k += run + 1;
+				}
+				if (k > 64)
+				{
+					return RestartResult::NotDecodable;
+				}
+			}
+		}
+	}
+	w.PadToByte();
+	if (r.Overrun())
+	{
+		return RestartResult::NotDecodable;
+	}
+
+	// The new segments
+
+	std::shared_ptr<FileSegment> D = CreateSegment(Segmenttype::JpegImageData, Endianness::Big, image_data->GetOffset(), out.size());
+	D->AssignData(std::move(out));
+	std::shared_ptr<JpegImageData> new_image_data = std::static_pointer_cast<JpegImageData>(D);
+	new_image_data->SetRestartOffsets(std::move(restart_offsets));
+
+	std::shared_ptr<FileSegment> R = CreateSegment(Segmenttype::JpegRestartInterval, Endianness::Big, 0, 6);
+	R->AssignData(ByteVector{ 0xff, 0xdd, 0x00, 0x04, static_cast<unsigned char>(interval >> 8), static_cast<unsigned char>(interval & 0xff) });
+	std::shared_ptr<JpegRestartInterval> dri = std::static_pointer_cast<JpegRestartInterval>(R);
+
+	for (auto it = index.frame.begin(); it != index.frame.end(); ++it)
+	{
+		if (*it == image_data)
+		{
+			*it = D;
+		}
+	}
+	auto sos = std::find(index.frame.begin(), index.frame.end(), std::static_pointer_cast<FileSegment>(index.sos.front()));
+	index.frame.insert(sos, R); // The DRI segment goes before the scan
+	index.image_data.front() = new_image_data;
+	index.dri = dri;
+	return RestartResult::Inserted;
+}
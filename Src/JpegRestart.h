@@ -0,0 +1,37 @@
+// File: JpegRestart.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef JPEGRESTART_H_INCLUDED
+#define JPEGRESTART_H_INCLUDED
+
+#include "JpegSegments.h"
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Restart marker insertion
+//
+//		Rewrites the entropy-coded data of a JPEG image without restart markers, so that it has a restart marker every
+//		mcu_rows MCU rows, and adds the DRI segment. The image can then be cut into strips (see ConvertJpegToTiff.cpp).
+//
+//		Only the Huffman coding is touched: the data is Huffman-decoded and coded again with the same tables. The
+//		coefficients are not changed, and no DCT is done. The only values that are coded differently are the DC
+//		differences of the first block of each component after a marker, since the DC predictors are reset there.
+//
+//		Only for a baseline image with one scan. Unless the result is Inserted, index is left as it is.
+//		When Inserted, the image data and the DRI segment in index are new segments; the ones in the GraphicsVector that
+//		index was built from are not changed.
+// --------------------------------------------------------------------------------------------------------------------
+
+enum class RestartResult
+{
+	Inserted,
+	NotNeeded,      // The image has restart markers already, or is no more than mcu_rows MCU rows high
+	NotDecodable,   // Not a baseline image with one scan, or the entropy-coded data can't be decoded
+	NoDcCode        // A DC difference has no code in the DC table (the tables of an optimized file only have codes
+	                // for the differences in the original)
+};
+
+RestartResult InsertRestartMarkers(JpegIndex& index, int mcu_rows);
+
+#endif
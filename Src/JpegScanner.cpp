@@ -0,0 +1,180 @@
+// File: JpegScanner.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "JpegScanner.h"
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define JPEGSCANNER_X86
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+
+namespace // anonymous
+{
+	// ----------------------------------------------------------------------------------------------------------------
+	//		ClassifyMarker()
+	//
+	//		data[i] is ff. Moves i past the marker if the scan can continue, otherwise fills in result and returns true.
+	// ----------------------------------------------------------------------------------------------------------------
+
+	inline bool ClassifyMarker(const unsigned char* data, size_t size, size_t& i, Offset_t base, std::vector<Offset_t>& restart_offsets, JpegScanResult& result)
+	{
+		if (i + 1 >= size)
+		{
+			result = JpegScanResult{ i, JpegScanStop::NeedMoreData }; // Need the next byte to tell what this is
+			return true;
+		}
+		int b2 = data[i + 1];
+		if (b2 == 0)
+		{
+			i += 2; // ff 00 is the normal encoding of an ff data byte
+		}
+		else if (b2 >= 0xd0 && b2 <= 0xd7)
+		{
+			restart_offsets.push_back(base + static_cast<Offset_t>(i));
+			i += 2;
+		}
+		else if (b2 == 0xff)
+		{
+			i += 1; // Fill byte
+		}
+		else if (b2 == 0xd9)
+		{
+			result = JpegScanResult{ i, JpegScanStop::EndOfImage };
+			return true;
+		}
+		else
+		{
+			result = JpegScanResult{ i, JpegScanStop::UnexpectedMarker };
+			return true;
+		}
+		return false;
+	}
+
+
+	JpegScanResult ScanScalarFrom(const unsigned char* data, size_t size, size_t i, Offset_t base, std::vector<Offset_t>& restart_offsets)
+	{
+		JpegScanResult result;
+		while (i < size)
+		{
+			if (data[i] != 0xff)
+			{
+				++i;
+			}
+			else if (ClassifyMarker(data, size, i, base, restart_offsets, result))
+			{
+				return result;
+			}
+		}
+		return JpegScanResult{ size, JpegScanStop::NeedMoreData };
+	}
+
+
+#ifdef JPEGSCANNER_X86
+	inline unsigned long LowestSetBit(unsigned int mask)
+	{
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+	}
+#endif
+
+
+	typedef JpegScanResult(*ScanFunction)(const unsigned char*, size_t, Offset_t, std::vector<Offset_t>&);
+
+	ScanFunction SelectScanFunction()
+	{
+#ifdef JPEGSCANNER_X86
+		if (vibo::CpuHasAVX2())
+		{
+			return &ScanEntropyCodedDataAVX2;
+		}
+		if (vibo::CpuHasSSE2())
+		{
+			return &ScanEntropyCodedDataSSE2;
+		}
+#endif
+		return &ScanEntropyCodedDataScalar;
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		ScanEntropyCodedData()
+// --------------------------------------------------------------------------------------------------------------------
+
+JpegScanResult ScanEntropyCodedData(const unsigned char* data, size_t size, Offset_t base, std::vector<Offset_t>& restart_offsets)
+{
+	static const ScanFunction scan = SelectScanFunction();
+	return scan(data, size, base, restart_offsets);
+}
+
+
+JpegScanResult ScanEntropyCodedDataScalar(const unsigned char* data, size_t size, Offset_t base, std::vector<Offset_t>& restart_offsets)
+{
+	return ScanScalarFrom(data, size, 0, base, restart_offsets);
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		SIMD versions
+//
+//		Whole vectors without any ff byte are skipped. Otherwise we jump to the first ff, classify it, and load the
+//		next vector from just past the marker. ff bytes are rare in entropy-coded data, so this is the common case.
+//		The remainder that does not fill a vector is handled by the scalar loop.
+// --------------------------------------------------------------------------------------------------------------------
+
+JpegScanResult ScanEntropyCodedDataSSE2(const unsigned char* data, size_t size, Offset_t base, std::vector<Offset_t>& restart_offsets)
+{
+	size_t i = 0;
+#ifdef JPEGSCANNER_X86
+	const __m128i ff = _mm_set1_epi8(static_cast<char>(0xff));
+	JpegScanResult result;
+	while (i + 16 <= size)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, ff)));
+		if (mask == 0)
+		{
+			i += 16;
+			continue;
+		}
+		i += LowestSetBit(mask);
+		if (ClassifyMarker(data, size, i, base, restart_offsets, result))
+		{
+			return result;
+		}
+	}
+#endif
+	return ScanScalarFrom(data, size, i, base, restart_offsets);
+}
+
+
+JpegScanResult ScanEntropyCodedDataAVX2(const unsigned char* data, size_t size, Offset_t base, std::vector<Offset_t>& restart_offsets)
+{
+	size_t i = 0;
+#ifdef JPEGSCANNER_X86
+	const __m256i ff = _mm256_set1_epi8(static_cast<char>(0xff));
+	JpegScanResult result;
+	while (i + 32 <= size)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, ff)));
+		if (mask == 0)
+		{
+			i += 32;
+			continue;
+		}
+		i += LowestSetBit(mask);
+		if (ClassifyMarker(data, size, i, base, restart_offsets, result))
+		{
+			return result;
+		}
+	}
+#endif
+	return ScanScalarFrom(data, size, i, base, restart_offsets);
+}
@@ -0,0 +1,44 @@
+// File: JpegScanner.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef JPEGSCANNER_H_INCLUDED
+#define JPEGSCANNER_H_INCLUDED
+
+#include "Util.h"
+#include <stddef.h>
+#include <vector>
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Scanner for the entropy-coded data that follows a start-of-scan segment
+//
+//		Looks for ff bytes 16 (SSE2) or 32 (AVX2) at a time, and classifies the byte following each of them:
+//		ff 00 (stuffing) is skipped, ff d0-d7 (restart marker) is recorded, ff ff is a fill byte, and the scan stops at
+//		ff d9 (end of image) or at any other marker. The implementation is chosen at runtime; there is a scalar fallback.
+// --------------------------------------------------------------------------------------------------------------------
+
+enum class JpegScanStop
+{
+	NeedMoreData,       // End of the block reached. position may be size - 1, if the last byte is ff.
+	EndOfImage,         // position is at the ff of ff d9
+	UnexpectedMarker    // position is at the ff of a marker that does not belong in entropy-coded data
+};
+
+
+struct JpegScanResult
+{
+	size_t position;
+	JpegScanStop stop;
+};
+
+
+// Scans data[0..size). Restart marker offsets are appended to restart_offsets as base + (index of the ff byte).
+JpegScanResult ScanEntropyCodedData(const unsigned char* data, size_t size, Offset_t base, std::vector<Offset_t>& restart_offsets);
+
+// The implementations, exposed so that they can be compared with each other. Use ScanEntropyCodedData().
+JpegScanResult ScanEntropyCodedDataScalar(const unsigned char* data, size_t size, Offset_t base, std::vector<Offset_t>& restart_offsets);
+JpegScanResult ScanEntropyCodedDataSSE2(const unsigned char* data, size_t size, Offset_t base, std::vector<Offset_t>& restart_offsets);
+JpegScanResult ScanEntropyCodedDataAVX2(const unsigned char* data, size_t size, Offset_t base, std::vector<Offset_t>& restart_offsets);
+
+#endif
@@ -10,17 +10,18 @@
 #include <sstream>
 #include "Exception.h"
 #include "CreateSegment.h"
+#include "JpegScanner.h"
 #include "Util.h"
 
 
-std::wstring JpegMarkerString(const ByteVector& vec);
+std::wstring JpegMarkerString(const vibo::ByteSpan& vec);
 
 // --------------------------------------------------------------------------------------------------------------------
 //		class JpegSegment
 // --------------------------------------------------------------------------------------------------------------------
 
 
-JpegSegment::JpegSegment(Offset_t offset, int size, Endianness) : FileSegment(offset, size)
+JpegSegment::JpegSegment(Offset_t offset, Offset_t size, Endianness) : FileSegment(offset, size)
 {
 }
 
@@ -31,7 +32,7 @@ Endianness JpegSegment::FileEndianness() const
 
 void JpegSegment::InterpretData()
 {
-	SetLabel(JpegMarkerString(m_data));
+	SetLabel(JpegMarkerString(Data()));
 }
 
 
@@ -39,7 +40,7 @@ void JpegSegment::InterpretData()
 //		class JpegStartOfImage
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegStartOfImage::JpegStartOfImage(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e) // Fixed size 2
+JpegStartOfImage::JpegStartOfImage(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e) // Fixed size 2
 {
 }
 
@@ -54,7 +55,7 @@ void JpegStartOfImage::RebuildBinaryData()
 //		class JpegEndOfImage
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegEndOfImage::JpegEndOfImage(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e) // Fixed size 2
+JpegEndOfImage::JpegEndOfImage(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e) // Fixed size 2
 {
 }
 
@@ -69,7 +70,7 @@ void JpegEndOfImage::RebuildBinaryData()
 //		class JpegRestartMarker
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegRestartMarker::JpegRestartMarker(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegRestartMarker::JpegRestartMarker(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -78,7 +79,7 @@ JpegRestartMarker::JpegRestartMarker(Offset_t offset, int size, Endianness e) :
 //		class JpegApp0Segment -- JFIF header
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegApp0Segment::JpegApp0Segment(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegApp0Segment::JpegApp0Segment(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -87,7 +88,7 @@ JpegApp0Segment::JpegApp0Segment(Offset_t offset, int size, Endianness e) : Jpeg
 //		class JpegApp1Segment -- // EXIF header, XMP
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegApp1Segment::JpegApp1Segment(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegApp1Segment::JpegApp1Segment(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -96,7 +97,7 @@ JpegApp1Segment::JpegApp1Segment(Offset_t offset, int size, Endianness e) : Jpeg
 //		class JpegApp2Segment -- // Usually ICC profile
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegApp2Segment::JpegApp2Segment(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegApp2Segment::JpegApp2Segment(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -105,7 +106,7 @@ JpegApp2Segment::JpegApp2Segment(Offset_t offset, int size, Endianness e) : Jpeg
 //		class JpegApp2Segment -- // Usually ICC profile
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegApp3Segment::JpegApp3Segment(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegApp3Segment::JpegApp3Segment(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -114,7 +115,7 @@ JpegApp3Segment::JpegApp3Segment(Offset_t offset, int size, Endianness e) : Jpeg
 //		class JpegOtherAppSegment
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegOtherAppSegment::JpegOtherAppSegment(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegOtherAppSegment::JpegOtherAppSegment(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -123,37 +124,62 @@ JpegOtherAppSegment::JpegOtherAppSegment(Offset_t offset, int size, Endianness e
 //		class JpegQuantizationTable
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegQuantizationTable::JpegQuantizationTable(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegQuantizationTable::JpegQuantizationTable(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
 
+// A DQT segment has one or more tables: precision and id, then 64 values (one or two bytes) in zigzag order
+
+int JpegQuantizationTable::GetDcQuantizer(int id) const
+{
+	vibo::ByteSpan D = Data();
+	size_t pos = 4; // Past ff db and the length
+	while (pos < D.size())
+	{
+		int precision = D[pos] >> 4;
+		size_t value_size = (precision == 0) ? 1 : 2;
+		if (pos + 1 + 64 * value_size > D.size())
+		{
+			return 0;
+		}
+		if ((D[pos] & 15) == id)
+		{
+			return (value_size == 1) ? D[pos + 1] : vibo::MakeUShort(&D[pos + 1], Endianness::Big);
+		}
+		pos += 1 + 64 * value_size;
+	}
+	return 0;
+}
+
+
 // --------------------------------------------------------------------------------------------------------------------
 //		class JpegStartOfFrame
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegStartOfFrame::JpegStartOfFrame(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e), m_precision(0), m_width(0), m_length(0), m_num_components(0), m_component_info{}
+JpegStartOfFrame::JpegStartOfFrame(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e), m_precision(0), m_width(0), m_length(0), m_num_components(0), m_component_info{}
 {
 }
 
 
 void JpegStartOfFrame::InterpretData()
 {
-	ASSERT(vibo::size(m_data) > 10);
+	vibo::ByteSpan D = Data();
+	ASSERT(vibo::size(D) > 10);
 
-	SetLabel(JpegMarkerString(m_data));
-	m_precision = vibo::MakeUByte(&m_data[4]);
-	m_length = vibo::MakeUShort(&m_data[5], FileEndianness());
-	m_width = vibo::MakeUShort(&m_data[7], FileEndianness());
-	m_num_components = vibo::MakeUByte(&m_data[9]);
+	SetLabel(JpegMarkerString(D));
+	m_precision = vibo::MakeUByte(&D[4]);
+	m_length = vibo::MakeUShort(&D[5], FileEndianness());
+	m_width = vibo::MakeUShort(&D[7], FileEndianness());
+	m_num_components = vibo::MakeUByte(&D[9]);
 
-	ASSERT(vibo::size(m_data) == 10 + 3 * m_num_components);
+	ASSERT(vibo::size(D) == 10 + 3 * m_num_components);
 	for (int i = 0; i < m_num_components; ++i)
 	{
 		Component_info info;
-		info.id = vibo::MakeUByte(&m_data[10 + 3 * i]);
-		info.sampling_factors = vibo::MakeUByte(&m_data[11 + 3 * i]);
-		info.quantitation_table_number = vibo::MakeUByte(&m_data[12 + 3 * i]);
+		info.id = vibo::MakeUByte(&D[10 + 3 * i]);
+		info.sampling_factors = vibo::MakeUByte(&D[11 + 3 * i]);
+		info.quantitation_table_number = vibo::MakeUByte(&D[12 + 3 * i]);
 		m_component_info.push_back(info);
 	}
 }
@@ -224,11 +250,25 @@ int JpegStartOfFrame::GetVerticalSamplingFactor(unsigned component) const
 }
 
 
+int JpegStartOfFrame::GetComponentId(unsigned component) const
+{
+	ASSERT(component >= 0 && component < m_component_info.size());
+	return m_component_info[component].id;
+}
+
+
+int JpegStartOfFrame::GetQuantizationTableNumber(unsigned component) const
+{
+	ASSERT(component >= 0 && component < m_component_info.size());
+	return m_component_info[component].quantitation_table_number;
+}
+
+
 // --------------------------------------------------------------------------------------------------------------------
 //		class JpegHuffmanTable
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegHuffmanTable::JpegHuffmanTable(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegHuffmanTable::JpegHuffmanTable(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -237,17 +277,55 @@ JpegHuffmanTable::JpegHuffmanTable(Offset_t offset, int size, Endianness e) : Jp
 //		class JpegStartOfScan
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegStartOfScan::JpegStartOfScan(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegStartOfScan::JpegStartOfScan(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e), m_num_components(0)
 {
 }
 
 
+void JpegStartOfScan::InterpretData()
+{
+	JpegSegment::InterpretData();
+	vibo::ByteSpan D = Data();
+	if (vibo::size(D) >= 5) // Otherwise a corrupt segment, which is copied as it is
+	{
+		m_num_components = vibo::MakeUByte(&D[4]);
+	}
+}
+
+
+int JpegStartOfScan::GetNumComponents() const
+{
+	return m_num_components;
+}
+
+
 // --------------------------------------------------------------------------------------------------------------------
 //		class JpegImageData
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegImageData::JpegImageData(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegImageData::JpegImageData(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
+{
+}
+
+
+void JpegImageData::SetRestartOffsets(std::vector<Offset_t>&& offsets)
 {
+	m_restart_offsets = std::move(offsets);
+}
+
+
+const std::vector<Offset_t>& JpegImageData::GetRestartOffsets() const
+{
+	return m_restart_offsets;
+}
+
+
+void JpegImageData::MoveStateTo(FileSegment& target)
+{
+	JpegImageData* T = dynamic_cast<JpegImageData*>(&target);
+	ASSERT(T != nullptr);
+	T->m_restart_offsets = std::move(m_restart_offsets);
+	m_restart_offsets.clear();
 }
 
 
@@ -255,7 +333,7 @@ JpegImageData::JpegImageData(Offset_t offset, int size, Endianness e) : JpegSegm
 //		class JpegNumberOfLines
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegNumberOfLines::JpegNumberOfLines(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegNumberOfLines::JpegNumberOfLines(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -264,16 +342,33 @@ JpegNumberOfLines::JpegNumberOfLines(Offset_t offset, int size, Endianness e) :
 //		class JpegRestartInterval
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegRestartInterval::JpegRestartInterval(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegRestartInterval::JpegRestartInterval(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e), m_interval(0)
 {
 }
 
 
+void JpegRestartInterval::InterpretData()
+{
+	JpegSegment::InterpretData();
+	vibo::ByteSpan D = Data();
+	if (vibo::size(D) >= 6)
+	{
+		m_interval = vibo::MakeUShort(&D[4], FileEndianness());
+	}
+}
+
+
+int JpegRestartInterval::GetRestartInterval() const
+{
+	return m_interval;
+}
+
+
 // --------------------------------------------------------------------------------------------------------------------
 //		class JpegSpecialSegment
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegSpecialSegment::JpegSpecialSegment(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegSpecialSegment::JpegSpecialSegment(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -282,7 +377,7 @@ JpegSpecialSegment::JpegSpecialSegment(Offset_t offset, int size, Endianness e)
 //		class JpegCommentSegment
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegCommentSegment::JpegCommentSegment(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegCommentSegment::JpegCommentSegment(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -291,7 +386,7 @@ JpegCommentSegment::JpegCommentSegment(Offset_t offset, int size, Endianness e)
 //		class JpegReservedSegment
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegReservedSegment::JpegReservedSegment(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegReservedSegment::JpegReservedSegment(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -300,7 +395,7 @@ JpegReservedSegment::JpegReservedSegment(Offset_t offset, int size, Endianness e
 //		class JpegUnknownSegment
 // --------------------------------------------------------------------------------------------------------------------
 
-JpegUnknownSegment::JpegUnknownSegment(Offset_t offset, int size, Endianness e) : JpegSegment(offset, size, e)
+JpegUnknownSegment::JpegUnknownSegment(Offset_t offset, Offset_t size, Endianness e) : JpegSegment(offset, size, e)
 {
 }
 
@@ -308,17 +403,14 @@ JpegUnknownSegment::JpegUnknownSegment(Offset_t offset, int size, Endianness e)
 // --------------------------------------------------------------------------------------------------------------------
 //		Free function ReadJpegStartOfImage()
 //
-//		filepos on entry: doesn't matter
-//		filepos on exit:  offset + 2
+//		reader position on entry: at the marker
+//		reader position on exit:  just past the marker
 // --------------------------------------------------------------------------------------------------------------------
 
-void ReadJpegStartOfImage(FILE* f, GraphicsVector& G, Offset_t offset, const std::wstring& comment)
+void ReadJpegStartOfImage(vibo::ByteReader& r, GraphicsVector& G, const std::wstring& comment)
 {
-	int check = fseek(f, offset, SEEK_SET);
-	ASSERT(check == 0);
-
-	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegStartOfImage, Endianness::Big, offset, 2);
-	S->ReadData(f);
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegStartOfImage, Endianness::Big, r.Position(), 2);
+	S->ReadData(r);
 	if (!comment.empty())
 	{
 		S->SetLabel(comment);
@@ -332,17 +424,14 @@ void ReadJpegStartOfImage(FILE* f, GraphicsVector& G, Offset_t offset, const std
 // --------------------------------------------------------------------------------------------------------------------
 //		Free function ReadJpegEndOfImage()
 //
-//		filepos on entry: doesn't matter
-//		filepos on exit:  offset + 2
+//		reader position on entry: at the marker
+//		reader position on exit:  just past the marker
 // --------------------------------------------------------------------------------------------------------------------
 
-void ReadJpegEndOfImage(FILE* f, GraphicsVector& G, Offset_t offset, const std::wstring& comment)
+void ReadJpegEndOfImage(vibo::ByteReader& r, GraphicsVector& G, const std::wstring& comment)
 {
-	int check = fseek(f, offset, SEEK_SET);
-	ASSERT(check == 0);
-
-	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegEndOfImage, Endianness::Big, offset, 2);
-	S->ReadData(f);
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegEndOfImage, Endianness::Big, r.Position(), 2);
+	S->ReadData(r);
 	if (!comment.empty())
 	{
 		S->SetLabel(comment);
@@ -356,18 +445,15 @@ void ReadJpegEndOfImage(FILE* f, GraphicsVector& G, Offset_t offset, const std::
 // --------------------------------------------------------------------------------------------------------------------
 //		Free function ReadJpegRestartMarker()
 //
-//		filepos on entry: doesn't matter
-//		filepos on exit:  offset + 2
+//		reader position on entry: at the marker
+//		reader position on exit:  just past the marker
 //		NOTE: I think this only appears in the data section, but include a handling function to be on the safe side.
 // --------------------------------------------------------------------------------------------------------------------
 
-void ReadJpegRestartMarker(FILE* f, GraphicsVector& G, Offset_t offset)
+void ReadJpegRestartMarker(vibo::ByteReader& r, GraphicsVector& G)
 {
-	int check = fseek(f, offset, SEEK_SET);
-	ASSERT(check == 0);
-	
-	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegRestartMarker, Endianness::Big, offset, 2);
-	S->ReadData(f);
+	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegRestartMarker, Endianness::Big, r.Position(), 2);
+	S->ReadData(r);
 	ASSERT(S->GetDataByte(0) == 0xff);
 	int databyte2 = S->GetDataByte(1);
 	ASSERT(databyte2 >= 0xd0 && databyte2 <= 0xd7);
@@ -375,18 +461,24 @@ void ReadJpegRestartMarker(FILE* f, GraphicsVector& G, Offset_t offset)
 }
 
 
-void ReadJpegUnspecifiedSegment(FILE* f, GraphicsVector& G, Segmenttype seg, Offset_t offset)
+// --------------------------------------------------------------------------------------------------------------------
+//		Free function ReadJpegUnspecifiedSegment()
+//
+//		reader position on entry: at the marker
+//		reader position on exit:  just past the segment
+// --------------------------------------------------------------------------------------------------------------------
+
+void ReadJpegUnspecifiedSegment(vibo::ByteReader& r, GraphicsVector& G, Segmenttype seg)
 {
-	int check = fseek(f, offset + 2, SEEK_SET); // offset + 2: Skip ff xx signature
-	ASSERT(check == 0);
-	UShort_t length = vibo::GetUShort(f, Endianness::Big); // JPEG is bigendian
+	if (!r.Ensure(4))
+	{
+		THROW(L"Unexpected end of JPEG data!");
+	}
+	UShort_t length = vibo::MakeUShort(r.Current() + 2, Endianness::Big); // + 2: Skip ff xx signature. JPEG is bigendian
 	length += 2; // Because the length that is stored in the segment does not include the initial 2 bytes (ff e2 etc.)
 
-	check = fseek(f, offset, SEEK_SET); // Go back to start of segment
-	ASSERT(check == 0);
-
-	std::shared_ptr<FileSegment> S = CreateSegment(seg, Endianness::Big, offset, length);
-	S->ReadData(f);
+	std::shared_ptr<FileSegment> S = CreateSegment(seg, Endianness::Big, r.Position(), length);
+	S->ReadData(r);
 	ASSERT(S->GetDataByte(0) == 0xff);
 
 	AddSegmentNopad(G, S);
@@ -396,58 +488,66 @@ void ReadJpegUnspecifiedSegment(FILE* f, GraphicsVector& G, Segmenttype seg, Off
 // --------------------------------------------------------------------------------------------------------------------
 //		Free function ReadJpegImagedata
 //
-//		filepos on entry: doesn't matter
-//		filepos on exit:  just past the segment starting at offset, i.e. offset + length
+//		reader position on entry: just past the start-of-scan segment
+//		reader position on exit:  at the end-of-image marker
+//
+//		The entropy-coded data is scanned (see JpegScanner.h), but never loaded. For a mapped file the segment becomes a
+//		view into the mapping (or the memory buffer); otherwise it refers to the range of the input file, which is copied when
+//		the output is written. Only when reading a stream are the bytes kept, as they are scanned.
+//		The offsets of any restart markers are kept with the segment.
 // --------------------------------------------------------------------------------------------------------------------
 
-void ReadJpegImagedata(FILE* f, GraphicsVector& G)
+void ReadJpegImagedata(vibo::ByteReader& r, GraphicsVector& G)
 {
-	int filepos = ftell(f);
-	int filepos2 = filepos;
+	Offset_t filepos = r.Position();
 	bool eoi_marker_found = false;
-	while (!feof(f))
+	std::vector<Offset_t> restart_offsets;
+	bool capture = !r.InMemory() && !r.IsSeekable(); // A stream can't be read again, so the data is kept as it is scanned
+	ByteVector captured;
+
+	while (!eoi_marker_found && r.Ensure(2))
 	{
-		int b1 = vibo::GetByte(f);
-		if (b1 == EOF)
-		{
-			break;
-		}
-		if (b1 != 0xff) continue;
-		int b2 = vibo::GetByte(f);
-		if (b2 == EOF)
-		{
-			break;
-		}
-		else if (b2 == 0)
-		{
-			continue; // ff 00 is the normal encoding of an ff data byte
-		}
-		else if (b2 == 0xd9)
+		const unsigned char* p = r.Current();
+		JpegScanResult scan = ScanEntropyCodedData(p, r.Available(), r.Position() - filepos, restart_offsets);
+		size_t scanned = scan.position;
+		if (scan.stop == JpegScanStop::EndOfImage)
 		{
-			// ff d9 is End of image (and eof) marker!
-			filepos2 = ftell(f);
-			ASSERT(filepos2 != EOF);
-			eoi_marker_found = true;
-			break;
+			eoi_marker_found = true; // ff d9 is End of image (and eof) marker!
 		}
-		else if (b2 >= 0xd0 && b2 <= 0xd7)
+		else if (scan.stop == JpegScanStop::UnexpectedMarker)
 		{
-			// Ignore -- sync markers!
+			std::wostringstream message;
+			message << L"ff " << std::hex << static_cast<int>(p[scanned + 1]) << L" appeared in jpeg image data stream!";
+			r.Warn(message.str());
+			scanned += 2;
 		}
-		else
+		if (capture)
 		{
-			std::wcerr << L"Warning: ff " << std::hex << b2 << L" appeared in jpeg image data stream!" << std::endl;
+			captured.insert(captured.end(), p, p + scanned);
 		}
+		r.Advance(scanned);
 	}
 	if (!eoi_marker_found)
 	{
-		std::cout << L"*** ERROR: Unexpected EOF ***\n";
+		r.Warn(L"Unexpected EOF in jpeg image data stream!");
 		return;
 	}
-	Offset_t imagedatasize = filepos2 - filepos - 2; // -2 because we don't include the end-of-image marker
+	Offset_t imagedatasize = r.Position() - filepos; // We don't include the end-of-image marker
 
 	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::JpegImageData, Endianness::Big, filepos, imagedatasize);
-	S->ReadData(f); // filepos is now at filepos + imagedatasize
+	if (r.InMemory())
+	{
+		S->AssignView(r.View(filepos, imagedatasize), r.Owner());
+	}
+	else if (capture)
+	{
+		S->AssignData(std::move(captured));
+	}
+	else
+	{
+		S->AssignRange(r.GetFile().Handle(), filepos); // Copied from the input file when the output is written
+	}
+	std::dynamic_pointer_cast<JpegImageData>(S)->SetRestartOffsets(std::move(restart_offsets));
 	AddSegmentNopad(G, S);
 	return;
 }
@@ -458,26 +558,45 @@ void ReadJpegImagedata(FILE* f, GraphicsVector& G)
 //
 //		filepos on entry: doesn't matter
 //		filepos on exit:  undefined
+//
+//		The file version prints the parser's warnings on std::wcerr. The reader version leaves them in the reader, and
+//		expects it to be positioned at offset. header_only: stop after the first start of scan, before the image data.
 // --------------------------------------------------------------------------------------------------------------------
 
-void ReadJpegFileOrEmbeddedSection(FILE* f, GraphicsVector& G, Offset_t offset, int datasize, const std::wstring& comment)
+void ReadJpegFileOrEmbeddedSection(vibo::File& f, GraphicsVector& G, Offset_t offset, Offset_t datasize, const std::wstring& comment, JpegIndex* index)
 {
-	int chk = fseek(f, offset, SEEK_SET);
-	ASSERT(chk == 0);
+	vibo::ByteReader r(f, offset);
+	ReadJpegFileOrEmbeddedSection(r, G, offset, datasize, comment, index);
+
+	const std::vector<std::wstring>& warnings = r.Warnings();
+	for (auto it = warnings.begin(); it != warnings.end(); ++it)
+	{
+		std::wcerr << L"Warning: " << *it << std::endl;
+	}
+}
+
+
+void ReadJpegFileOrEmbeddedSection(vibo::ByteReader& r, GraphicsVector& G, Offset_t offset, Offset_t datasize, const std::wstring& comment, JpegIndex* index, bool header_only)
+{
+	ASSERT(r.Position() == offset);
 
 	int nesting = 0;
 
-	ByteVector vec = vibo::GetBytes(f, 2);
-	if (vec[0] == 0xff && vec[1] == 0xd8)
+	if (r.Ensure(2) && r.Current()[0] == 0xff && r.Current()[1] == 0xd8)
 	{
-		ReadJpegStartOfImage(f, G, offset, comment); // filepos is now offset+2
+		ReadJpegStartOfImage(r, G, comment); // reader is now at offset+2
 		unsigned char prev_marker[2];
-		Offset_t endoffset = offset + datasize;
+		Offset_t endoffset = vibo::CheckedAdd(offset, datasize);
 		for (;;)
 		{
-			// The file position is correctly positioned on entry, and should be updated correctly
-			Offset_t filepos = ftell(f);
-			vec = vibo::GetBytes(f, 2);
+			// The reader is correctly positioned on entry, and should be updated correctly
+			Offset_t filepos = r.Position();
+			size_t first_new = G.size(); // Segments from here on are added to the index at the end of the iteration
+			if (!r.Ensure(2))
+			{
+				THROW(L"Unexpected end of JPEG data!");
+			}
+			const unsigned char* vec = r.Current();
 			if (filepos > endoffset)
 			{
 				ASSERT(false); // Done this way to allow setting a breakpoint
@@ -489,8 +608,8 @@ void ReadJpegFileOrEmbeddedSection(FILE* f, GraphicsVector& G, Offset_t offset,
 			{
 				if (vec[1] == 0xd9)
 				{
-					ReadJpegEndOfImage(f, G, filepos, comment);
-					Offset_t currentpos = ftell(f);
+					ReadJpegEndOfImage(r, G, comment);
+					Offset_t currentpos = r.Position();
 					if (true || currentpos >= endoffset) // Return anyway -- Nikon B700 images has new StartOfImage near the end of the file!
 					{
 						return; // DNG may have two contiguous jpegs! (referenced by different directories)
@@ -500,111 +619,128 @@ void ReadJpegFileOrEmbeddedSection(FILE* f, GraphicsVector& G, Offset_t offset,
 				else if (vec[1] == 0xd8)
 				{
 					//!! THROW(L"Unexpected start of JPEG image marker (nesting not allowed)");
-					int chk = fseek(f, filepos, SEEK_SET);
-					ASSERT(chk == 0);
 					++nesting;
-					ReadJpegStartOfImage(f, G, offset, L"NESTED SEGMENT");
+					ReadJpegStartOfImage(r, G, L"NESTED SEGMENT");
 				}
 				else if (vec[1] == 0xc4)
 				{
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegHuffmanTable, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegHuffmanTable);
 				}
 				else if (vec[1] == 0xcc)
 				{
 					// Define Arithmetic conditioning table
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegSpecialSegment, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegSpecialSegment);
 
 				}
 				else if (vec[1] >= 0xc0 && vec[1] <= 0xcf)
 				{
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegStartOfFrame, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegStartOfFrame);
 
 				}
 				else if (vec[1] >= 0xd0 && vec[1] <= 0xd7)
 				{
 					// Restart interval 'm' modulo 8 *
 					// This marker has no data, requires special processing.
-					void ReadJpegRestartMarker(FILE* f, GraphicsVector& G, Offset_t offset);
+					ReadJpegRestartMarker(r, G);
 				}
 				else if (vec[1] == 0xda)
 				{
 					// Start of scan
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegStartOfScan, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegStartOfScan);
 				}
 				else if (vec[1] == 0xdb)
 				{// Define quantization table(s)
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegQuantizationTable, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegQuantizationTable);
 
 				}
 				else if (vec[1] == 0xdc)
 				{
 					// Define number of lines
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegNumberOfLines, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegNumberOfLines);
 
 				}
 				else if (vec[1] == 0xdd)
 				{
 					// Define restart interval
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegRestartInterval, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegRestartInterval);
 				}
 				else if (vec[1] == 0xde)
 				{
 					// Define hierarchical progression
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegSpecialSegment, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegSpecialSegment);
 				}
 				else if (vec[1] == 0xdf)
 				{
 					// Expand reference component(s)
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegSpecialSegment, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegSpecialSegment);
 				}
 				else if (vec[1] == 0xe0)
 				{
 					// jfif header
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegApp0Segment, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegApp0Segment);
 				}
 				else if (vec[1] == 0xe1)
 				{
 					// exif header or segment
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegApp1Segment, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegApp1Segment);
 				}
 				else if (vec[1] == 0xe2)
 				{
 					// Usually ICC definition
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegApp2Segment, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegApp2Segment);
 				}
 				else if (vec[1] >= 0xe3 && vec[1] <= 0xef)
 				{
 					// Other APP marker
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegOtherAppSegment, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegOtherAppSegment);
 				}
 				else if (vec[1] == 0xfe)
 				{
 					// Label
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegCommentSegment, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegCommentSegment);
 				}
 				else if (vec[1] == 0x01)
 				{
 					// For temporary private use in arithmetic coding *
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegSpecialSegment, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegSpecialSegment);
 				}
 				else if ((vec[1] > 0x02 && vec[1] <= 0xbf) || (vec[1] >= 0xf0 && vec[1] <= 0xfd) || vec[1] == 0xc8)
 				{
 					// Reserved
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegReservedSegment, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegReservedSegment);
 				}
 				else
 				{
-					ReadJpegUnspecifiedSegment(f, G, Segmenttype::JpegUnknownSegment, filepos);
+					ReadJpegUnspecifiedSegment(r, G, Segmenttype::JpegUnknownSegment);
 				}
 			}
 			else
 			{
 				break;
 			}
+			bool stop = false;
 			if (prev_marker[0] == 0xff && prev_marker[1] == 0xda)
 			{
 				// Start of scan marker was the last one read, i.e. image data should follow
-				ReadJpegImagedata(f, G);
+				if (header_only)
+				{
+					stop = true;
+				}
+				else
+				{
+					ReadJpegImagedata(r, G);
+				}
+			}
+			if (index != nullptr)
+			{
+				for (size_t i = first_new; i < G.size(); ++i)
+				{
+					index->Add(G[i]->GetSegmenttype(), G[i]);
+				}
+			}
+			if (stop)
+			{
+				return;
 			}
 		}
 	}
@@ -615,7 +751,63 @@ void ReadJpegFileOrEmbeddedSection(FILE* f, GraphicsVector& G, Offset_t offset,
 }
 
 
-std::wstring JpegMarkerString(const ByteVector& vec)
+// --------------------------------------------------------------------------------------------------------------------
+//		JpegIndex
+// --------------------------------------------------------------------------------------------------------------------
+
+void JpegIndex::Add(Segmenttype seg, const std::shared_ptr<FileSegment>& S)
+{
+	// The segment types are set by CreateSegment(), so the static casts are safe
+	switch (seg)
+	{
+	case Segmenttype::JpegStartOfFrame:
+		sof = std::static_pointer_cast<JpegStartOfFrame>(S);
+		frame.push_back(S);
+		break;
+	case Segmenttype::JpegRestartInterval:
+		dri = std::static_pointer_cast<JpegRestartInterval>(S);
+		frame.push_back(S);
+		break;
+	case Segmenttype::JpegStartOfScan:
+		sos.push_back(std::static_pointer_cast<JpegStartOfScan>(S));
+		frame.push_back(S);
+		break;
+	case Segmenttype::JpegImageData:
+		image_data.push_back(std::static_pointer_cast<JpegImageData>(S));
+		frame.push_back(S);
+		break;
+	case Segmenttype::JpegQuantizationTable:
+		dqt.push_back(std::static_pointer_cast<JpegQuantizationTable>(S));
+		tables.push_back(S);
+		break;
+	case Segmenttype::JpegHuffmanTable:
+		dht.push_back(std::static_pointer_cast<JpegHuffmanTable>(S));
+		tables.push_back(S);
+		break;
+	case Segmenttype::JpegApp1Segment:
+		app1.push_back(std::static_pointer_cast<JpegApp1Segment>(S));
+		break;
+	case Segmenttype::JpegApp2Segment:
+		app2.push_back(std::static_pointer_cast<JpegApp2Segment>(S));
+		break;
+	default:
+		break;
+	}
+}
+
+
+JpegIndex BuildJpegIndex(const GraphicsVector& G)
+{
+	JpegIndex index;
+	for (auto it = G.begin(); it != G.end(); ++it)
+	{
+		index.Add((*it)->GetSegmenttype(), *it);
+	}
+	return index;
+}
+
+
+std::wstring JpegMarkerString(const vibo::ByteSpan& vec)
 {
 	std::wstringstream s;
 	if (vibo::size(vec) >= 2)
@@ -8,18 +8,24 @@
 
 #include "GraphicsFile.h"
 #include "FileSegment.h"
+#include "ByteReader.h"
 #include <stdio.h>
+#include <memory>
+#include <vector>
+
+struct JpegIndex; // Below
 
 // --------------------------------------------------------------------------------------------------------------------
 //		Free functions
 // --------------------------------------------------------------------------------------------------------------------
 
-void ReadJpegStartOfImage(FILE* f, GraphicsVector& G, Offset_t offset, const std::wstring& comment);
-void ReadJpegEndOfImage(FILE* f, GraphicsVector& G, Offset_t offset, const std::wstring& comment);
-void ReadJpegRestartMarker(FILE* f, GraphicsVector& G, Offset_t offset);
-void ReadJpegUnspecifiedSegment(FILE* f, GraphicsVector& G, Segmenttype seg, Offset_t offset);
-void ReadJpegImagedata(FILE* f, GraphicsVector& G);
-void ReadJpegFileOrEmbeddedSection(FILE* f, GraphicsVector& G, Offset_t offset, int datasize, const std::wstring& comment);
+void ReadJpegStartOfImage(vibo::ByteReader& r, GraphicsVector& G, const std::wstring& comment);
+void ReadJpegEndOfImage(vibo::ByteReader& r, GraphicsVector& G, const std::wstring& comment);
+void ReadJpegRestartMarker(vibo::ByteReader& r, GraphicsVector& G);
+void ReadJpegUnspecifiedSegment(vibo::ByteReader& r, GraphicsVector& G, Segmenttype seg);
+void ReadJpegImagedata(vibo::ByteReader& r, GraphicsVector& G);
+void ReadJpegFileOrEmbeddedSection(vibo::File& f, GraphicsVector& G, Offset_t offset, Offset_t datasize, const std::wstring& comment, JpegIndex* index = nullptr);
+void ReadJpegFileOrEmbeddedSection(vibo::ByteReader& r, GraphicsVector& G, Offset_t offset, Offset_t datasize, const std::wstring& comment, JpegIndex* index = nullptr, bool header_only = false);
 
 // --------------------------------------------------------------------------------------------------------------------
 //		Derived JPEG classes
@@ -28,7 +34,7 @@ void ReadJpegFileOrEmbeddedSection(FILE* f, GraphicsVector& G, Offset_t offset,
 class JpegSegment : public FileSegment
 {
 public:
-	JpegSegment(Offset_t offset, int size, Endianness e);
+	JpegSegment(Offset_t offset, Offset_t size, Endianness e);
 	Endianness FileEndianness() const;
 
 protected:
@@ -40,7 +46,7 @@ protected:
 class JpegStartOfImage : public JpegSegment
 {
 public:
-	JpegStartOfImage(Offset_t offset, int size, Endianness e);
+	JpegStartOfImage(Offset_t offset, Offset_t size, Endianness e);
 	~JpegStartOfImage() = default;
 	void RebuildBinaryData();
 };
@@ -49,7 +55,7 @@ public:
 class JpegEndOfImage : public JpegSegment
 {
 public:
-	JpegEndOfImage(Offset_t offset, int size, Endianness e); // fixed size 2
+	JpegEndOfImage(Offset_t offset, Offset_t size, Endianness e); // fixed size 2
 	~JpegEndOfImage() = default;
 	void RebuildBinaryData();
 };
@@ -58,7 +64,7 @@ public:
 class JpegRestartMarker : public JpegSegment
 {
 public:
-	JpegRestartMarker(Offset_t offset, int size, Endianness e);
+	JpegRestartMarker(Offset_t offset, Offset_t size, Endianness e);
 	~JpegRestartMarker() = default;
 };
 
@@ -66,7 +72,7 @@ public:
 class JpegApp0Segment : public JpegSegment
 {
 public:
-	JpegApp0Segment(Offset_t offset, int size, Endianness e);
+	JpegApp0Segment(Offset_t offset, Offset_t size, Endianness e);
 	~JpegApp0Segment() = default;
 };
 
@@ -74,7 +80,7 @@ public:
 class JpegApp1Segment : public JpegSegment
 {
 public:
-	JpegApp1Segment(Offset_t offset, int size, Endianness e);
+	JpegApp1Segment(Offset_t offset, Offset_t size, Endianness e);
 	~JpegApp1Segment() = default;
 };
 
@@ -82,7 +88,7 @@ public:
 class JpegApp2Segment : public JpegSegment
 {
 public:
-	JpegApp2Segment(Offset_t offset, int size, Endianness e);
+	JpegApp2Segment(Offset_t offset, Offset_t size, Endianness e);
 	~JpegApp2Segment() = default;
 };
 
@@ -90,7 +96,7 @@ public:
 class JpegApp3Segment : public JpegSegment
 {
 public:
-	JpegApp3Segment(Offset_t offset, int size, Endianness e);
+	JpegApp3Segment(Offset_t offset, Offset_t size, Endianness e);
 	~JpegApp3Segment() = default;
 };
 
@@ -98,7 +104,7 @@ public:
 class JpegOtherAppSegment : public JpegSegment
 {
 public:
-	JpegOtherAppSegment(Offset_t offset, int size, Endianness e);
+	JpegOtherAppSegment(Offset_t offset, Offset_t size, Endianness e);
 	~JpegOtherAppSegment() = default;
 };
 
@@ -106,8 +112,10 @@ public:
 class JpegQuantizationTable : public JpegSegment
 {
 public:
-	JpegQuantizationTable(Offset_t offset, int size, Endianness e);
+	JpegQuantizationTable(Offset_t offset, Offset_t size, Endianness e);
 	~JpegQuantizationTable() = default;
+
+	int GetDcQuantizer(int id) const; // The first value of table id; 0 if the segment does not define it
 };
 
 
@@ -128,7 +136,7 @@ class JpegStartOfFrame : public JpegSegment
 	std::vector<Component_info> m_component_info;
 
 public:
-	JpegStartOfFrame(Offset_t offset, int size, Endianness e);
+	JpegStartOfFrame(Offset_t offset, Offset_t size, Endianness e);
 	~JpegStartOfFrame() = default;
 	std::vector<std::wstring> StringRepresentation() const override;
 
@@ -139,6 +147,8 @@ public:
 	int GetNumComponents() const;
 	int GetHorizontalSamplingFactor(unsigned component) const;
 	int GetVerticalSamplingFactor(unsigned component) const;
+	int GetComponentId(unsigned component) const;
+	int GetQuantizationTableNumber(unsigned component) const;
 
 protected:
 	void InterpretData() override;
@@ -148,47 +158,69 @@ protected:
 class JpegHuffmanTable : public JpegSegment
 {
 public:
-	JpegHuffmanTable(Offset_t offset, int size, Endianness e);
+	JpegHuffmanTable(Offset_t offset, Offset_t size, Endianness e);
 	~JpegHuffmanTable() = default;
 };
 
 
 class JpegStartOfScan : public JpegSegment
 {
+	int m_num_components;
+
 public:
-	JpegStartOfScan(Offset_t offset, int size, Endianness e);
+	JpegStartOfScan(Offset_t offset, Offset_t size, Endianness e);
 	~JpegStartOfScan() = default;
+
+	int GetNumComponents() const; // In this scan
+
+protected:
+	void InterpretData() override;
 };
 
 
 class JpegImageData : public JpegSegment
 {
+	std::vector<Offset_t> m_restart_offsets; // Relative to the start of the segment, found while scanning the data
+
 public:
-	JpegImageData(Offset_t offset, int size, Endianness e);
+	JpegImageData(Offset_t offset, Offset_t size, Endianness e);
 	~JpegImageData() = default;
+
+	void SetRestartOffsets(std::vector<Offset_t>&& offsets);
+	const std::vector<Offset_t>& GetRestartOffsets() const;
+
+protected:
+	void MoveStateTo(FileSegment& target) override;
 };
 
 
 class JpegNumberOfLines : public JpegSegment
 {
 public:
-	JpegNumberOfLines(Offset_t offset, int size, Endianness e);
+	JpegNumberOfLines(Offset_t offset, Offset_t size, Endianness e);
 	~JpegNumberOfLines() = default;
 };
 
 
 class JpegRestartInterval : public JpegSegment
 {
+	int m_interval;
+
 public:
-	JpegRestartInterval(Offset_t offset, int size, Endianness e);
+	JpegRestartInterval(Offset_t offset, Offset_t size, Endianness e);
 	~JpegRestartInterval() = default;
+
+	int GetRestartInterval() const; // MCUs between restart markers; 0 means no restart markers
+
+protected:
+	void InterpretData() override;
 };
 
 
 class JpegSpecialSegment : public JpegSegment
 {
 public:
-	JpegSpecialSegment(Offset_t offset, int size, Endianness e);
+	JpegSpecialSegment(Offset_t offset, Offset_t size, Endianness e);
 	~JpegSpecialSegment() = default;
 };
 
@@ -196,7 +228,7 @@ public:
 class JpegCommentSegment : public JpegSegment
 {
 public:
-	JpegCommentSegment(Offset_t offset, int size, Endianness e);
+	JpegCommentSegment(Offset_t offset, Offset_t size, Endianness e);
 	~JpegCommentSegment() = default;
 };
 
@@ -204,7 +236,7 @@ public:
 class JpegReservedSegment : public JpegSegment
 {
 public:
-	JpegReservedSegment(Offset_t offset, int size, Endianness e);
+	JpegReservedSegment(Offset_t offset, Offset_t size, Endianness e);
 	~JpegReservedSegment() = default;
 };
 
@@ -212,9 +244,36 @@ public:
 class JpegUnknownSegment : public JpegSegment
 {
 public:
-	JpegUnknownSegment(Offset_t offset, int size, Endianness e);
+	JpegUnknownSegment(Offset_t offset, Offset_t size, Endianness e);
 	~JpegUnknownSegment() = default;
 };
 
+
+// --------------------------------------------------------------------------------------------------------------------
+//		JpegIndex -- typed references to the segments of a JPEG file that the conversion uses
+//
+//		Filled in by the parser as it reads the segments (see ReadJpegFileOrEmbeddedSection()), or afterwards from a
+//		GraphicsVector by BuildJpegIndex(). frame and tables keep the order of the file.
+// --------------------------------------------------------------------------------------------------------------------
+
+struct JpegIndex
+{
+	std::shared_ptr<JpegStartOfFrame> sof;                          // The last one, if there are several
+	std::shared_ptr<JpegRestartInterval> dri;                       // The last one, if there are several
+	std::vector<std::shared_ptr<JpegStartOfScan>> sos;
+	std::vector<std::shared_ptr<JpegImageData>> image_data;
+	std::vector<std::shared_ptr<JpegQuantizationTable>> dqt;
+	std::vector<std::shared_ptr<JpegHuffmanTable>> dht;
+	std::vector<std::shared_ptr<JpegApp1Segment>> app1;
+	std::vector<std::shared_ptr<JpegApp2Segment>> app2;
+
+	std::vector<std::shared_ptr<FileSegment>> frame;                // Start of frame, restart interval, start of scan and image data
+	std::vector<std::shared_ptr<FileSegment>> tables;               // Quantization and Huffman tables
+
+	void Add(Segmenttype seg, const std::shared_ptr<FileSegment>& S); // Ignores the segments that are not indexed
+};
+
+JpegIndex BuildJpegIndex(const GraphicsVector& G);
+
 #endif
 
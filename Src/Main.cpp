@@ -8,6 +8,8 @@
 
 #pragma warning(disable: 4996)
 #include <iostream>
+#include <io.h>
+#include <fcntl.h>
 #include <string>
 #include <vector>
 #include "Exception.h"
@@ -19,24 +21,156 @@
 #include "CreateSegment.h"
 
 #include "ConvertJpegToTiff.h"
+#include "Batch.h"
 
 
-
-void ReadFile(std::wstring fn, GraphicsVector& G);
+static void PrintWarnings(const std::vector<std::wstring>& warnings)
+{
+	for (auto it = warnings.begin(); it != warnings.end(); ++it)
+	{
+		std::wcerr << L"Warning: " << *it << std::endl;
+	}
+}
 
 
 int wmain(int argc, wchar_t* argv[])
 {
 	try
 	{
+		// Conversion options, before the other arguments (see ConvertJpegToTiff.h):
+		// -exiforder: write the TIFF file in the byte order of the EXIF block
+		// -restart N: insert restart markers every N MCU rows in a JPEG that has none, so that it can be cut into strips
+		// -preview: add a 1/8 scale preview, made from the DC coefficients
+		// -thumbnail: add the thumbnail of the EXIF block
+		// -bigtiff: write a BigTIFF file even if the file would fit in a TIFF file
+		ConversionOptions conversion;
+		int first = 1;
+		while (argc > first)
+		{
+			std::wstring arg = argv[first];
+			if (arg == L"-exiforder")
+			{
+				conversion.byte_order = TiffByteOrder::FromExif;
+				++first;
+			}
+			else if (arg == L"-preview")
+			{
+				conversion.preview = true;
+				++first;
+			}
+			else if (arg == L"-thumbnail")
+			{
+				conversion.exif_thumbnail = true;
+				++first;
+			}
+			else if (arg == L"-bigtiff")
+			{
+				conversion.bigtiff = true;
+				++first;
+			}
+			else if (arg == L"-restart" && argc > first + 1)
+			{
+				conversion.restart_rows = _wtoi(argv[first + 1]);
+				first += 2;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		if (argc > first && std::wstring(argv[first]) == L"-batch")
+		{
+			// -batch [-threads N | -pipeline R,P,A,W [-queue N]] [-outdir DIR] input... (files, directories, @listfiles). See Batch.h.
+			BatchOptions options;
+			options.conversion = conversion;
+			for (int i = first + 1; i < argc; ++i)
+			{
+				std::wstring arg = argv[i];
+				if (arg == L"-threads" && i + 1 < argc)
+				{
+					options.num_threads = _wtoi(argv[++i]);
+				}
+				else if (arg == L"-outdir" && i + 1 < argc)
+				{
+					options.output_directory = argv[++i];
+				}
+				else if (arg == L"-pipeline" && i + 1 < argc)
+				{
+					// Threads for the read, parse, assemble and write stages, e.g. 1,4,2,1
+					options.pipeline = true;
+					swscanf(argv[++i], L"%d,%d,%d,%d", &options.read_threads, &options.parse_threads, &options.assemble_threads, &options.write_threads);
+				}
+				else if (arg == L"-queue" && i + 1 < argc)
+				{
+					options.queue_capacity = _wtoi(argv[++i]);
+				}
+				else
+				{
+					options.inputs.push_back(arg);
+				}
+			}
+			BatchSummary summary = ConvertBatch(options);
+			return (summary.failed > 0) ? 1 : 0;
+		}
+
+		if (argc > first + 1 && std::wstring(argv[first]) == L"-multipage")
+		{
+			// -multipage outfile.tif [-threads N] [-queue N] input... (files, directories, @listfiles), one page each. See Batch.h.
+			MultiPageOptions options;
+			options.conversion = conversion;
+			options.output_file = argv[first + 1];
+			for (int i = first + 2; i < argc; ++i)
+			{
+				std::wstring arg = argv[i];
+				if (arg == L"-threads" && i + 1 < argc)
+				{
+					options.num_threads = _wtoi(argv[++i]);
+				}
+				else if (arg == L"-queue" && i + 1 < argc)
+				{
+					options.pages_in_flight = _wtoi(argv[++i]);
+				}
+				else
+				{
+					options.inputs.push_back(arg);
+				}
+			}
+			BatchSummary summary = ConvertToMultiPageTiff(options);
+			return (summary.failed > 0) ? 1 : 0;
+		}
+
+		if (argc > first && std::wstring(argv[first]) == L"-")
+		{
+			// Read the JPEG file from stdin, in one pass, and write the TIFF file to stdout (or to argv[2]).
+			_setmode(_fileno(stdin), _O_BINARY);
+			GraphicsVector G;
+			JpegIndex index;
+			ReadJpegStream(stdin, G, &index);
+			std::vector<std::wstring> warnings;
+			GraphicsVector TiffFile = AssembleTiff(G, index, conversion, &warnings);
+			PrintWarnings(warnings);
+			if (argc > first + 1 && std::wstring(argv[first + 1]) != L"-")
+			{
+				WriteTiff(TiffFile, argv[first + 1]);
+			}
+			else
+			{
+				_setmode(_fileno(stdout), _O_BINARY);
+				WriteGraphicsVector(TiffFile, stdout);
+				fflush(stdout);
+			}
+			return 0;
+		}
+
 		GraphicsVector G;
-		if (argc > 1)
+		if (argc > first)
 		{
-			std::wstring infile_name = argv[1];
+			std::wstring infile_name = argv[first];
 			std::wstring outfile_name{};
-			if (argc > 2)
+			if (argc > first + 1)
 			{
-				std::wstring outfile_name = argv[2];
+				outfile_name = argv[first + 1];
 			}
 			else
 			{
@@ -65,7 +199,21 @@ int wmain(int argc, wchar_t* argv[])
 			ReadFile(infile_name, G);
 			// std::wcout << L"\n\n";
 			// Dump(G);
-			ConvertJpegToTiff(G, outfile_name);
+			std::vector<std::wstring> warnings;
+			ConvertJpegToTiff(G, outfile_name, conversion, &warnings);
+			PrintWarnings(warnings);
+		}
+		else
+		{
+			std::wcerr << L"Usage: " << argv[0] << L" [-exiforder] [-restart N] [-preview] [-thumbnail] [-bigtiff] infile.jpg [outfile.tif]" << std::endl;
+			std::wcerr << L"       " << argv[0] << L" [-exiforder] [-restart N] [-preview] [-thumbnail] [-bigtiff] - [outfile.tif]    (jpeg from stdin; tiff to stdout unless outfile.tif is given)" << std::endl;
+			std::wcerr << L"       " << argv[0] << L" [-exiforder] [-restart N] [-preview] [-thumbnail] [-bigtiff] -batch [-threads N | -pipeline R,P,A,W [-queue N]] [-outdir DIR] file|directory|@listfile ..." << std::endl;
+			std::wcerr << L"       " << argv[0] << L" [-exiforder] [-restart N] [-preview] [-thumbnail] [-bigtiff] -multipage outfile.tif [-threads N] [-queue N] file|directory|@listfile ...    (one page per jpeg)" << std::endl;
+			std::wcerr << L"       -exiforder: the tiff file gets the byte order of the jpeg's exif block (default: little-endian)" << std::endl;
+			std::wcerr << L"       -restart N: a jpeg without restart markers gets one every N MCU rows, and the tiff file gets strips" << std::endl;
+			std::wcerr << L"       -preview: the tiff file gets a 1/8 scale preview (a SubIFD), made without decoding the image" << std::endl;
+			std::wcerr << L"       -thumbnail: the exif thumbnail of the jpeg is copied to the tiff file (a SubIFD)" << std::endl;
+			std::wcerr << L"       -bigtiff: always write a BigTIFF file (default: only when the file would be larger than 4 GB)" << std::endl;
 		}
 	}
 	catch (std::wstring& e)
@@ -80,50 +228,3 @@ int wmain(int argc, wchar_t* argv[])
 	}
 	return 0;
 }
-
-
-void ReadFile(std::wstring fn, GraphicsVector& G)
-{
-	vibo::File f(_wfopen(fn.c_str(), L"rb"));
-	if (f == nullptr)
-	{
-		std::wcerr << L"Error opening file \'" << fn << "\'\n";
-		exit(0);
-	}
-
-	ByteVector vec = vibo::GetBytes(f, 4);
-	Filetype ft = Filetype::Unknown;
-	if (vec == ByteVector{0x49, 0x49, 0x2a, 00})
-	{
-		ft = Filetype::TIFF_Little_endian;
-	}
-	else if (vec == ByteVector{0x4d, 0x4d, 00, 0x2a})
-	{
-		ft = Filetype::TIFF_Big_endian;
-	}
-	else if (vec == ByteVector{ 0xff, 0xd8, 0xff, 0xe0 })
-	{
-		ft = Filetype::JPEG; // JPEG-Jfif
-	}
-	else if (vec == ByteVector{ 0xff, 0xd8, 0xff, 0xe1 })
-	{
-		ft = Filetype::JPEG; // JPEG-Exif
-	}
-	else
-	{
-		std::wcout << L"Not a tiff or jpeg file\n";
-		exit(0);
-	}
-
-	if (ft == Filetype::TIFF_Big_endian || ft == Filetype::TIFF_Little_endian)
-	{
-		Offset_t first_directory_offset = ReadTiffHeader(f, ft, G, 0);
-		ReadTiffDirectories(f, ft, G, first_directory_offset);
-	}
-	else if (ft == Filetype::JPEG)
-	{
-		Offset_t filesize = static_cast<Offset_t> (vibo::GetFileSize(f));
-		ReadJpegFileOrEmbeddedSection(f, G, 0, filesize, L"JPEG file");
-	}
-}
-
@@ -17,7 +17,7 @@
 //		valid_icc_chunk()
 // ----------------------------------------------------------------------------------------------------------------------------------------
 
-bool valid_icc_chunk(const ByteVector& V)
+bool valid_icc_chunk(const vibo::ByteSpan& V)
 {
 	// V starts with FF E2 nn nn, where nn nn is the length of the segment (not counting the initial FF F2)
 
@@ -57,7 +57,7 @@ bool valid_icc_chunk(const ByteVector& V)
 //		X is the chunk number (1..Y).
 // ----------------------------------------------------------------------------------------------------------------------------------------
 
-ByteVector ReadIccProfile(std::vector<std::shared_ptr<JpegApp2Segment>>& App2Segments)
+ByteVector ReadIccProfile(const std::vector<std::shared_ptr<JpegApp2Segment>>& App2Segments)
 {
 	ByteVector IccProfile{};
 
@@ -66,7 +66,7 @@ ByteVector ReadIccProfile(std::vector<std::shared_ptr<JpegApp2Segment>>& App2Seg
 
 	for (auto it = App2Segments.begin(); it != App2Segments.end(); ++it)
 	{
-		const ByteVector& D = (*it)->Data();
+		vibo::ByteSpan D = (*it)->Data();
 		if (valid_icc_chunk(D))
 		{
 			// valid_icc_chunk guarantees that D.size() >= 18.
@@ -126,7 +126,7 @@ ByteVector ReadIccProfile(std::vector<std::shared_ptr<JpegApp2Segment>>& App2Seg
 //		valid_exif_chunk()
 // ----------------------------------------------------------------------------------------------------------------------------------------
 
-bool valid_exif_chunk(const ByteVector& V)
+bool valid_exif_chunk(const vibo::ByteSpan& V)
 {
 	// V starts with {FF E1 nn nn E X I F 0 0 S1 S2 S3 S4 xx xx xx xx }, where nn nn is the length of the segment, S1 S2 S3 S4 is {I I 2a 0} or {M M 0 2a} and xx xx xx xx is the offset of the TIFF directory
 
@@ -195,34 +195,33 @@ std::vector<std::tuple<TiffDirEntry, ByteVector>> ReadDirectory(const ByteVector
 {
 	std::vector<std::tuple<TiffDirEntry, ByteVector >> directory_info;
 
+	if (vibo::CheckedAdd(offset, 2) > memory.size())
+	{
+		THROW(L"Invalid directory offset in Exif App1 segment!");
+	}
 	int num_entries = vibo::MakeUShort(&memory[offset], ee);
-
-	Offset_t exifdir_offset = 0;
-	Offset_t gpsdir_offset = 0;
+	if (offset + 2 + 12 * static_cast<Offset_t>(num_entries) > memory.size()) //  2 = { num_entries }, 12 = sizeof(dir entry)
+	{
+		THROW(L"Invalid directory in Exif App1 segment!");
+	}
 
 	for (int i = 0; i < num_entries; ++i)
 	{
 		TiffDirEntry e;
-		e.InitializeFromMemory(&memory[offset + 2 + 12 * i], ee); //  2 = { num_entries }, 12 = sizeof(dir entry)
+		e.InitializeFromMemory(&memory[offset + 2 + 12 * i], ee);
 
 		ByteVector V;
 
-		ULong_t datasize = e.GetDataSize();
+		Offset_t datasize = e.GetDataSize();
 		if (datasize > 4)
 		{
 			Offset_t offs = e.GetOffsetField();
-			if (offs + datasize < (ULong_t) vibo::size(memory))
+			if (vibo::CheckedAdd(offs, datasize) <= memory.size())
 			{
-				ByteVector tmp(offs + memory.begin(), offs + datasize + memory.begin()); // Correction for endianness is performed in Write_Selected_Entries(), ConvertGraphicsFileToTiff.cpp
+				ByteVector tmp(memory.begin() + static_cast<size_t>(offs), memory.begin() + static_cast<size_t>(offs + datasize)); // Correction for endianness is performed in Write_Selected_Entries(), ConvertGraphicsFileToTiff.cpp
 				tmp.swap(V);
 			}
-			else if (offs + datasize == vibo::size(memory))
-			{
-				// special case, we have just reached the end of mem
-				ByteVector tmp(offs + memory.begin(), memory.end());
-				tmp.swap(V);
-			}
-			// else ERROR...
+			// else the data is outside the segment, and V is left empty
 		}
 		directory_info.emplace_back(std::make_tuple(e, V));
 	}
@@ -249,6 +248,57 @@ Offset_t find_offset(const std::vector<std::tuple<TiffDirEntry, ByteVector>>& di
 }
 
 
+// ----------------------------------------------------------------------------------------------------------------------------------------
+//		Find the value of an entry with a single short or long value
+// ----------------------------------------------------------------------------------------------------------------------------------------
+
+int find_value(const std::vector<std::tuple<TiffDirEntry, ByteVector>>& dir, int tagID)
+{
+	int num_entries = vibo::size(dir);
+	for (int i = 0; i < num_entries; ++i)
+	{
+		const TiffDirEntry& E = std::get<TiffDirEntry>(dir[i]);
+		if (E.Tag() == tagID && E.GetDataCount() == 1 && (E.GetDataType() == Datatype::Ushort || E.GetDataType() == Datatype::Ulong))
+		{
+			return E.GetIntegerValue();
+		}
+	}
+	return 0;
+}
+
+
+// ----------------------------------------------------------------------------------------------------------------------------------------
+//		read_thumbnail()
+// ----------------------------------------------------------------------------------------------------------------------------------------
+//		IFD1 follows the main directory (its offset is after the last entry), and holds the thumbnail as an offset and
+//		a length (JPEGInterchangeFormat, JPEGInterchangeFormatLength). Nothing is read if the offsets are not valid.
+// ----------------------------------------------------------------------------------------------------------------------------------------
+
+ByteVector read_thumbnail(const ByteVector& memory, Offset_t main_dir_offset, Endianness ee)
+{
+	ByteVector thumbnail;
+	unsigned long long size = memory.size();
+	unsigned long long next_offset_pos = main_dir_offset + 2ull + 12ull * vibo::MakeUShort(&memory[main_dir_offset], ee);
+	if (next_offset_pos + 4 > size)
+	{
+		return thumbnail;
+	}
+	Offset_t ifd1_offset = vibo::MakeULong(&memory[next_offset_pos], ee);
+	if (ifd1_offset == 0 || ifd1_offset + 2ull > size || ifd1_offset + 2ull + 12ull * vibo::MakeUShort(&memory[ifd1_offset], ee) > size)
+	{
+		return thumbnail;
+	}
+	std::vector<std::tuple<TiffDirEntry, ByteVector>> ifd1 = ReadDirectory(memory, ifd1_offset, ee);
+	unsigned long long offset = static_cast<unsigned int>(find_value(ifd1, TiffTag::JPEGInterchangeFormat));
+	unsigned long long length = static_cast<unsigned int>(find_value(ifd1, TiffTag::JPEGInterchangeFormatLength));
+	if (offset > 0 && length > 0 && offset + length <= size)
+	{
+		thumbnail.assign(memory.begin() + offset, memory.begin() + offset + length);
+	}
+	return thumbnail;
+}
+
+
 // ----------------------------------------------------------------------------------------------------------------------------------------
 //		ReadApp1Metadata()
 // ----------------------------------------------------------------------------------------------------------------------------------------
@@ -257,13 +307,14 @@ Offset_t find_offset(const std::vector<std::tuple<TiffDirEntry, ByteVector>>& di
 //		nn nn = size (bigendian) of the segment (minus 2, FF E1 do not count). 
 // ----------------------------------------------------------------------------------------------------------------------------------------
 
-exif_info ReadApp1Metadata(std::vector<std::shared_ptr<JpegApp1Segment>>& App1Segments)
+exif_info ReadApp1Metadata(const std::vector<std::shared_ptr<JpegApp1Segment>>& App1Segments)
 {
 	exif_info metadata;
+	metadata.endianness = Endianness::Little; // If there is no Exif block
 
 	for (auto it = App1Segments.begin(); it != App1Segments.end(); ++it)
 	{
-		const ByteVector& D = (*it)->Data();
+		vibo::ByteSpan D = (*it)->Data();
 		if (valid_exif_chunk(D))
 		{
 			if (D[10] == 0x49)
@@ -280,7 +331,7 @@ exif_info ReadApp1Metadata(std::vector<std::shared_ptr<JpegApp1Segment>>& App1Se
 			}
 
 			Offset_t dir_offset = vibo::MakeULong(&D[14], metadata.endianness); // The directory offset is located at pos 14, after {FF E1 nn nn E X I F 0 0 S1 S2 S3 S4}
-			if (dir_offset + 18 >= (ULong_t) vibo::size(D)) // 18: 2 + 12 + 4: size of directory with one entry
+			if (dir_offset + 18 >= D.size()) // 18: 2 + 12 + 4: size of directory with one entry
 			{
 				THROW(L"Invalid directory offset in Exif App1 segment!");
 			}
@@ -299,6 +350,8 @@ exif_info ReadApp1Metadata(std::vector<std::shared_ptr<JpegApp1Segment>>& App1Se
 			{
 				metadata.gps_dir = ReadDirectory(D2, gpsdir_offset, metadata.endianness);
 			}
+
+			metadata.thumbnail = read_thumbnail(D2, dir_offset, metadata.endianness);
 		}
 	}
 	return metadata;
@@ -12,7 +12,7 @@
 #include <tuple>
 #include "TiffDirEntry.h"
 
-ByteVector ReadIccProfile(std::vector<std::shared_ptr<JpegApp2Segment>>& App2Segments);
+ByteVector ReadIccProfile(const std::vector<std::shared_ptr<JpegApp2Segment>>& App2Segments);
 
 
 struct exif_info
@@ -21,8 +21,13 @@ struct exif_info
 	std::vector<std::tuple<TiffDirEntry, ByteVector>> main_dir;
 	std::vector<std::tuple<TiffDirEntry, ByteVector>> exif_dir;
 	std::vector<std::tuple<TiffDirEntry, ByteVector>> gps_dir;
+	ByteVector thumbnail; // The JPEG thumbnail of IFD1 (JPEGInterchangeFormat), as it is. Empty if there is none.
+
+	exif_info() : endianness(Endianness::Little), main_dir(), exif_dir(), gps_dir(), thumbnail() // Little-endian if there is no Exif block
+	{
+	}
 };
 
-exif_info ReadApp1Metadata(std::vector<std::shared_ptr<JpegApp1Segment>>& App1Segments);
+exif_info ReadApp1Metadata(const std::vector<std::shared_ptr<JpegApp1Segment>>& App1Segments);
 
 #endif
\ No newline at end of file
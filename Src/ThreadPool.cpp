@@ -0,0 +1,144 @@
+// File: ThreadPool.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "ThreadPool.h"
+#include "Exception.h"
+
+namespace vibo
+{
+	ThreadPool::ThreadPool(int num_threads) : m_queues(), m_threads(), m_mutex(), m_workAvailable(), m_allDone(), m_queued(0), m_pending(0), m_next(0), m_stop(false)
+	{
+		if (num_threads <= 0)
+		{
+			num_threads = static_cast<int>(std::thread::hardware_concurrency());
+			if (num_threads <= 0)
+			{
+				num_threads = 1;
+			}
+		}
+		for (int i = 0; i < num_threads; ++i)
+		{
+			m_queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue));
+		}
+		for (int i = 0; i < num_threads; ++i)
+		{
+			m_threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+		}
+	}
+
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_workAvailable.notify_all();
+		for (auto it = m_threads.begin(); it != m_threads.end(); ++it)
+		{
+			it->join();
+		}
+	}
+
+
+	int ThreadPool::Size() const
+	{
+		return static_cast<int>(m_threads.size());
+	}
+
+
+	void ThreadPool::Submit(Task task)
+	{
+		unsigned index = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			ASSERT(!m_stop);
+			++m_queued;
+			++m_pending;
+			index = m_next++ % m_queues.size();
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+			m_queues[index]->tasks.push_back(std::move(task));
+		}
+		m_workAvailable.notify_one();
+	}
+
+
+	void ThreadPool::Wait()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_allDone.wait(lock, [this]() { return m_pending == 0; });
+	}
+
+
+	bool ThreadPool::TryGetTask(int index, Task& task)
+	{
+		int n = static_cast<int>(m_queues.size());
+		for (int i = 0; i < n; ++i)
+		{
+			WorkQueue& Q = *m_queues[(index + i) % n];
+			std::lock_guard<std::mutex> lock(Q.mutex);
+			if (!Q.tasks.empty())
+			{
+				if (i == 0)
+				{
+					task = std::move(Q.tasks.back()); // Own queue
+					Q.tasks.pop_back();
+				}
+				else
+				{
+					task = std::move(Q.tasks.front()); // Steal the oldest task
+					Q.tasks.pop_front();
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+
+	void ThreadPool::WorkerLoop(int index)
+	{
+		for (;;)
+		{
+			Task task;
+			if (TryGetTask(index, task))
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					--m_queued;
+				}
+				try
+				{
+					task();
+				}
+				catch (...)
+				{
+					// Tasks report their own errors
+				}
+				bool done = false;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					done = (--m_pending == 0);
+				}
+				if (done)
+				{
+					m_allDone.notify_all();
+				}
+			}
+			else
+			{
+				// m_queued is counted before a task is pushed, so a task that is on its way keeps us from sleeping
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_workAvailable.wait(lock, [this]() { return m_stop || m_queued > 0; });
+				if (m_stop && m_queued == 0)
+				{
+					return;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,69 @@
+// File: ThreadPool.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef THREADPOOL_H_INCLUDED
+#define THREADPOOL_H_INCLUDED
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vibo
+{
+	// --------------------------------------------------------------------------------------------------------------------
+	//		ThreadPool -- fixed number of worker threads with work stealing
+	//
+	//		Every worker has its own queue. Submit() deals the tasks out round-robin; a worker takes tasks from the back of
+	//		its own queue, and when that is empty it steals from the front of the others. Conversions vary a lot in size,
+	//		so this keeps all the workers busy until the end of a batch.
+	//		Tasks must handle their own errors; an exception that escapes a task is discarded.
+	// --------------------------------------------------------------------------------------------------------------------
+
+	class ThreadPool
+	{
+	public:
+		typedef std::function<void()> Task;
+
+	private:
+		struct WorkQueue
+		{
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		std::vector<std::unique_ptr<WorkQueue>> m_queues;
+		std::vector<std::thread> m_threads;
+
+		std::mutex m_mutex;                       // Protects the members below
+		std::condition_variable m_workAvailable;
+		std::condition_variable m_allDone;
+		int m_queued;                             // Submitted, not yet taken by a worker
+		int m_pending;                            // Submitted, not yet finished
+		unsigned m_next;                          // Queue for the next Submit()
+		bool m_stop;
+
+	public:
+		explicit ThreadPool(int num_threads); // 0: one thread per hardware thread
+		~ThreadPool();                        // Finishes the submitted tasks
+
+		int Size() const;
+		void Submit(Task task);
+		void Wait(); // Returns when all submitted tasks have finished
+
+		ThreadPool() = delete;
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+	private:
+		void WorkerLoop(int index);
+		bool TryGetTask(int index, Task& task);
+	};
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include <iomanip>
 #include "Exception.h"
 #include "Util.h"
+#include "ByteOrder.h"
 
 
 // Local functions
@@ -20,13 +21,9 @@ std::wstring GetDatatypeRepresentation(int datatype, int datacount, Endianness e
 std::wstring GetByteDataRepresentation(const unsigned char* data, int dataType, int dataCount, Endianness e);
 
 
-TiffDirEntry::TiffDirEntry() : m_tagID(0), m_dataType(0), m_dataCount(0), m_storageLogic(StorageLogic::Invalid)
+TiffDirEntry::TiffDirEntry() : m_tagID(0), m_dataType(0), m_dataCount(0), m_dataBytes(), m_offset(0), m_storageLogic(StorageLogic::Invalid)
 {
 	m_endianness = Endianness::Little; // Whatever (will be overwritten)
-	m_dataBytes[0] = 0;
-	m_dataBytes[1] = 0;
-	m_dataBytes[2] = 0;
-	m_dataBytes[3] = 0;
 }
 
 TiffDirEntry::~TiffDirEntry()
@@ -39,12 +36,13 @@ TiffDirEntry::TiffDirEntry(const TiffDirEntry& rhs)
 	m_tagID(rhs.m_tagID),
 	m_dataType(rhs.m_dataType),
 	m_dataCount(rhs.m_dataCount),
+	m_offset(rhs.m_offset),
 	m_storageLogic(rhs.m_storageLogic)
 {
-	m_dataBytes[0] = rhs.m_dataBytes[0];
-	m_dataBytes[1] = rhs.m_dataBytes[1];
-	m_dataBytes[2] = rhs.m_dataBytes[2];
-	m_dataBytes[3] = rhs.m_dataBytes[3];
+	for (int i = 0; i < 8; ++i)
+	{
+		m_dataBytes[i] = rhs.m_dataBytes[i];
+	}
 }
 
 
@@ -54,19 +52,21 @@ TiffDirEntry& TiffDirEntry::operator=(const TiffDirEntry& rhs)
 	m_tagID = rhs.m_tagID;
 	m_dataType = rhs.m_dataType;
 	m_dataCount = rhs.m_dataCount;
-	m_dataBytes[0] = rhs.m_dataBytes[0];
-	m_dataBytes[1] = rhs.m_dataBytes[1];
-	m_dataBytes[2] = rhs.m_dataBytes[2];
-	m_dataBytes[3] = rhs.m_dataBytes[3];
+	for (int i = 0; i < 8; ++i)
+	{
+		m_dataBytes[i] = rhs.m_dataBytes[i];
+	}
+	m_offset = rhs.m_offset;
 	m_storageLogic = rhs.m_storageLogic;
 	return *this;
 }
 
 
-TiffDirEntry::TiffDirEntry(int tagid, int datatype, int datacount, const AsOffset& offset, Endianness e) : m_endianness(e), m_tagID(tagid), m_dataType(datatype), m_dataCount(datacount), m_storageLogic(StorageLogic::OffsetData)
+TiffDirEntry::TiffDirEntry(int tagid, int datatype, ULong_t datacount, const AsOffset& offset, Endianness e) : m_endianness(e), m_tagID(tagid), m_dataType(datatype), m_dataCount(datacount), m_dataBytes(), m_offset(0), m_storageLogic(StorageLogic::OffsetData)
 {
-	ASSERT(datacount*TiffDatatypeLength(datatype) >= 4); // Usually > 4. However, some tags hold a single offset to a large block of memory (for example stripByteCounts).
-	uint32_t value = offset.value();
+	ASSERT(GetDataSize() >= 4); // Usually > 4. However, some tags hold a single offset to a large block of memory (for example stripByteCounts).
+	m_offset = offset.value();
+	uint32_t value = static_cast<uint32_t>(m_offset); // The field of a classic TIFF file
 	unsigned char* bytePointer = reinterpret_cast<unsigned char*>(&value);
 
 	if (e == vibo::GetSystemEndianness())
@@ -86,7 +86,7 @@ TiffDirEntry::TiffDirEntry(int tagid, int datatype, int datacount, const AsOffse
 }
 
 
-TiffDirEntry::TiffDirEntry(int tagid, int datatype, int datacount, const uint32_t& longvalue, Endianness e) : m_endianness(e), m_tagID(tagid), m_dataType(datatype), m_dataCount(datacount), m_storageLogic(StorageLogic::LongData)
+TiffDirEntry::TiffDirEntry(int tagid, int datatype, ULong_t datacount, const uint32_t& longvalue, Endianness e) : m_endianness(e), m_tagID(tagid), m_dataType(datatype), m_dataCount(datacount), m_dataBytes(), m_offset(0), m_storageLogic(StorageLogic::LongData)
 {
 
 	if (!(TiffDatatypeLength(m_dataType) == 4 && m_dataCount == 1))
@@ -115,7 +115,7 @@ TiffDirEntry::TiffDirEntry(int tagid, int datatype, int datacount, const uint32_
 }
 
 
-TiffDirEntry::TiffDirEntry(int tagid, int datatype, int datacount, const AsShort& ts, Endianness e) : m_endianness(e), m_tagID(tagid), m_dataType(datatype), m_dataCount(datacount), m_storageLogic(StorageLogic::ShortData)
+TiffDirEntry::TiffDirEntry(int tagid, int datatype, ULong_t datacount, const AsShort& ts, Endianness e) : m_endianness(e), m_tagID(tagid), m_dataType(datatype), m_dataCount(datacount), m_dataBytes(), m_offset(0), m_storageLogic(StorageLogic::ShortData)
 {
 	ASSERT(TiffDatatypeLength(m_dataType) == 2 && (m_dataCount == 1 || m_dataCount == 2));
 
@@ -142,7 +142,7 @@ TiffDirEntry::TiffDirEntry(int tagid, int datatype, int datacount, const AsShort
 }
 
 
-TiffDirEntry::TiffDirEntry(int tagid, int datatype, int datacount, const AsByte& fb, Endianness e) : m_endianness(e), m_tagID(tagid), m_dataType(datatype), m_dataCount(datacount), m_storageLogic(StorageLogic::ByteData)
+TiffDirEntry::TiffDirEntry(int tagid, int datatype, ULong_t datacount, const AsByte& fb, Endianness e) : m_endianness(e), m_tagID(tagid), m_dataType(datatype), m_dataCount(datacount), m_dataBytes(), m_offset(0), m_storageLogic(StorageLogic::ByteData)
 {
 	m_dataBytes[0] = fb[0];
 	m_dataBytes[1] = fb[1];
@@ -151,24 +151,34 @@ TiffDirEntry::TiffDirEntry(int tagid, int datatype, int datacount, const AsByte&
 }
 
 
-uint32_t TiffDirEntry::GetOffsetField() const
+TiffDirEntry::TiffDirEntry(int tagid, int datatype, ULong_t datacount, const AsLong8& value, Endianness e) : m_endianness(e), m_tagID(tagid), m_dataType(datatype), m_dataCount(datacount), m_dataBytes(), m_offset(0), m_storageLogic(StorageLogic::Long8Data)
 {
-	if (m_storageLogic != StorageLogic::OffsetData)
+	ASSERT(TiffDatatypeLength(m_dataType) == 8 && m_dataCount == 1);
+	if (e == Endianness::Little)
 	{
-		ASSERT(false);
+		vibo::Store<Endianness::Little>(m_dataBytes, value.value());
 	}
-
-	ASSERT(m_storageLogic == StorageLogic::OffsetData);
-	if (m_endianness == Endianness::Little)
+	else
 	{
-		return 256 * 256 * 256 * m_dataBytes[3] + 256 * 256 * m_dataBytes[2] + 256 * m_dataBytes[1] + m_dataBytes[0];
+		vibo::Store<Endianness::Big>(m_dataBytes, value.value());
 	}
-	else if (m_endianness == Endianness::Big)
+}
+
+
+TiffDirEntry::TiffDirEntry(int tagid, int datatype, ULong_t datacount, const ByteVector& value) : m_endianness(Endianness::Little), m_tagID(tagid), m_dataType(datatype), m_dataCount(datacount), m_dataBytes(), m_offset(0), m_storageLogic(StorageLogic::InlineData)
+{
+	ASSERT(value.size() == GetDataSize() && value.size() <= 8);
+	for (int i = 0; i < vibo::size(value); ++i)
 	{
-		return 256 * 256 * 256 * m_dataBytes[0] + 256 * 256 * m_dataBytes[1] + 256 * m_dataBytes[2] + m_dataBytes[3];
+		m_dataBytes[i] = value[i];
 	}
-	ASSERT(false);
-	return 0; // never reached
+}
+
+
+Offset_t TiffDirEntry::GetOffsetField() const
+{
+	ASSERT(m_storageLogic == StorageLogic::OffsetData);
+	return m_offset; // Set from the field when read, and from the AsOffset when constructed
 }
 
 
@@ -239,17 +249,43 @@ AsByte TiffDirEntry::GetFourBytes() const
 
 void TiffDirEntry::InitializeFromMemory(const unsigned char* mem, Endianness e)
 {
-	m_endianness = e;
-	m_tagID = vibo::MakeUShort(mem, e);
-	m_dataType = vibo::MakeUShort(mem + 2, e);
-	m_dataCount = vibo::MakeULong(mem + 4, e);
-	m_dataBytes[0] = vibo::MakeUByte(mem + 8);
-	m_dataBytes[1] = vibo::MakeUByte(mem + 9);
-	m_dataBytes[2] = vibo::MakeUByte(mem + 10);
-	m_dataBytes[3] = vibo::MakeUByte(mem + 11);
+	if (e == Endianness::Little)
+	{
+		InitializeFromMemory<Endianness::Little>(mem);
+	}
+	else
+	{
+		InitializeFromMemory<Endianness::Big>(mem);
+	}
+}
+
+
+template<Endianness E> void TiffDirEntry::InitializeFromMemory(const unsigned char* mem)
+{
+	m_endianness = E;
+	m_tagID = vibo::Load<E, uint16_t>(mem);
+	m_dataType = vibo::Load<E, uint16_t>(mem + 2);
+	m_dataCount = vibo::Load<E, uint32_t>(mem + 4);
+	m_dataBytes[0] = mem[8];
+	m_dataBytes[1] = mem[9];
+	m_dataBytes[2] = mem[10];
+	m_dataBytes[3] = mem[11];
+	m_dataBytes[4] = 0;
+	m_dataBytes[5] = 0;
+	m_dataBytes[6] = 0;
+	m_dataBytes[7] = 0;
+	SetStorageLogic();
+	m_offset = (m_storageLogic == StorageLogic::OffsetData) ? vibo::Load<E, uint32_t>(mem + 8) : 0;
+}
 
+template void TiffDirEntry::InitializeFromMemory<Endianness::Little>(const unsigned char* mem);
+template void TiffDirEntry::InitializeFromMemory<Endianness::Big>(const unsigned char* mem);
+
+
+void TiffDirEntry::SetStorageLogic()
+{
 	int sizeof_datatype = TiffDatatypeLength(m_dataType);
-	int sizeof_data = sizeof_datatype * m_dataCount;
+	Offset_t sizeof_data = GetDataSize();
 	if (sizeof_data > 4)
 	{
 		m_storageLogic = StorageLogic::OffsetData;
@@ -289,15 +325,42 @@ void TiffDirEntry::InitializeFromMemory(const unsigned char* mem, Endianness e)
 }
 
 
-void TiffDirEntry::BuildMemoryRepresentation(unsigned char* mem, Endianness e)
+void TiffDirEntry::BuildMemoryRepresentation(unsigned char* mem, Endianness e, bool bigtiff)
 {
 	vibo::PutUShort(mem, m_tagID, e);
 	vibo::PutUShort(mem + 2, m_dataType, e);
-	vibo::PutUlong(mem + 4, m_dataCount, e);
-	mem[8] = m_dataBytes[0];
-	mem[9] = m_dataBytes[1];
-	mem[10] = m_dataBytes[2];
-	mem[11] = m_dataBytes[3];
+	if (!bigtiff)
+	{
+		ASSERT(m_storageLogic == StorageLogic::OffsetData ? m_offset <= 0xffffffffULL : GetDataSize() <= 4);
+		vibo::PutUlong(mem + 4, m_dataCount, e);
+		mem[8] = m_dataBytes[0];
+		mem[9] = m_dataBytes[1];
+		mem[10] = m_dataBytes[2];
+		mem[11] = m_dataBytes[3];
+	}
+	else
+	{
+		// An offset is 8 bytes; so is the count. Data of 8 bytes or less is in the entry.
+		ASSERT(m_storageLogic == StorageLogic::OffsetData ? GetDataSize() > 8 || (GetDataSize() == 8 && m_dataCount == 1) : GetDataSize() <= 8);
+		vibo::PutULongLong(mem + 4, m_dataCount, e);
+		if (m_storageLogic == StorageLogic::OffsetData)
+		{
+			vibo::PutULongLong(mem + 12, m_offset, e);
+		}
+		else
+		{
+			for (int i = 0; i < 8; ++i)
+			{
+				mem[12 + i] = m_dataBytes[i];
+			}
+		}
+	}
+}
+
+
+int TiffDirEntry::BinarySize(bool bigtiff)
+{
+	return bigtiff ? 20 : 12;
 }
 
 
@@ -317,9 +380,9 @@ int TiffDirEntry::Tag() const
 }
 
 
-ULong_t TiffDirEntry::GetDataSize() const
+Offset_t TiffDirEntry::GetDataSize() const
 {
-	return m_dataCount * TiffDatatypeLength(m_dataType);
+	return vibo::CheckedMultiply(m_dataCount, TiffDatatypeLength(m_dataType));
 }
 
 
@@ -329,7 +392,7 @@ int TiffDirEntry::GetDataType() const
 }
 
 
-int TiffDirEntry::GetDataCount() const
+ULong_t TiffDirEntry::GetDataCount() const
 {
 	return m_dataCount;
 }
@@ -359,6 +422,9 @@ std::wstring TiffDataTypeString(int typ)
 	case 11: return L"Float";
 	case 12: return L"Double";
 	case 13: return L"IDF";
+	case 16: return L"Long8";
+	case 17: return L"SLong8";
+	case 18: return L"IFD8";
 	}
 	ASSERT(false);
 	static const std::wstring Q(L"?");
@@ -382,6 +448,10 @@ UShort_t TiffDatatypeLength(int typ)
 	case 10: return 8; // L"SRational";
 	case 11: return 4; // L"Float";
 	case 12: return 8; // L"Double";
+	case 13: return 4; // L"IFD";
+	case 16: return 8; // L"Long8";
+	case 17: return 8; // L"SLong8";
+	case 18: return 8; // L"IFD8";
 	}
 	ASSERT(false);
 	return 0;
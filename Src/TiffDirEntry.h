@@ -24,6 +24,10 @@
 //		If the DataType occupes two bytes and the DataCount is 1, the first and second byte may need to be switched.
 //		If the DataType occupes two bytes and the DataCount is 2, the first and second, and the third and fourth byte, may need to be switched.
 //		If the Datatype occupies four bytes, the first and fourth, and the second and third byte may need to be switched.
+//
+//		In a BigTIFF file the DataCount is eight bytes and the Offset_or_Value field is eight bytes, so values up to eight bytes are stored in the
+//		entry. The field is kept as eight bytes, left-justified; only the first four are used in a classic TIFF file. An offset is kept as a number,
+//		as its size in the file depends on the format.
 //	_________________________________________________________________________________________________________________________________________________
 //
 //		To enforce consistency, helper classes representing the various StorageLogics have been written. Separate constructors have been written
@@ -33,7 +37,7 @@
 
 enum class StorageLogic
 {
-	ByteData, ShortData, LongData, OffsetData, Invalid
+	ByteData, ShortData, LongData, Long8Data, InlineData, OffsetData, Invalid
 };
 
 
@@ -104,13 +108,13 @@ public:
 
 class AsOffset
 {
-	uint32_t m_value;
+	unsigned long long m_value;
 public:
-	AsOffset(Offset_t v)
+	AsOffset(unsigned long long v)
 	{
 		m_value = v;
 	}
-	uint32_t value() const
+	unsigned long long value() const
 	{
 		return m_value;
 	}
@@ -120,6 +124,24 @@ public:
 };
 
 
+class AsLong8 // A single 8-byte value. BigTIFF only.
+{
+	uint64_t m_value;
+public:
+	AsLong8(unsigned long long v)
+	{
+		m_value = v;
+	}
+	uint64_t value() const
+	{
+		return m_value;
+	}
+	AsLong8(const AsLong8&) = default;
+	AsLong8& operator=(const AsLong8&) = default;
+	~AsLong8() = default;
+};
+
+
 //	_________________________________________________________________________________________________________________________________________________
 //
 //		class TiffDirEntry
@@ -131,31 +153,38 @@ class TiffDirEntry
 	int m_tagID; //Short_t
 	int m_dataType; // Short_t
 	ULong_t m_dataCount; // ULong_t
-	unsigned char m_dataBytes[4]; // Used when interpreting the value (e.g. a vector of 2 shorts where m_Offset_or_Data holds the value)
-	StorageLogic m_storageLogic; // AsByte, AsShort, AsLong, AsOffset, Invalid
+	unsigned char m_dataBytes[8]; // Used when interpreting the value (e.g. a vector of 2 shorts where m_Offset_or_Data holds the value)
+	unsigned long long m_offset; // StorageLogic::OffsetData
+	StorageLogic m_storageLogic; // AsByte, AsShort, AsLong, AsLong8, inline bytes, AsOffset, Invalid
+
+	void SetStorageLogic();
 
 public:
 	TiffDirEntry();
-	TiffDirEntry(int tagid, int datatype, int datacount, const uint32_t& longvalue, Endianness e);
-	TiffDirEntry(int tagid, int datatype, int datacount, const AsOffset& offset, Endianness e);
-	TiffDirEntry(int tagid, int datatype, int datacount, const AsShort& ts, Endianness e);
-	TiffDirEntry(int tagid, int datatype, int datacount, const AsByte& fb, Endianness e);
+	TiffDirEntry(int tagid, int datatype, ULong_t datacount, const uint32_t& longvalue, Endianness e);
+	TiffDirEntry(int tagid, int datatype, ULong_t datacount, const AsOffset& offset, Endianness e);
+	TiffDirEntry(int tagid, int datatype, ULong_t datacount, const AsShort& ts, Endianness e);
+	TiffDirEntry(int tagid, int datatype, ULong_t datacount, const AsByte& fb, Endianness e);
+	TiffDirEntry(int tagid, int datatype, ULong_t datacount, const AsLong8& value, Endianness e);
+	TiffDirEntry(int tagid, int datatype, ULong_t datacount, const ByteVector& value); // The value in the byte order of the file. More than four bytes only in BigTIFF.
 	~TiffDirEntry();
 	TiffDirEntry(const TiffDirEntry&);
 	TiffDirEntry& operator=(const TiffDirEntry&);
 	void InitializeFromMemory(const unsigned char* mem, Endianness e);
-	void BuildMemoryRepresentation(unsigned char* mem, Endianness e);
+	template<Endianness E> void InitializeFromMemory(const unsigned char* mem); // For loops over a directory: E is fixed for all its entries
+	void BuildMemoryRepresentation(unsigned char* mem, Endianness e, bool bigtiff = false);
 	std::wstring StringRepresentation(Endianness e) const;
 
 	int Tag() const;
-	ULong_t GetDataSize() const;
+	Offset_t GetDataSize() const; // Count times element size; throws if it does not fit
 	int GetDataType() const;
-	int GetDataCount() const;
+	ULong_t GetDataCount() const;
 	int GetElementSize() const;
+	static int BinarySize(bool bigtiff); // 12 bytes, 20 in BigTIFF
 
 	// __________________ Access methods _____________________
 	
-	uint32_t GetOffsetField() const;
+	Offset_t GetOffsetField() const;
 	uint32_t GetLongValue() const;
 	AsShort GetTwoShorts() const;
 	AsByte GetFourBytes() const;
@@ -182,7 +211,10 @@ enum Datatype
 	SRational = 10,
 	Float = 11,
 	Double = 12,
-	IFD = 13
+	IFD = 13,
+	Long8 = 16, // BigTIFF
+	SLong8 = 17,
+	IFD8 = 18
 };
 
 //	_________________________________________________________________________________________________________________________________________________
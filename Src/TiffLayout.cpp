@@ -0,0 +1,125 @@
+// File: TiffLayout.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "TiffLayout.h"
+#include "CreateSegment.h"
+#include "Exception.h"
+
+namespace // anonymous
+{
+	const unsigned long long MaxTiffFileSize = 0xffffffffULL; // Offsets are 32 bits
+}
+
+
+TiffLayout::TiffLayout(Endianness e, bool bigtiff, unsigned long long start) : m_items(), m_endianness(e), m_bigTiff(bigtiff), m_start(start), m_fileSize(0), m_planned(false)
+{
+	ASSERT(start % 2 == 0);
+}
+
+
+bool TiffLayout::IsBigTiff() const
+{
+	return m_bigTiff;
+}
+
+
+TiffLayout::Slot TiffLayout::Add(const std::shared_ptr<FileSegment>& S, bool padded)
+{
+	ASSERT(!m_planned);
+	ASSERT(S != nullptr);
+	Item item{ S, S->GetSize(), padded, 0 };
+	m_items.push_back(item);
+	return vibo::size(m_items) - 1;
+}
+
+
+TiffLayout::Slot TiffLayout::Reserve(unsigned long long size, bool padded)
+{
+	ASSERT(!m_planned);
+	Item item{ nullptr, size, padded, 0 };
+	m_items.push_back(item);
+	return vibo::size(m_items) - 1;
+}
+
+
+void TiffLayout::Plan()
+{
+	unsigned long long offset = m_start;
+	for (auto it = m_items.begin(); it != m_items.end(); ++it)
+	{
+		it->offset = offset;
+		offset += it->size;
+		if (it->padded)
+		{
+			offset += offset % 2; // Segments start on two-byte boundaries
+		}
+	}
+	if (!m_bigTiff && offset > MaxTiffFileSize)
+	{
+		THROW(L"The output file would be larger than 4 GB, which is more than TIFF can address!");
+	}
+	m_fileSize = offset;
+	m_planned = true;
+}
+
+
+Offset_t TiffLayout::GetOffset(Slot s) const
+{
+	ASSERT(m_planned);
+	ASSERT(s >= 0 && s < vibo::size(m_items));
+	return m_items[s].offset;
+}
+
+
+Offset_t TiffLayout::GetNextOffset(Slot s) const
+{
+	ASSERT(m_planned);
+	ASSERT(s >= 0 && s < vibo::size(m_items));
+	if (s + 1 < vibo::size(m_items))
+	{
+		return m_items[s + 1].offset;
+	}
+	return m_fileSize;
+}
+
+
+unsigned long long TiffLayout::GetFileSize() const
+{
+	ASSERT(m_planned);
+	return m_fileSize;
+}
+
+
+void TiffLayout::Fill(Slot s, const std::shared_ptr<FileSegment>& S)
+{
+	ASSERT(m_planned);
+	ASSERT(s >= 0 && s < vibo::size(m_items));
+	ASSERT(m_items[s].segment == nullptr);
+	ASSERT(S->GetSize() == m_items[s].size);
+	m_items[s].segment = S;
+}
+
+
+GraphicsVector TiffLayout::Materialize() const
+{
+	ASSERT(m_planned);
+	GraphicsVector G;
+	G.reserve(2 * m_items.size()); // Room for the padding
+	for (auto it = m_items.begin(); it != m_items.end(); ++it)
+	{
+		if (it->segment == nullptr)
+		{
+			THROW(L"TiffLayout::Materialize: A reserved segment was never filled!");
+		}
+		it->segment->SetOffset(it->offset);
+		G.push_back(it->segment);
+		unsigned long long end = it->offset + it->size;
+		if (it->padded && end % 2 != 0)
+		{
+			G.push_back(CreateSegment(Segmenttype::Padding, m_endianness, end, 1));
+		}
+	}
+	return G;
+}
@@ -0,0 +1,68 @@
+// File: TiffLayout.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef TIFFLAYOUT_H_INCLUDED
+#define TIFFLAYOUT_H_INCLUDED
+
+#include "GraphicsFile.h"
+#include <memory>
+#include <vector>
+
+// --------------------------------------------------------------------------------------------------------------------
+//		TiffLayout -- plans an output file before its bytes are produced
+//
+//		1. Add() the segments whose data is ready, and Reserve() space for those that can only be built when the offsets
+//		   are known (header, directories). Only the sizes are used.
+//		2. Plan() assigns every offset and the padding, and gives the exact size of the file.
+//		3. Fill() the reserved slots, and Materialize() the GraphicsVector that is written.
+//
+//		The segments start at offset 0, or at start for a page that follows others in a multi-page file.
+// --------------------------------------------------------------------------------------------------------------------
+
+class TiffLayout
+{
+public:
+	typedef int Slot;
+
+private:
+	struct Item
+	{
+		std::shared_ptr<FileSegment> segment; // nullptr until a reserved slot is filled
+		unsigned long long size;
+		bool padded;
+		unsigned long long offset;
+	};
+
+	std::vector<Item> m_items;
+	Endianness m_endianness; // For the padding segments
+	bool m_bigTiff;
+	unsigned long long m_start;
+	unsigned long long m_fileSize;
+	bool m_planned;
+
+public:
+	explicit TiffLayout(Endianness e, bool bigtiff = false, unsigned long long start = 0); // start: even
+	bool IsBigTiff() const; // 8-byte offsets; the values of up to 8 bytes are in the directory entries
+
+	// Phase 1
+	Slot Add(const std::shared_ptr<FileSegment>& S, bool padded = true);
+	Slot Reserve(unsigned long long size, bool padded = true);
+
+	// Phase 2. Throws if the file would be too large for TIFF's 32-bit offsets (not for BigTIFF).
+	void Plan();
+	Offset_t GetOffset(Slot s) const;
+	Offset_t GetNextOffset(Slot s) const; // Offset of what follows the slot, i.e. after its padding
+	unsigned long long GetFileSize() const; // Up to the end of the last segment, from the start of the file
+
+	// Phase 3
+	void Fill(Slot s, const std::shared_ptr<FileSegment>& S);
+	GraphicsVector Materialize() const;
+
+	TiffLayout() = delete;
+	TiffLayout(const TiffLayout&) = delete;
+	TiffLayout& operator=(const TiffLayout&) = delete;
+};
+
+#endif
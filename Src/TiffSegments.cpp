@@ -13,13 +13,13 @@
 #include "CreateSegment.h"
 
 
-std::shared_ptr<FileSegment> ReadTiffSegmentGeneric(FILE* f, Segmenttype seg, Endianness e, int offset, int datasize);
+std::shared_ptr<FileSegment> ReadTiffSegmentGeneric(vibo::File& f, Segmenttype seg, Endianness e, Offset_t offset, Offset_t datasize);
 
 // --------------------------------------------------------------------------------------------------------------------
 //		class TiffSegment
 // --------------------------------------------------------------------------------------------------------------------
 
-TiffSegment::TiffSegment(int offset, int size, Endianness e) : FileSegment(offset, size), m_Endianness(e)
+TiffSegment::TiffSegment(Offset_t offset, Offset_t size, Endianness e) : FileSegment(offset, size), m_Endianness(e)
 {
 }
 
@@ -34,7 +34,7 @@ Endianness TiffSegment::FileEndianness() const
 //		class TiffHeader
 // --------------------------------------------------------------------------------------------------------------------
 
-TiffHeader::TiffHeader(int offset, int size, Endianness e) : TiffSegment(offset, size, e), m_directoryOffset(0)
+TiffHeader::TiffHeader(Offset_t offset, Offset_t size, Endianness e) : TiffSegment(offset, size, e), m_directoryOffset(0), m_bigTiff(false)
 {
 	if (e == Endianness::Little)
 	{
@@ -51,12 +51,18 @@ TiffHeader::TiffHeader(int offset, int size, Endianness e) : TiffSegment(offset,
 }
 
 
-void TiffHeader::SetDirectoryOffset(int offset)
+void TiffHeader::SetDirectoryOffset(unsigned long long offset)
 {
 	m_directoryOffset = offset;
 }
 
 
+void TiffHeader::SetBigTiff(bool bigtiff)
+{
+	m_bigTiff = bigtiff;
+}
+
+
 Offset_t TiffHeader::GetDirectoryOffset() const
 {
 	return m_directoryOffset;
@@ -65,44 +71,42 @@ Offset_t TiffHeader::GetDirectoryOffset() const
 
 void TiffHeader::RebuildBinaryData()
 {
-	int32_t dirOffset = m_directoryOffset;
-	unsigned char* bytes = reinterpret_cast<unsigned char*>(&dirOffset);
-
 	if (m_Endianness == Endianness::Little)
 	{
-		m_data = ByteVector{ 0x49, 0x49, 0x2a, 0x00 };
+		m_data = ByteVector{ 0x49, 0x49 };
 	}
 	else if (m_Endianness == Endianness::Big)
 	{
-		m_data = ByteVector{ 0x4d, 0x4d, 0x00, 0x2a };
+		m_data = ByteVector{ 0x4d, 0x4d };
 	}
 	else
 	{
 		ASSERT(false);
 	}
-	if (m_Endianness == vibo::GetSystemEndianness())
+	if (!m_bigTiff)
 	{
-		// Keep endianness
-		m_data.push_back(bytes[0]);
-		m_data.push_back(bytes[1]);
-		m_data.push_back(bytes[2]);
-		m_data.push_back(bytes[3]);
+		ASSERT(m_directoryOffset <= 0xffffffffULL);
+		m_data.resize(8);
+		vibo::PutUShort(&m_data[2], 42, m_Endianness);
+		vibo::PutUlong(&m_data[4], static_cast<uint32_t>(m_directoryOffset), m_Endianness);
 	}
 	else
 	{
-		// Switch endianness
-		m_data.push_back(bytes[3]);
-		m_data.push_back(bytes[2]);
-		m_data.push_back(bytes[1]);
-		m_data.push_back(bytes[0]);
+		m_data.resize(16);
+		vibo::PutUShort(&m_data[2], 43, m_Endianness);
+		vibo::PutUShort(&m_data[4], 8, m_Endianness); // Bytesize of offsets
+		vibo::PutUShort(&m_data[6], 0, m_Endianness);
+		vibo::PutULongLong(&m_data[8], m_directoryOffset, m_Endianness);
 	}
+	m_size = vibo::size(m_data);
 }
 
 
 void TiffHeader::InterpretData()
 {
-	ASSERT(vibo::size(m_data) == 8);
-	m_directoryOffset = vibo::MakeULong(&m_data[4], FileEndianness());
+	vibo::ByteSpan D = Data();
+	ASSERT(vibo::size(D) == 8);
+	m_directoryOffset = vibo::MakeULong(&D[4], FileEndianness());
 }
 
 
@@ -119,7 +123,7 @@ std::vector<std::wstring> TiffHeader::StringRepresentation() const
 //		class TiffDirectory
 // --------------------------------------------------------------------------------------------------------------------
 
-TiffDirectory::TiffDirectory(int offset, int size, Endianness e) : TiffSegment(offset, size, e), m_entries(), m_nextDirectoryOffset(0)
+TiffDirectory::TiffDirectory(Offset_t offset, Offset_t size, Endianness e) : TiffSegment(offset, size, e), m_entries(), m_nextDirectoryOffset(0), m_bigTiff(false)
 {
 }
 
@@ -159,31 +163,61 @@ int TiffDirectory::GetCompression()
 
 void TiffDirectory::InterpretData()
 {
-	int num_entries = vibo::MakeUShort(&m_data[0], FileEndianness());
-	ASSERT(vibo::size(m_data) == 12 * num_entries + 6);
+	vibo::ByteSpan D = Data();
+	int num_entries = vibo::MakeUShort(&D[0], FileEndianness());
+	ASSERT(vibo::size(D) == 12 * num_entries + 6);
+
+	// The byte order is tested once per directory, not once per field
+	if (FileEndianness() == Endianness::Little)
+	{
+		InterpretEntries<Endianness::Little>(&D[0], num_entries);
+	}
+	else
+	{
+		InterpretEntries<Endianness::Big>(&D[0], num_entries);
+	}
+}
 
+
+template<Endianness E> void TiffDirectory::InterpretEntries(const unsigned char* data, int num_entries)
+{
+	m_entries.reserve(m_entries.size() + num_entries);
 	for (int i = 0; i < num_entries; ++i)
 	{
 		TiffDirEntry e;
-		e.InitializeFromMemory(&m_data[2 + 12 * i], FileEndianness());
+		e.InitializeFromMemory<E>(data + 2 + 12 * i);
 		AddEntry(e);
 	}
-	m_nextDirectoryOffset = vibo::MakeULong(&m_data[2 + 12 * num_entries], FileEndianness());
+	m_nextDirectoryOffset = vibo::Load<E, uint32_t>(data + 2 + 12 * num_entries);
 }
 
 
 void TiffDirectory::RebuildBinaryData()
 {
 	int num_entries = vibo::size(m_entries);
-	m_size = 6 + 12 * num_entries;
+	m_size = BinarySize(num_entries, m_bigTiff);
 	m_data.resize(m_size);
 	unsigned char* mem = &m_data[0];
-	vibo::PutUShort(mem, num_entries, FileEndianness());
-	for (int i = 0; i < num_entries; ++i)
+	int entry_size = TiffDirEntry::BinarySize(m_bigTiff);
+	if (!m_bigTiff)
+	{
+		ASSERT(m_nextDirectoryOffset <= 0xffffffffULL);
+		vibo::PutUShort(mem, num_entries, FileEndianness());
+		for (int i = 0; i < num_entries; ++i)
+		{
+			m_entries[i].BuildMemoryRepresentation(mem + 2 + entry_size * i, FileEndianness());
+		}
+		vibo::PutUlong(mem + 2 + entry_size * num_entries, static_cast<uint32_t>(m_nextDirectoryOffset), FileEndianness());
+	}
+	else
 	{
-		m_entries[i].BuildMemoryRepresentation(mem + 2 + 12 * i, FileEndianness());
+		vibo::PutULongLong(mem, num_entries, FileEndianness());
+		for (int i = 0; i < num_entries; ++i)
+		{
+			m_entries[i].BuildMemoryRepresentation(mem + 8 + entry_size * i, FileEndianness(), true);
+		}
+		vibo::PutULongLong(mem + 8 + entry_size * num_entries, m_nextDirectoryOffset, FileEndianness());
 	}
-	vibo::PutUlong(mem + 2 + 12 * num_entries, m_nextDirectoryOffset, FileEndianness());
 }
 
 
@@ -195,14 +229,14 @@ void TiffDirectory::RebuildBinaryData()
 //
 // --------------------------------------------------------------------------------------------------------------------
 
-void TiffDirectory::ReadExternalData(FILE* f, GraphicsVector& G)
+void TiffDirectory::ReadExternalData(vibo::File& f, GraphicsVector& G)
 {
-	Offset_t filepos = ftell(f);
-	std::vector<uint32_t> stripOffsets;
-	std::vector<uint32_t> stripByteCounts;
-	std::vector<uint32_t> tileOffsets;
-	std::vector<uint32_t> tileByteCounts;
-	std::vector<uint32_t> bitsPerSample;
+	Offset_t filepos = vibo::Tell(f);
+	std::vector<Offset_t> stripOffsets;
+	std::vector<Offset_t> stripByteCounts;
+	std::vector<Offset_t> tileOffsets;
+	std::vector<Offset_t> tileByteCounts;
+	std::vector<Offset_t> bitsPerSample;
 
 	int compression = 0;
 	for (auto p = m_entries.begin(); p != m_entries.end(); ++p)
@@ -215,10 +249,9 @@ void TiffDirectory::ReadExternalData(FILE* f, GraphicsVector& G)
 			if (p->GetDataSize() > 4)
 			{
 				std::shared_ptr<FileSegment> S = ReadTiffSegmentGeneric(f, Segmenttype::TiffUShortVector, FileEndianness(), p->GetOffsetField(), p->GetDataSize());
-				Offset_t filepos = ftell(f);
+				Offset_t filepos = vibo::Tell(f);
 				S->ReadData(f);
-				int chk = fseek(f, filepos, SEEK_SET);
-				ASSERT(chk == 0);
+				vibo::Seek(f, filepos);
 				S->SetLabel(TiffTagName(TiffTag::BitsPerSample));
 
 				AddSegmentNopad(G, S);
@@ -284,18 +317,18 @@ void TiffDirectory::ReadExternalData(FILE* f, GraphicsVector& G)
 	}
 	else if (vibo::size(tileOffsets) >= 1 && vibo::size(tileByteCounts) >= 1)
 	{
-		int siz = vibo::size(tileOffsets);
-		ASSERT(siz == vibo::size(tileByteCounts));
-		for (int i = 0; i < siz; ++i)
+		size_t siz = tileOffsets.size();
+		ASSERT(siz == tileByteCounts.size());
+		for (size_t i = 0; i < siz; ++i)
 		{
 			ReadTiffOtherData(f, G, Segmenttype::TiffImageData, FileEndianness(), tileOffsets[i], tileByteCounts[i]);
 		}
 	}
 	else if (vibo::size(stripOffsets) >= 1 && vibo::size(stripByteCounts) >= 1)
 	{
-		int siz = vibo::size(stripOffsets);
-		ASSERT(siz == vibo::size(stripByteCounts));
-		for (int i = 0; i < siz; ++i)
+		size_t siz = stripOffsets.size();
+		ASSERT(siz == stripByteCounts.size());
+		for (size_t i = 0; i < siz; ++i)
 		{
 			ReadTiffOtherData(f, G, Segmenttype::TiffImageData, FileEndianness(), stripOffsets[i], stripByteCounts[i]);
 		}
@@ -303,12 +336,18 @@ void TiffDirectory::ReadExternalData(FILE* f, GraphicsVector& G)
 }
 
 
-void TiffDirectory::SetNextDirectoryOffset(int offset)
+void TiffDirectory::SetNextDirectoryOffset(unsigned long long offset)
 {
 	m_nextDirectoryOffset = offset;
 }
 
 
+void TiffDirectory::SetBigTiff(bool bigtiff)
+{
+	m_bigTiff = bigtiff;
+}
+
+
 Offset_t TiffDirectory::GetNextDirectoryOffset() const
 {
 	return m_nextDirectoryOffset;
@@ -327,11 +366,21 @@ void TiffDirectory::SortEntries()
 }
 
 
+ULong_t TiffDirectory::BinarySize(int num_entries, bool bigtiff)
+{
+	if (bigtiff)
+	{
+		return 16 + 20 * num_entries;
+	}
+	return 6 + 12 * num_entries; // Entry count, entries, next directory offset
+}
+
+
 // --------------------------------------------------------------------------------------------------------------------
 //		Class TiffByteVector
 // --------------------------------------------------------------------------------------------------------------------
 
-TiffByteVector::TiffByteVector(int offset, int size, Endianness e) : TiffNumericVectorT<unsigned char, Datatype::Ubyte>(offset, size, e)
+TiffByteVector::TiffByteVector(Offset_t offset, Offset_t size, Endianness e) : TiffNumericVectorT<unsigned char, Datatype::Ubyte>(offset, size, e)
 {
 }
 
@@ -353,7 +402,7 @@ void TiffByteVector::RebuildBinaryData()
 //		Class TiffUShortVector
 // --------------------------------------------------------------------------------------------------------------------
 
-TiffUShortVector::TiffUShortVector(int offset, int size, Endianness e) : TiffNumericVectorT<uint16_t, Datatype::Ushort>(offset, size, e)
+TiffUShortVector::TiffUShortVector(Offset_t offset, Offset_t size, Endianness e) : TiffNumericVectorT<uint16_t, Datatype::Ushort>(offset, size, e)
 {
 }
 
@@ -362,7 +411,7 @@ TiffUShortVector::TiffUShortVector(int offset, int size, Endianness e) : TiffNum
 //		Class TiffOffsetTable
 // --------------------------------------------------------------------------------------------------------------------
 
-TiffOffsetTable::TiffOffsetTable(int offset, int size, Endianness e) : TiffNumericVectorT<uint32_t, Datatype::Ulong>(offset, size, e)
+TiffOffsetTable::TiffOffsetTable(Offset_t offset, Offset_t size, Endianness e) : TiffNumericVectorT<uint32_t, Datatype::Ulong>(offset, size, e)
 {
 }
 
@@ -371,7 +420,7 @@ TiffOffsetTable::TiffOffsetTable(int offset, int size, Endianness e) : TiffNumer
 //		Class TiffBytecountTable
 // --------------------------------------------------------------------------------------------------------------------
 
-TiffBytecountTable::TiffBytecountTable(int offset, int size, Endianness e) : TiffNumericVectorT<uint32_t, Datatype::Ulong>(offset, size, e)
+TiffBytecountTable::TiffBytecountTable(Offset_t offset, Offset_t size, Endianness e) : TiffNumericVectorT<uint32_t, Datatype::Ulong>(offset, size, e)
 {
 }
 
@@ -380,7 +429,7 @@ TiffBytecountTable::TiffBytecountTable(int offset, int size, Endianness e) : Tif
 //		Class TiffImageData
 // --------------------------------------------------------------------------------------------------------------------
 
-TiffImageData::TiffImageData(int offset, int size, Endianness e) : TiffSegment(offset, size, e)
+TiffImageData::TiffImageData(Offset_t offset, Offset_t size, Endianness e) : TiffSegment(offset, size, e)
 {
 }
 
@@ -392,10 +441,9 @@ TiffImageData::TiffImageData(int offset, int size, Endianness e) : TiffSegment(o
 //		filepos on exit:  offset + sizeof(header) // sizeof(header) == 8
 // --------------------------------------------------------------------------------------------------------------------
 
-Offset_t ReadTiffHeader(FILE* f, Filetype ft, GraphicsVector& G, Offset_t offset)
+Offset_t ReadTiffHeader(vibo::File& f, Filetype ft, GraphicsVector& G, Offset_t offset)
 {
-	int chk = fseek(f, offset, SEEK_SET);
-	ASSERT(chk == 0);
+	vibo::Seek(f, offset);
 
 	std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffHeader, GetEndianness(ft), 0, 8);
 	std::shared_ptr<TiffHeader> P = std::dynamic_pointer_cast<TiffHeader>(S);
@@ -414,25 +462,23 @@ Offset_t ReadTiffHeader(FILE* f, Filetype ft, GraphicsVector& G, Offset_t offset
 //		filepos on exit:  just past the end of the last directory in the linked list of directories
 // --------------------------------------------------------------------------------------------------------------------
 
-void ReadTiffDirectories(FILE* f, Filetype ft, GraphicsVector& G, Offset_t offset)
+void ReadTiffDirectories(vibo::File& f, Filetype ft, GraphicsVector& G, Offset_t offset)
 {
 	Offset_t filepos = offset;
 
 	while (filepos > 0)
 	{
-		int check = fseek(f, filepos, SEEK_SET);
-		ASSERT(check == 0);
+		vibo::Seek(f, filepos);
 
 		int num_entries = vibo::GetUShort(f, GetEndianness(ft));
-		int siz = 12 * num_entries + 6; // 2: num entries, 4: next
+		Offset_t siz = 12 * static_cast<Offset_t>(num_entries) + 6; // 2: num entries, 4: next
 
 		std::shared_ptr<FileSegment> S = CreateSegment(Segmenttype::TiffDirectory, GetEndianness(ft), filepos, siz);
 		std::shared_ptr<TiffDirectory> P = std::dynamic_pointer_cast<TiffDirectory>(S);
 		ASSERT(P != nullptr);
 
 		// Read data as binary chunk
-		check = fseek(f, filepos, SEEK_SET);
-		ASSERT(check == 0);
+		vibo::Seek(f, filepos);
 		P->ReadData(f);
 		filepos = P->GetNextDirectoryOffset();
 
@@ -448,7 +494,7 @@ void ReadTiffDirectories(FILE* f, Filetype ft, GraphicsVector& G, Offset_t offse
 //		filepos on exit:  same as on entry
 // --------------------------------------------------------------------------------------------------------------------
 
-void ReadTiffOtherData(FILE* f, GraphicsVector& G, Segmenttype seg, Endianness e, int offset, int datasize)
+void ReadTiffOtherData(vibo::File& f, GraphicsVector& G, Segmenttype seg, Endianness e, Offset_t offset, Offset_t datasize)
 {
 	std::shared_ptr<FileSegment> S = ReadTiffSegmentGeneric(f, seg, e, offset, datasize);
 	AddSegmentNopad(G, S); 
@@ -462,18 +508,16 @@ void ReadTiffOtherData(FILE* f, GraphicsVector& G, Segmenttype seg, Endianness e
 //		filepos on exit:  same as on entry
 // --------------------------------------------------------------------------------------------------------------------
 
-std::shared_ptr<FileSegment> ReadTiffSegmentGeneric(FILE* f, Segmenttype seg, Endianness e, int offset, int datasize)
+std::shared_ptr<FileSegment> ReadTiffSegmentGeneric(vibo::File& f, Segmenttype seg, Endianness e, Offset_t offset, Offset_t datasize)
 {
-	int filepos_bk = ftell(f);
+	Offset_t filepos_bk = vibo::Tell(f);
 
-	int chk = fseek(f, offset, SEEK_SET);
-	ASSERT(chk == 0);
+	vibo::Seek(f, offset);
 
 	std::shared_ptr<FileSegment> S = CreateSegment(seg, e, offset, datasize);
 	S->ReadData(f);
 
-	chk = fseek(f, filepos_bk, SEEK_SET);
-	ASSERT(chk == 0);
+	vibo::Seek(f, filepos_bk);
 	return S;
 }
 
@@ -485,12 +529,12 @@ std::shared_ptr<FileSegment> ReadTiffSegmentGeneric(FILE* f, Segmenttype seg, En
 //		filepos on exit:  same as on entry
 // --------------------------------------------------------------------------------------------------------------------
 
-std::vector<uint32_t> ReadTiffNumericVector(FILE* f, Endianness e, const TiffDirEntry& E)
+std::vector<Offset_t> ReadTiffNumericVector(vibo::File& f, Endianness e, const TiffDirEntry& E)
 {
-	Offset_t filepos_bk = ftell(f);
-	std::vector<uint32_t> vec;
+	Offset_t filepos_bk = vibo::Tell(f);
+	std::vector<Offset_t> vec;
 	int sizeof_datatype = TiffDatatypeLength(E.GetDataType());
-	int datacount = E.GetDataCount();
+	ULong_t datacount = E.GetDataCount();
 	if (datacount == 1)
 	{
 		switch (sizeof_datatype)
@@ -529,33 +573,36 @@ std::vector<uint32_t> ReadTiffNumericVector(FILE* f, Endianness e, const TiffDir
 	else if (sizeof_datatype == 1 && datacount <= 4)
 	{
 		AsByte fb = E.GetFourBytes();
-		for (int i = 0; i < datacount; ++i)
+		for (ULong_t i = 0; i < datacount; ++i)
 		{
 			vec.push_back(fb[i]);
 		}
 	}
-	else if (sizeof_datatype*datacount > 4)
+	else if (E.GetDataSize() > 4)
 	{
-		vec.resize(datacount);
-		int check = fseek(f, E.GetOffsetField(), SEEK_SET);
-		ASSERT(check == 0);
+		if (vibo::CheckedAdd(E.GetOffsetField(), E.GetDataSize()) > f.Size())
+		{
+			THROW(L"TIFF directory entry points past the end of the file!");
+		}
+		vec.resize(vibo::CheckedSize(datacount));
+		vibo::Seek(f, E.GetOffsetField());
 		if (sizeof_datatype == 1)
 		{
-			for (uint32_t& element : vec)
+			for (Offset_t& element : vec)
 			{
 				element = vibo::GetByte(f);
 			}
 		}
 		else if (sizeof_datatype == 2)
 		{
-			for (uint32_t& element : vec)
+			for (Offset_t& element : vec)
 			{
 				element = vibo::GetUShort(f, e);
 			}
 		}
 		else if (sizeof_datatype == 4)
 		{
-			for (uint32_t& element : vec)
+			for (Offset_t& element : vec)
 			{
 				element = vibo::GetULong(f, e);
 			}
@@ -569,7 +616,24 @@ std::vector<uint32_t> ReadTiffNumericVector(FILE* f, Endianness e, const TiffDir
 	{
 		THROW(L"This should not happen! BUG?");
 	}
-	int check = fseek(f, filepos_bk, SEEK_SET);
+	vibo::Seek(f, filepos_bk);
 	return vec;
 }
 
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Class TiffOffsetTable8
+// --------------------------------------------------------------------------------------------------------------------
+
+TiffOffsetTable8::TiffOffsetTable8(Offset_t offset, Offset_t size, Endianness e) : TiffNumericVectorT<uint64_t, Datatype::Long8>(offset, size, e)
+{
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Class TiffBytecountTable8
+// --------------------------------------------------------------------------------------------------------------------
+
+TiffBytecountTable8::TiffBytecountTable8(Offset_t offset, Offset_t size, Endianness e) : TiffNumericVectorT<uint64_t, Datatype::Long8>(offset, size, e)
+{
+}
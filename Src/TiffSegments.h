@@ -10,17 +10,18 @@
 #include "GraphicsFile.h"
 #include "Exception.h"
 #include "TiffDirEntry.h"
+#include "ByteOrder.h"
 #include <vector>
 
 // --------------------------------------------------------------------------------------------------------------------
 //		Free functions
 // --------------------------------------------------------------------------------------------------------------------
 
-Offset_t ReadTiffHeader(FILE* f, Filetype ft, GraphicsVector& G, Offset_t offset); // returns offset of first directory
-void ReadTiffDirectories(FILE* f, Filetype ft, GraphicsVector& G, Offset_t offset);
-void ReadTiffOtherData(FILE* f, GraphicsVector& G, Segmenttype seg, Endianness e, int offset, int datasize);
+Offset_t ReadTiffHeader(vibo::File& f, Filetype ft, GraphicsVector& G, Offset_t offset); // returns offset of first directory
+void ReadTiffDirectories(vibo::File& f, Filetype ft, GraphicsVector& G, Offset_t offset);
+void ReadTiffOtherData(vibo::File& f, GraphicsVector& G, Segmenttype seg, Endianness e, Offset_t offset, Offset_t datasize);
 
-std::vector<uint32_t> ReadTiffNumericVector(FILE* f, Endianness e, const TiffDirEntry& E);
+std::vector<Offset_t> ReadTiffNumericVector(vibo::File& f, Endianness e, const TiffDirEntry& E);
 
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -33,7 +34,7 @@ protected:
 	Endianness m_Endianness;
 
 public:
-	TiffSegment(int offset, int size, Endianness e);
+	TiffSegment(Offset_t offset, Offset_t size, Endianness e);
 	Endianness FileEndianness() const;
 protected:
 	~TiffSegment() = default;
@@ -42,14 +43,16 @@ protected:
 
 class TiffHeader : public TiffSegment
 {
-	int m_directoryOffset;
+	unsigned long long m_directoryOffset;
+	bool m_bigTiff; // 16 bytes: version 43, the size of an offset (8), and an 8-byte directory offset
 
 public:
-	TiffHeader(int offset, int size, Endianness e);
+	TiffHeader(Offset_t offset, Offset_t size, Endianness e);
 	~TiffHeader() = default;
 
 	Offset_t GetDirectoryOffset() const;
-	void SetDirectoryOffset(int offset);
+	void SetDirectoryOffset(unsigned long long offset);
+	void SetBigTiff(bool bigtiff);
 	void RebuildBinaryData();
 	std::vector<std::wstring> StringRepresentation() const override;
 
@@ -61,24 +64,31 @@ protected:
 class TiffDirectory : public TiffSegment
 {
 	std::vector<TiffDirEntry> m_entries;
-	int m_nextDirectoryOffset;
+	unsigned long long m_nextDirectoryOffset;
+	bool m_bigTiff; // 8-byte entry count and next directory offset, 20-byte entries
 
 public:
-	TiffDirectory(int offset, int size, Endianness e);
+	TiffDirectory(Offset_t offset, Offset_t size, Endianness e);
 	~TiffDirectory() = default;
 
 	void AddEntry(const TiffDirEntry& E);
 	std::vector<std::wstring> StringRepresentation() const override;
 
 	Offset_t GetNextDirectoryOffset() const;
-	void SetNextDirectoryOffset(int offset);
+	void SetNextDirectoryOffset(unsigned long long offset);
+	void SetBigTiff(bool bigtiff);
 	int GetCompression();
-	void ReadExternalData(FILE* f, GraphicsVector& G);
+	void ReadExternalData(vibo::File& f, GraphicsVector& G);
 	void RebuildBinaryData() override;
 	void SortEntries(); // "According to the standard, tags must appear in numerical order"
 
+	static ULong_t BinarySize(int num_entries, bool bigtiff = false); // Size of a directory with num_entries entries
+
 protected:
 	void InterpretData() override;
+
+private:
+	template<Endianness E> void InterpretEntries(const unsigned char* data, int num_entries);
 };
 
 
@@ -90,7 +100,7 @@ protected:
 	std::vector<T> m_vector;
 
 public:
-	TiffNumericVectorT(int offset, int size, Endianness e);
+	TiffNumericVectorT(Offset_t offset, Offset_t size, Endianness e);
 	int GetTiffDatatype() const;
 	int GetTiffDatacount() const;
 	~TiffNumericVectorT() = default;
@@ -100,9 +110,12 @@ public:
 
 protected:
 	void InterpretData() override;
+
+private:
+	template<Endianness E> void InterpretValues(const unsigned char* data, int sizeof_tiffDatatype);
 };
 
-template<typename T, int tiffDatatype> TiffNumericVectorT<T, tiffDatatype>::TiffNumericVectorT(int offset, int size, Endianness e) : TiffSegment(offset, size, e), m_datatype(tiffDatatype), m_datacount(0), m_vector{}
+template<typename T, int tiffDatatype> TiffNumericVectorT<T, tiffDatatype>::TiffNumericVectorT(Offset_t offset, Offset_t size, Endianness e) : TiffSegment(offset, size, e), m_datatype(tiffDatatype), m_datacount(0), m_vector{}
 {
 	ASSERT(TiffDatatypeLength(m_datatype) >= 1);
 	this->m_datacount = m_size / TiffDatatypeLength(m_datatype);
@@ -125,35 +138,57 @@ template<typename T, int tiffDatatype> void TiffNumericVectorT<T, tiffDatatype>:
 	int sizeof_tiffDatatype = TiffDatatypeLength(m_datatype);
 	ASSERT(sizeof(T) >= sizeof_tiffDatatype);
 	int sizeof_data = m_datacount * sizeof_tiffDatatype;
+	vibo::ByteSpan D = this->Data();
 	ASSERT(m_size == sizeof_data);
-	ASSERT(vibo::size(m_data) == sizeof_data);
+	ASSERT(vibo::size(D) == sizeof_data);
 
 	m_vector.resize(m_datacount);
 
+	// The byte order is tested once here, not once per value
+	if (FileEndianness() == Endianness::Little)
+	{
+		InterpretValues<Endianness::Little>(&D[0], sizeof_tiffDatatype);
+	}
+	else
+	{
+		InterpretValues<Endianness::Big>(&D[0], sizeof_tiffDatatype);
+	}
+}
+
+
+template<typename T, int tiffDatatype> template<Endianness E> void TiffNumericVectorT<T, tiffDatatype>::InterpretValues(const unsigned char* data, int sizeof_tiffDatatype)
+{
 	if (sizeof_tiffDatatype == 1)
 	{
 		for (int i = 0; i < m_datacount; ++i)
 		{
-			m_vector[i] = vibo::MakeUByte(&m_data[i]);
+			m_vector[i] = data[i];
 		}
 	}
 	else if (sizeof_tiffDatatype == 2)
 	{
 		for (int i = 0; i < m_datacount; ++i)
 		{
-			m_vector[i] = (T) vibo::MakeUShort(&m_data[sizeof_tiffDatatype*i], FileEndianness());
+			m_vector[i] = (T) vibo::Load<E, uint16_t>(data + 2 * i);
 		}
 	}
 	else if (sizeof_tiffDatatype == 4)
 	{
 		for (int i = 0; i < m_datacount; ++i)
 		{
-			m_vector[i] = (T) vibo::MakeULong(&m_data[sizeof_tiffDatatype*i], FileEndianness());
+			m_vector[i] = (T) vibo::Load<E, uint32_t>(data + 4 * i);
+		}
+	}
+	else if (sizeof_tiffDatatype == 8)
+	{
+		for (int i = 0; i < m_datacount; ++i)
+		{
+			m_vector[i] = (T) vibo::Load<E, uint64_t>(data + 8 * i);
 		}
 	}
 	else
 	{
-		THROW(L"TiffNumericVectorT::InterpretData: The datatype must be either 1, 2 or 4 bytes long");
+		THROW(L"TiffNumericVectorT::InterpretData: The datatype must be either 1, 2, 4 or 8 bytes long");
 	}
 }
 
@@ -190,7 +225,7 @@ template<typename T, int tiffDatatype> void TiffNumericVectorT<T, tiffDatatype>:
 class TiffByteVector : public TiffNumericVectorT <unsigned char, Datatype::Ubyte>
 {
 public:
-	TiffByteVector(int offset, int size, Endianness e);
+	TiffByteVector(Offset_t offset, Offset_t size, Endianness e);
 	~TiffByteVector() = default;
 	void RebuildBinaryData() override;
 };
@@ -199,7 +234,7 @@ public:
 class TiffUShortVector : public TiffNumericVectorT <uint16_t, Datatype::Ushort>
 {
 public:
-	TiffUShortVector(int offset, int size, Endianness e);
+	TiffUShortVector(Offset_t offset, Offset_t size, Endianness e);
 	~TiffUShortVector() = default;
 };
 
@@ -208,7 +243,7 @@ public:
 class TiffOffsetTable : public TiffNumericVectorT<uint32_t, Datatype::Ulong>
 {
 public:
-	TiffOffsetTable(int offset, int size, Endianness e);
+	TiffOffsetTable(Offset_t offset, Offset_t size, Endianness e);
 	~TiffOffsetTable() = default;
 };
 
@@ -216,15 +251,33 @@ public:
 class TiffBytecountTable : public TiffNumericVectorT<uint32_t, Datatype::Ulong>
 {
 public:
-	TiffBytecountTable(int offset, int size, Endianness e);
+	TiffBytecountTable(Offset_t offset, Offset_t size, Endianness e);
 	~TiffBytecountTable() = default;
 };
 
 
+// The same tables in a BigTIFF file
+
+class TiffOffsetTable8 : public TiffNumericVectorT<uint64_t, Datatype::Long8>
+{
+public:
+	TiffOffsetTable8(Offset_t offset, Offset_t size, Endianness e);
+	~TiffOffsetTable8() = default;
+};
+
+
+class TiffBytecountTable8 : public TiffNumericVectorT<uint64_t, Datatype::Long8>
+{
+public:
+	TiffBytecountTable8(Offset_t offset, Offset_t size, Endianness e);
+	~TiffBytecountTable8() = default;
+};
+
+
 class TiffImageData : public TiffSegment
 {
 public:
-	TiffImageData(int offset, int size, Endianness e);
+	TiffImageData(Offset_t offset, Offset_t size, Endianness e);
 	~TiffImageData() = default;
 };
 
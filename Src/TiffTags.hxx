@@ -25,6 +25,7 @@ TIFFTAG_MACRO(  XResolution,                 Main,       Rational,  282    )
 TIFFTAG_MACRO(  YResolution,                 Main,       Rational,  283    )
 TIFFTAG_MACRO(  PlanarConfig,                Main,       Short,     284    )
 TIFFTAG_MACRO(  ResolutionUnit,              Main,       Short,     296    )
+TIFFTAG_MACRO(  PageNumber,                  Main,       Short,     297    )
 TIFFTAG_MACRO(  Software,                    Main,       Ascii,     305    )
 TIFFTAG_MACRO(  DateTime,                    Main,       Ascii,     306    )
 TIFFTAG_MACRO(  Artist,                      Main,       Ascii,     315    )
@@ -5,6 +5,8 @@
 
 #pragma warning(disable: 4996)
 #include "Util.h"
+#include "ByteOrder.h"
+#include "ByteSwap.h"
 #include <iostream>
 #include "Exception.h"
 #include <windows.h>
@@ -12,16 +14,117 @@
 
 namespace vibo
 {
-	File::File(FILE* f) : m_file(f)
+	File::File(FILE* f) : m_file(f, [](FILE* p) { if (p != nullptr) fclose(p); }), m_size((f != nullptr) ? GetFileSize(f) : 0), m_mapping()
 	{
 	}
 
-	File::~File()
+
+	unsigned long long File::Size() const
+	{
+		return m_size;
+	}
+
+
+	bool File::Map()
+	{
+		if (m_mapping == nullptr)
+		{
+			try
+			{
+				m_mapping = std::make_shared<const MappedFile>(m_file.get());
+			}
+			catch (Exception&)
+			{
+				return false;
+			}
+			m_size = m_mapping->Size();
+		}
+		return true;
+	}
+
+
+	bool File::IsMapped() const
+	{
+		return m_mapping != nullptr;
+	}
+
+
+	const std::shared_ptr<const MappedFile>& File::Mapping() const
+	{
+		return m_mapping;
+	}
+
+
+	const std::shared_ptr<FILE>& File::Handle() const
+	{
+		return m_file;
+	}
+
+
+	// ------------------------------------------------------------------------------------------
+	//		MappedFile
+	// ------------------------------------------------------------------------------------------
+
+	MappedFile::MappedFile(FILE* f) : m_mapping(nullptr), m_base(nullptr), m_size(0)
+	{
+		m_size = GetFileSize(f);
+		if (m_size == 0)
+		{
+			THROW(L"MappedFile: cannot map an empty file!");
+		}
+		HANDLE ha = (HANDLE)_get_osfhandle(_fileno(f));
+		if (ha == INVALID_HANDLE_VALUE)
+		{
+			THROW(L"_get_osfhandle failed!");
+		}
+		HANDLE mapping = CreateFileMappingW(ha, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+		{
+			THROW(L"CreateFileMapping failed!");
+		}
+		const void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (base == nullptr)
+		{
+			CloseHandle(mapping);
+			THROW(L"MapViewOfFile failed!");
+		}
+		m_mapping = mapping;
+		m_base = static_cast<const unsigned char*>(base);
+	}
+
+
+	MappedFile::~MappedFile()
 	{
-		if (m_file != nullptr)
+		UnmapViewOfFile(m_base);
+		CloseHandle(m_mapping);
+	}
+
+
+	unsigned long long MappedFile::Size() const
+	{
+		return m_size;
+	}
+
+
+	ByteSpan MappedFile::View(unsigned long long offset, unsigned long long size) const
+	{
+		if (offset > m_size || size > m_size - offset)
+		{
+			THROW(L"MappedFile::View: range exceeds the end of the file!");
+		}
+		return ByteSpan(m_base + offset, static_cast<size_t>(size));
+	}
+
+
+	void MappedFile::Prefetch() const
+	{
+		const unsigned long long PageSize = 4096;
+		volatile unsigned char sink = 0;
+		for (unsigned long long i = 0; i < m_size; i += PageSize)
 		{
-			fclose(m_file);
+			sink = m_base[i];
 		}
+		(void)sink;
 	}
 
 
@@ -79,10 +182,132 @@ namespace vibo
 		return true;
 	}
 
+
+	// ------------------------------------------------------------------------------------------
+	//			is_directory()
+	// ------------------------------------------------------------------------------------------
+
+	bool is_directory(const std::wstring& path)
+	{
+		DWORD attributes = GetFileAttributesW(path.c_str());
+		return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+	}
+
+
+	// ------------------------------------------------------------------------------------------
+	//			ListDirectory()
+	// ------------------------------------------------------------------------------------------
+
+	void ListDirectory(const std::wstring& directory, std::vector<std::wstring>& files, std::vector<std::wstring>& subdirectories)
+	{
+		std::wstring prefix = directory;
+		if (!prefix.empty() && prefix.back() != L'\\' && prefix.back() != L'/')
+		{
+			prefix += L'\\';
+		}
+		WIN32_FIND_DATAW data;
+		HANDLE h = FindFirstFileW((prefix + L"*").c_str(), &data);
+		if (h == INVALID_HANDLE_VALUE)
+		{
+			THROW(L"Cannot list the directory \'" + directory + L"\'");
+		}
+		do
+		{
+			std::wstring name = data.cFileName;
+			if (name == L"." || name == L"..")
+			{
+				continue;
+			}
+			if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+			{
+				subdirectories.push_back(prefix + name);
+			}
+			else
+			{
+				files.push_back(prefix + name);
+			}
+		} while (FindNextFileW(h, &data));
+		FindClose(h);
+	}
+
 	// ------------------------------------------------------------------------------------------
 	//			Get data from file
 	// ------------------------------------------------------------------------------------------
 
+	void Seek(FILE* f, Offset_t offset)
+	{
+		if (offset > static_cast<Offset_t>((std::numeric_limits<__int64>::max)()) || _fseeki64(f, static_cast<__int64>(offset), SEEK_SET) != 0)
+		{
+			THROW(L"Seek error!");
+		}
+	}
+
+
+	Offset_t Tell(FILE* f)
+	{
+		__int64 pos = _ftelli64(f);
+		if (pos < 0)
+		{
+			THROW(L"Tell error!");
+		}
+		return static_cast<Offset_t>(pos);
+	}
+
+
+	void ThrowOffsetOverflow()
+	{
+		THROW(L"An offset or a size is too large!");
+	}
+
+
+	// ------------------------------------------------------------------------------------------
+	//		CopyFileRange()
+	//
+	//		Copies size bytes, starting at offset in source, to the current position of destination.
+	//		The file position of source is undefined on exit.
+	// ------------------------------------------------------------------------------------------
+
+	void CopyFileRange(FILE* source, unsigned long long offset, unsigned long long size, FILE* destination)
+	{
+		const size_t BlockSize = 256 * 1024;
+		Seek(source, offset);
+		ByteVector buffer(static_cast<size_t>(size < BlockSize ? size : BlockSize));
+		while (size > 0)
+		{
+			size_t chunk = static_cast<size_t>(size < BlockSize ? size : BlockSize);
+			if (fread(&buffer[0], 1, chunk, source) != chunk)
+			{
+				THROW(L"CopyFileRange: Read error!");
+			}
+			if (fwrite(&buffer[0], 1, chunk, destination) != chunk)
+			{
+				THROW(L"CopyFileRange: Write error!");
+			}
+			size -= chunk;
+		}
+	}
+
+
+	// ------------------------------------------------------------------------------------------
+	//		PreallocateFile()
+	//
+	//		Reserves disk space for a file that will be size bytes, so that it can be allocated in one piece.
+	//		Failure is not an error; the file is then allocated as it is written.
+	// ------------------------------------------------------------------------------------------
+
+	void PreallocateFile(FILE* f, unsigned long long size)
+	{
+		HANDLE ha = (HANDLE)_get_osfhandle(_fileno(f));
+		if (ha == INVALID_HANDLE_VALUE)
+		{
+			return;
+		}
+		FILE_ALLOCATION_INFO info;
+		info.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+		SetFileInformationByHandle(ha, FileAllocationInfo, &info, sizeof(info));
+	}
+
+
 	int GetByte(FILE* f)
 	{
 		unsigned char buf[2];
@@ -95,10 +320,10 @@ namespace vibo
 	}
 
 
-	ByteVector GetBytes(FILE*f, int n)
+	ByteVector GetBytes(FILE*f, size_t n)
 	{
 		std::vector<unsigned char> vec(n);
-		int check = (int) fread(&vec[0], 1, n, f);
+		size_t check = fread(&vec[0], 1, n, f);
 		if (check != n)
 		{
 			THROW(L"GetBytes: Read error!");
@@ -109,42 +334,22 @@ namespace vibo
 	
 	ULong_t GetULong(FILE* f, Endianness e)
 	{
-		ByteVector vec(4);
-		int check = (int) fread(&vec[0], 1, 4, f);
-		if (check != 4)
+		unsigned char buf[4];
+		if (fread(buf, 1, 4, f) != 4)
 		{
 			THROW(L"GetULong: Read error!");
 		}
-		if (e == Endianness::Little)
-		{
-			return vec[0] + 256 * vec[1] + 256 * 256 * vec[2] + 256 * 256 * 256 * vec[3];
-		}
-		else if (e == Endianness::Big)
-		{
-			return vec[3] + 256 * vec[2] + 256 * 256 * vec[1] + 256 * 256 * 256 * vec[0];
-		}
-		ASSERT(false);
-		return 0; // never reached
+		return MakeULong(buf, e);
 	}
 
 	UShort_t GetUShort(FILE* f, Endianness e)
 	{
-		ByteVector vec(2);
-		int check = (int) fread(&vec[0], 1, 2, f);
-		if (check != 2)
+		unsigned char buf[2];
+		if (fread(buf, 1, 2, f) != 2)
 		{
 			THROW(L"GetUShort: Read error!");
 		}
-		if (e == Endianness::Little)
-		{
-			return vec[0] + 256 * vec[1];
-		}
-		else if (e == Endianness::Big)
-		{
-			return vec[1] + 256 * vec[0];
-		}
-		ASSERT(false);
-		return 0; // never reached
+		return MakeUShort(buf, e);
 	}
 
 	UByte_t MakeUByte(const unsigned char* data)
@@ -161,18 +366,11 @@ namespace vibo
 		return data[0];
 	}
 
+	// The versions below take the byte order at run time. Loops should use Load<E, T>() / Store<E, T>() (ByteOrder.h).
+
 	UShort_t MakeUShort(const unsigned char* data, Endianness e)
 	{
-		if (e == Endianness::Little)
-		{
-			return data[0] + 256 * data[1];
-		}
-		else if (e == Endianness::Big)
-		{
-			return data[1] + 256 * data[0];
-		}
-		ASSERT(false);
-		return 0; // never reached
+		return (e == Endianness::Little) ? Load<Endianness::Little, uint16_t>(data) : Load<Endianness::Big, uint16_t>(data);
 	}
 
 
@@ -189,17 +387,7 @@ namespace vibo
 
 	ULong_t MakeULong(const unsigned char* data, Endianness e)
 	{
-		static const ULong_t LL_256 = 256;
-		if (e == Endianness::Little)
-		{
-			return data[0] + LL_256 * data[1] + LL_256 * LL_256  * data[2] + LL_256 * LL_256 * LL_256  * data[3];
-		}
-		else if (e == Endianness::Big)
-		{
-			return data[3] + LL_256 * data[2] + LL_256 * LL_256  * data[1] + LL_256 * LL_256 * LL_256  * data[0];
-		}
-		ASSERT(false);
-		return 0; // never reached
+		return (e == Endianness::Little) ? Load<Endianness::Little, uint32_t>(data) : Load<Endianness::Big, uint32_t>(data);
 	}
 
 	SLong_t MakeSLong(const unsigned char* data, Endianness e)
@@ -215,71 +403,56 @@ namespace vibo
 	
 	Endianness GetSystemEndianness()
 	{
-		static const int i = 1;
-		const char* p = reinterpret_cast<const char*>(&i);
-		if (p[0] == 1)
+		return HostEndianness;
+	}
+
+
+	void binary_copy(unsigned char* destination, const unsigned char* source, int num_elements, int element_size, Endianness e)
+	{
+		memcpy(destination, source, num_elements*element_size);
+		if (element_size != 1 && e != GetSystemEndianness())
 		{
-			return Endianness::Little;
+			SwapBytes(destination, static_cast<size_t>(num_elements) * element_size, element_size);
 		}
-		return Endianness::Big;
 	}
 
 
-	void binary_copy(unsigned char* destination, const unsigned char* source, int num_elements, int element_size, Endianness e)
+	// ---- Put Methods
+	void PutUShort(unsigned char* memory, const uint16_t& ush, Endianness e)
 	{
-		if (element_size == 1 || e == GetSystemEndianness())
+		if (e == Endianness::Little)
 		{
-			memcpy(destination, source, num_elements*element_size);
+			Store<Endianness::Little>(memory, ush);
 		}
 		else
 		{
-			for (int i = 0; i < num_elements; ++i)
-			{
-				const unsigned char* src = source + i * element_size;
-				unsigned char* dest = destination + i * element_size;
-				for (int j = 1; j <= element_size; ++j)
-				{
-					dest[j - 1] = src[element_size - j]; // NOT TESTED
-				}
-			}
+			Store<Endianness::Big>(memory, ush);
 		}
 	}
 
 
-	// ---- Put Methods
-	void PutUShort(unsigned char* memory, const uint16_t& ush, Endianness e)
+	void PutUlong(unsigned char* memory, const uint32_t& ulo, Endianness e)
 	{
-		const unsigned char* p = reinterpret_cast<const unsigned char*>(&ush);
-		if (e == GetSystemEndianness())
+		if (e == Endianness::Little)
 		{
-			memory[0] = p[0];
-			memory[1] = p[1];
+			Store<Endianness::Little>(memory, ulo);
 		}
 		else
 		{
-			memory[0] = p[1];
-			memory[1] = p[0];
+			Store<Endianness::Big>(memory, ulo);
 		}
 	}
 
 
-	void PutUlong(unsigned char* memory, const uint32_t& ulo, Endianness e)
+	void PutULongLong(unsigned char* memory, const uint64_t& ull, Endianness e)
 	{
-		const unsigned char* p = reinterpret_cast<const unsigned char*>(&ulo);
-		if (e == GetSystemEndianness())
+		if (e == Endianness::Little)
 		{
-			memory[0] = p[0];
-			memory[1] = p[1];
-			memory[2] = p[2];
-			memory[3] = p[3];
+			Store<Endianness::Little>(memory, ull);
 		}
 		else
 		{
-			memory[0] = p[3];
-			memory[1] = p[2];
-			memory[2] = p[1];
-			memory[3] = p[0];
+			Store<Endianness::Big>(memory, ull);
 		}
 	}
 }
-
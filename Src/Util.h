@@ -9,6 +9,8 @@
 #include <stdio.h>
 #include <iosfwd>
 #include <vector>
+#include <memory>
+#include <limits>
 
 typedef std::vector<unsigned char> ByteVector;
 
@@ -24,35 +26,120 @@ typedef short          Short_t;
 typedef unsigned short UShort_t;
 typedef char           Byte_t;
 typedef unsigned char  UByte_t;
-typedef unsigned long  Offset_t;
+typedef unsigned long long Offset_t; // Offsets and sizes in a file. 64 bits also where a long is 32 bits.
 
 
 namespace vibo
 {
+	// Read-only view of a contiguous range of bytes (pointer + length). Does not own the bytes.
+
+	class ByteSpan
+	{
+		const unsigned char* m_data;
+		size_t m_size;
+
+	public:
+		ByteSpan() : m_data(nullptr), m_size(0)
+		{
+		}
+		ByteSpan(const unsigned char* data, size_t size) : m_data(data), m_size(size)
+		{
+		}
+		ByteSpan(const ByteVector& vec) : m_data(vec.data()), m_size(vec.size())
+		{
+		}
+		const unsigned char* data() const
+		{
+			return m_data;
+		}
+		size_t size() const
+		{
+			return m_size;
+		}
+		bool empty() const
+		{
+			return m_size == 0;
+		}
+		const unsigned char& operator[](size_t idx) const
+		{
+			return m_data[idx];
+		}
+		const unsigned char* begin() const
+		{
+			return m_data;
+		}
+		const unsigned char* end() const
+		{
+			return m_data + m_size;
+		}
+	};
+
+
+	// Read-only memory mapping of an entire file. The mapping stays valid after the FILE* is closed.
+
+	class MappedFile
+	{
+		void* m_mapping; // HANDLE
+		const unsigned char* m_base;
+		unsigned long long m_size;
+
+	public:
+		explicit MappedFile(FILE* f);
+		~MappedFile();
+		unsigned long long Size() const;
+		ByteSpan View(unsigned long long offset, unsigned long long size) const;
+		void Prefetch() const; // Touches every page, so that the file is read from disk now rather than when it is parsed
+
+		MappedFile() = delete;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+	};
+
+
 	class File
 	{
-		FILE* m_file;
-		unsigned long long m_size; // __int64 retval = GetFileSize(f)
+		std::shared_ptr<FILE> m_file; // Shared with segments that refer to a range of the file (see Handle())
+		unsigned long long m_size;
+		std::shared_ptr<const MappedFile> m_mapping;
 
 	public:
 		File(FILE* f);
 		operator FILE*()
 		{
-			return m_file; 
+			return m_file.get(); 
 		}
-		~File();
+
+		unsigned long long Size() const;
+
+		// Memory-mapped input: after Map(), FileSegment::ReadData() stores views into the mapping instead of copying the bytes.
+		// Returns false, and leaves the file unmapped, if the file cannot be mapped.
+		bool Map();
+		bool IsMapped() const;
+		const std::shared_ptr<const MappedFile>& Mapping() const;
+
+		// Keeps the file open after this object is gone
+		const std::shared_ptr<FILE>& Handle() const;
+
 		File() = delete;
 		File(const File&) = delete;
 		File& operator=(const File&) = delete;
 	};
 
+	// File positions beyond 2 GB: fseek() and ftell() take a long, which is 32 bits on Windows. Seek() throws on failure.
+	void Seek(FILE* f, Offset_t offset);
+	Offset_t Tell(FILE* f);
+
 	unsigned long long GetFileSize(FILE* f);
+	void CopyFileRange(FILE* source, unsigned long long offset, unsigned long long size, FILE* destination);
+	void PreallocateFile(FILE* f, unsigned long long size); // A hint to the file system; the file size is not changed
 	unsigned long long GetFileSize(const std::wstring& filename);
 	bool file_exists(const std::wstring& filename);
+	bool is_directory(const std::wstring& path);
+	void ListDirectory(const std::wstring& directory, std::vector<std::wstring>& files, std::vector<std::wstring>& subdirectories); // Full paths
 
 	int GetByte(FILE* f);
 
-	ByteVector GetBytes(FILE*f, int n);
+	ByteVector GetBytes(FILE*f, size_t n);
 
 	ULong_t  GetULong(FILE* f, Endianness e);
 	UShort_t GetUShort(FILE* f, Endianness e);
@@ -71,11 +158,47 @@ namespace vibo
 	// Do we need these?
 	void PutUShort(unsigned char* memory, const uint16_t& ush, Endianness e);
 	void PutUlong(unsigned char* memory, const uint32_t& ulo, Endianness e);
+	void PutULongLong(unsigned char* memory, const uint64_t& ull, Endianness e);
 
 	template<class T> int size(const T& t)
 	{
 		return static_cast<int>(t.size());
 	};
+
+
+	// ---- Checked arithmetic on offsets and sizes
+	//
+	// Offsets and sizes read from a file can be anything. These throw rather than wrap around. The test is a compare and
+	// a branch that is not taken, so large files go through the same code as small ones.
+
+	[[noreturn]] void ThrowOffsetOverflow();
+
+	inline Offset_t CheckedAdd(Offset_t a, Offset_t b)
+	{
+		if (a > (std::numeric_limits<Offset_t>::max)() - b)
+		{
+			ThrowOffsetOverflow();
+		}
+		return a + b;
+	}
+
+	inline Offset_t CheckedMultiply(Offset_t a, Offset_t b)
+	{
+		if (b != 0 && a > (std::numeric_limits<Offset_t>::max)() / b)
+		{
+			ThrowOffsetOverflow();
+		}
+		return a * b;
+	}
+
+	inline size_t CheckedSize(Offset_t n) // The size of something that is to be held in memory
+	{
+		if (n > (std::numeric_limits<size_t>::max)())
+		{
+			ThrowOffsetOverflow();
+		}
+		return static_cast<size_t>(n);
+	}
 }
 
 
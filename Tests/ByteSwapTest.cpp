@@ -0,0 +1,172 @@
+// File: ByteSwapTest.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "Test.h"
+#include "../Src/ByteSwap.h"
+#include "../Src/CpuFeatures.h"
+#include "../Src/Exception.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace // anonymous
+{
+	typedef void(*SwapFunction)(unsigned char*, size_t, int);
+
+	struct SwapLevel
+	{
+		const char* name;
+		SwapFunction swap;
+	};
+
+	// The implementations this CPU can run
+	std::vector<SwapLevel> AvailableLevels()
+	{
+		std::vector<SwapLevel> levels;
+		levels.push_back(SwapLevel{ "Scalar", &vibo::SwapBytesScalar });
+		if (vibo::CpuHasSSSE3())
+		{
+			levels.push_back(SwapLevel{ "SSSE3", &vibo::SwapBytesSSSE3 });
+		}
+		if (vibo::CpuHasAVX2())
+		{
+			levels.push_back(SwapLevel{ "AVX2", &vibo::SwapBytesAVX2 });
+		}
+		levels.push_back(SwapLevel{ "SwapBytes", &vibo::SwapBytes });
+		return levels;
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------------------
+	//		SwapReference()
+	//
+	//		The change_endianness() that the kernels replaced: a new vector with the bytes of each element reversed.
+	// ----------------------------------------------------------------------------------------------------------------
+
+	std::vector<unsigned char> SwapReference(const std::vector<unsigned char>& data, int element_size)
+	{
+		std::vector<unsigned char> swapped(data.size());
+		for (size_t i = 0; i < data.size(); i += element_size)
+		{
+			for (int j = 0; j < element_size; ++j)
+			{
+				swapped[i + j] = data[i + element_size - j - 1];
+			}
+		}
+		return swapped;
+	}
+
+
+	// Swaps data at buffer + align with every level, and checks the result and the bytes on either side
+	void CheckAllLevels(const std::vector<SwapLevel>& levels, const std::vector<unsigned char>& data, int element_size, size_t align)
+	{
+		const unsigned char guard = 0xa5;
+		const std::vector<unsigned char> expected = SwapReference(data, element_size);
+		std::vector<unsigned char> buffer(align + data.size() + 32);
+		for (const SwapLevel& level : levels)
+		{
+			std::fill(buffer.begin(), buffer.end(), guard);
+			std::copy(data.begin(), data.end(), buffer.begin() + align);
+			level.swap(buffer.data() + align, data.size(), element_size);
+			CHECK(std::equal(expected.begin(), expected.end(), buffer.begin() + align));
+			CHECK(std::count(buffer.begin(), buffer.begin() + align, guard) == static_cast<std::ptrdiff_t>(align));
+			CHECK(std::count(buffer.begin() + align + data.size(), buffer.end(), guard) == 32);
+		}
+	}
+
+
+	std::vector<unsigned char> RandomBytes(size_t size, std::mt19937& random)
+	{
+		std::vector<unsigned char> data(size);
+		for (unsigned char& b : data)
+		{
+			b = static_cast<unsigned char>(random());
+		}
+		return data;
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		TestByteSwap()
+// --------------------------------------------------------------------------------------------------------------------
+
+void TestByteSwap()
+{
+	const std::vector<SwapLevel> levels = AvailableLevels();
+	std::mt19937 random(2018);
+	const int element_sizes[] = { 1, 2, 4, 8 };
+
+	// Every length up to five AVX2 vectors, at every alignment within 32 bytes: this covers the unaligned heads, and
+	// the tails that do not fill a vector
+	for (int element_size : element_sizes)
+	{
+		for (size_t align = 0; align < 32; ++align)
+		{
+			for (size_t size = 0; size <= 160; size += element_size)
+			{
+				CheckAllLevels(levels, RandomBytes(size, random), element_size, align);
+			}
+		}
+	}
+
+	// Random lengths and alignments
+	for (int round = 0; round < 2000; ++round)
+	{
+		int element_size = element_sizes[random() % 4];
+		size_t size = (random() % 5000) / element_size * element_size;
+		CheckAllLevels(levels, RandomBytes(size, random), element_size, random() % 64);
+	}
+
+	// A big-endian rational 1/2 is swapped as two 4-byte values
+	std::vector<unsigned char> rational = { 0, 0, 0, 1, 0, 0, 0, 2 };
+	vibo::SwapBytes(rational.data(), rational.size(), 4);
+	CHECK((rational == std::vector<unsigned char>{ 1, 0, 0, 0, 2, 0, 0, 0 }));
+
+	// Other element sizes are an error
+	bool thrown = false;
+	try
+	{
+		unsigned char odd[6] = {};
+		vibo::SwapBytes(odd, 6, 3);
+	}
+	catch (const vibo::Exception&)
+	{
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		BenchmarkByteSwap()
+//
+//		16 MB of 2, 4 and 8 byte elements, through change_endianness() and every level.
+// --------------------------------------------------------------------------------------------------------------------
+
+void BenchmarkByteSwap()
+{
+	const std::vector<SwapLevel> levels = AvailableLevels();
+	std::mt19937 random(2019);
+	std::vector<unsigned char> data = RandomBytes(16 << 20, random);
+	const int element_sizes[] = { 2, 4, 8 };
+	for (int element_size : element_sizes)
+	{
+		std::cout << "ByteSwap, " << (data.size() >> 20) << " MB, element size " << element_size << ":" << std::endl;
+
+		std::vector<unsigned char> expected;
+		double seconds = test::BestTime(5, [&]() { expected = SwapReference(data, element_size); });
+		test::PrintThroughput("change_endianness", data.size(), seconds);
+
+		for (const SwapLevel& level : levels)
+		{
+			std::vector<unsigned char> swapped = data;
+			seconds = test::BestTime(5, [&]() { level.swap(swapped.data(), swapped.size(), element_size); });
+			test::PrintThroughput(level.name, data.size(), seconds);
+			CHECK(swapped == expected); // Swapped five times
+		}
+	}
+}
@@ -0,0 +1,237 @@
+// File: CheckedOffsetsTest.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#pragma warning(disable: 4996)
+#include "Test.h"
+#include "TestJpeg.h"
+#include "../Src/Exception.h"
+#include "../Src/ReadJpegMetadata.h"
+#include "../Src/TiffDirEntry.h"
+#include "../Src/TiffSegments.h"
+#include "../Src/Util.h"
+#include <limits>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace // anonymous
+{
+	const wchar_t* const g_overflow = L"An offset or a size is too large!";
+
+	// Whether f() throws the exception with the message, and not some other
+	template<class F> bool Throws(F f, const std::wstring& message)
+	{
+		try
+		{
+			f();
+		}
+		catch (const vibo::Exception& e)
+		{
+			return std::wstring(e.message()).compare(0, message.size(), message) == 0;
+		}
+		return false;
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------------------
+	//		Exif blocks
+	// ----------------------------------------------------------------------------------------------------------------
+
+	void PutShort(ByteVector& v, size_t pos, unsigned int value) // Little-endian
+	{
+		v[pos] = static_cast<unsigned char>(value);
+		v[pos + 1] = static_cast<unsigned char>(value >> 8);
+	}
+
+
+	void PutLong(ByteVector& v, size_t pos, uint32_t value)
+	{
+		PutShort(v, pos, value & 0xffff);
+		PutShort(v, pos + 2, value >> 16);
+	}
+
+
+	struct Entry
+	{
+		unsigned int tag;
+		unsigned int type;
+		uint32_t count;
+		uint32_t value;
+	};
+
+
+	// The TIFF structure of an Exif block: the header, and the main directory at offset 8. num_entries: as the directory
+	// says, which may be more than there are.
+	ByteVector MakeExifTiff(const std::vector<Entry>& entries, unsigned int num_entries, size_t size)
+	{
+		ByteVector tiff(std::max(size, 8 + 2 + 12 * entries.size() + 4), 0);
+		tiff[0] = 0x49;
+		tiff[1] = 0x49;
+		PutShort(tiff, 2, 0x2a);
+		PutLong(tiff, 4, 8);
+		PutShort(tiff, 8, num_entries);
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			size_t pos = 10 + 12 * i;
+			PutShort(tiff, pos, entries[i].tag);
+			PutShort(tiff, pos + 2, entries[i].type);
+			PutLong(tiff, pos + 4, entries[i].count);
+			PutLong(tiff, pos + 8, entries[i].value);
+		}
+		return tiff;
+	}
+
+
+	// The metadata of a JPEG file with nothing but an APP1 segment with tiff in it
+	exif_info ReadExif(const ByteVector& tiff)
+	{
+		ByteVector jpeg{ 0xff, 0xd8, 0xff, 0xe1, 0, 0, 'E', 'x', 'i', 'f', 0, 0 };
+		jpeg.insert(jpeg.end(), tiff.begin(), tiff.end());
+		jpeg[4] = static_cast<unsigned char>((jpeg.size() - 4) >> 8);
+		jpeg[5] = static_cast<unsigned char>((jpeg.size() - 4) & 0xff);
+		jpeg.insert(jpeg.end(), { 0xff, 0xd9 });
+
+		GraphicsVector G;
+		JpegIndex index = test::ParseJpeg(jpeg, G);
+		return ReadApp1Metadata(index.app1);
+	}
+
+
+	void TestCheckedArithmetic()
+	{
+		const Offset_t max = (std::numeric_limits<Offset_t>::max)();
+		CHECK(vibo::CheckedAdd(max - 1, 1) == max);
+		CHECK(vibo::CheckedAdd(0xffffffffULL, 1) == 0x100000000ULL); // Past 32 bits
+		CHECK(Throws([=]() { vibo::CheckedAdd(max, 1); }, g_overflow));
+		CHECK(Throws([=]() { vibo::CheckedAdd(1, max); }, g_overflow));
+		CHECK(Throws([=]() { vibo::CheckedAdd(0x8000000000000000ULL, 0x8000000000000000ULL); }, g_overflow));
+
+		CHECK(vibo::CheckedMultiply(0, max) == 0);
+		CHECK(vibo::CheckedMultiply(max, 0) == 0);
+		CHECK(vibo::CheckedMultiply(max, 1) == max);
+		CHECK(vibo::CheckedMultiply(0xffffffffULL, 8) == 0x7fffffff8ULL);
+		CHECK(vibo::CheckedMultiply(0x100000000ULL, 0xffffffffULL) == 0xffffffff00000000ULL);
+		CHECK(Throws([=]() { vibo::CheckedMultiply(0x100000000ULL, 0x100000000ULL); }, g_overflow));
+		CHECK(Throws([=]() { vibo::CheckedMultiply(max / 2 + 1, 2); }, g_overflow));
+
+		CHECK(vibo::CheckedSize(12345) == 12345);
+		if (sizeof(size_t) < sizeof(Offset_t))
+		{
+			CHECK(Throws([]() { vibo::CheckedSize(0x100000000ULL); }, g_overflow));
+		}
+		else
+		{
+			CHECK(vibo::CheckedSize(max) == (std::numeric_limits<size_t>::max)());
+		}
+	}
+
+
+	// Count times size is computed in 64 bits: it would wrap in 32
+	void TestDataSize()
+	{
+		TiffDirEntry doubles(TiffTag::XResolution, Datatype::Double, 0x80000000, AsOffset(8), Endianness::Little);
+		CHECK(doubles.GetDataSize() == 0x400000000ULL);
+		TiffDirEntry longs(TiffTag::StripOffsets, Datatype::Ulong, 0xffffffff, AsOffset(8), Endianness::Little);
+		CHECK(longs.GetDataSize() == 0x3fffffffcULL);
+	}
+
+
+	void TestExifDirectories()
+	{
+		// 0x40000001 longs are 4 bytes in 32 bits. The entry is not taken as one with its value in the offset field, and
+		// its data is outside the segment, so none is copied.
+		exif_info wrapped = ReadExif(MakeExifTiff({ Entry{ TiffTag::StripOffsets, Datatype::Ulong, 0x40000001, 8 } }, 1, 64));
+		CHECK(wrapped.main_dir.size() == 1);
+		if (wrapped.main_dir.size() == 1)
+		{
+			CHECK(std::get<TiffDirEntry>(wrapped.main_dir.front()).GetDataSize() == 0x100000004ULL);
+			CHECK(std::get<ByteVector>(wrapped.main_dir.front()).empty());
+		}
+
+		// The data of an entry that ends past 4 GB, but at 8 in 32 bits
+		exif_info past_end = ReadExif(MakeExifTiff({ Entry{ TiffTag::XResolution, Datatype::Rational, 2, 0xfffffff8 } }, 1, 64));
+		CHECK(past_end.main_dir.size() == 1);
+		if (past_end.main_dir.size() == 1)
+		{
+			CHECK(std::get<ByteVector>(past_end.main_dir.front()).empty());
+		}
+
+		// A directory with more entries than the segment has room for
+		CHECK(Throws([]() { ReadExif(MakeExifTiff({}, 0xffff, 64)); }, L"Invalid directory in Exif"));
+
+		// A directory offset just short of 4 GB, which is 0 in 32 bits once 2 is added
+		CHECK(Throws([]() { ReadExif(MakeExifTiff({ Entry{ TiffTag::ExifIFD, Datatype::Ulong, 1, 0xfffffffe } }, 1, 64)); }, L"Invalid directory offset in Exif"));
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------------------
+	//		ReadTiffNumericVector() of a TIFF file's directory entry
+	// ----------------------------------------------------------------------------------------------------------------
+
+	void TestTiffEntries()
+	{
+		const wchar_t* name = L"CheckedOffsetsTest.tmp";
+		ByteVector data(100, 0);
+		for (int i = 0; i < 8; ++i)
+		{
+			PutLong(data, 16 + 4 * i, 1000 + i);
+		}
+		FILE* out = _wfopen(name, L"wb");
+		CHECK(out != nullptr);
+		if (out == nullptr)
+		{
+			return;
+		}
+		fwrite(data.data(), 1, data.size(), out);
+		fclose(out);
+
+		{
+			vibo::File f(_wfopen(name, L"rb"));
+			TiffDirEntry inside(TiffTag::StripOffsets, Datatype::Ulong, 8, AsOffset(16), Endianness::Little);
+			std::vector<Offset_t> values = ReadTiffNumericVector(f, Endianness::Little, inside);
+			CHECK(values.size() == 8 && values[0] == 1000 && values[7] == 1007);
+
+			// Ends at 0x100000010: past the end of the file, but at 0x10 in 32 bits
+			TiffDirEntry wrapped(TiffTag::StripOffsets, Datatype::Ulong, 8, AsOffset(0xfffffff0), Endianness::Little);
+			CHECK(Throws([&f, &wrapped]() { ReadTiffNumericVector(f, Endianness::Little, wrapped); }, L"TIFF directory entry points past the end"));
+
+			// A BigTIFF offset where offset + size doesn't fit in 64 bits
+			TiffDirEntry overflow(TiffTag::StripOffsets, Datatype::Ulong, 8, AsOffset(0xfffffffffffffff0ULL), Endianness::Little);
+			CHECK(Throws([&f, &overflow]() { ReadTiffNumericVector(f, Endianness::Little, overflow); }, g_overflow));
+		}
+		_wremove(name);
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		TestCheckedOffsets()
+// --------------------------------------------------------------------------------------------------------------------
+
+void TestCheckedOffsets()
+{
+	TestCheckedArithmetic();
+	TestDataSize();
+	TestExifDirectories();
+	TestTiffEntries();
+}
+
+
+void BenchmarkCheckedOffsets()
+{
+	// An Exif directory of 2000 entries, each with 8 bytes outside it
+	std::vector<Entry> entries;
+	const uint32_t data_offset = 8 + 2 + 12 * 2000 + 4;
+	for (uint32_t i = 0; i < 2000; ++i)
+	{
+		entries.push_back(Entry{ TiffTag::XResolution, Datatype::Rational, 1, data_offset + 8 * i });
+	}
+	ByteVector tiff = MakeExifTiff(entries, 2000, data_offset + 8 * 2000);
+	double seconds = test::BestTime(5, [&tiff]()
+	{
+		ReadExif(tiff);
+	});
+	test::PrintThroughput("ReadApp1Metadata", tiff.size(), seconds);
+}
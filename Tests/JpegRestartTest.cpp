@@ -0,0 +1,150 @@
+// File: JpegRestartTest.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "Test.h"
+#include "TestJpeg.h"
+#include "../Src/ConvertJpegToTiff.h"
+#include "../Src/JpegEntropy.h"
+#include "../Src/JpegRestart.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace // anonymous
+{
+	// The offsets of the restart markers, found by looking at every byte
+	std::vector<Offset_t> FindRestartMarkers(const vibo::ByteSpan& data)
+	{
+		std::vector<Offset_t> offsets;
+		for (size_t i = 0; i + 1 < data.size(); ++i)
+		{
+			if (data.data()[i] == 0xff && data.data()[i + 1] >= 0xd0 && data.data()[i + 1] <= 0xd7)
+			{
+				offsets.push_back(i);
+			}
+		}
+		return offsets;
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------------------
+	//		The cases
+	// ----------------------------------------------------------------------------------------------------------------
+
+	// mcu_rows: of InsertRestartMarkers(). mcus_per_row: of the image.
+	void TestInserted(const test::TestImage& image, int mcu_rows, long long mcus_per_row, unsigned seed)
+	{
+		std::vector<test::Block> blocks = test::RandomBlocks(image, seed);
+		ByteVector jpeg = test::MakeJpeg(image, blocks);
+		GraphicsVector G;
+		JpegIndex index = test::ParseJpeg(jpeg, G);
+		CHECK(test::DecodeBlocks(index, image) == blocks);
+
+		CHECK(InsertRestartMarkers(index, mcu_rows) == RestartResult::Inserted);
+		long long interval = mcu_rows * mcus_per_row;
+		CHECK(index.dri != nullptr && index.dri->GetRestartInterval() == interval);
+		auto dri = std::find(index.frame.begin(), index.frame.end(), std::static_pointer_cast<FileSegment>(index.dri));
+		auto sos = std::find(index.frame.begin(), index.frame.end(), std::static_pointer_cast<FileSegment>(index.sos.front()));
+		CHECK(dri != index.frame.end() && dri + 1 == sos);
+
+		ByteVector buffer;
+		vibo::ByteSpan data = GetEntropyCodedData(*index.image_data.front(), buffer);
+		const std::vector<Offset_t>& restart_offsets = index.image_data.front()->GetRestartOffsets();
+		CHECK(vibo::size(restart_offsets) == (test::NumMcus(image) - 1) / interval);
+		CHECK(FindRestartMarkers(data) == restart_offsets);
+
+		CHECK(test::DecodeBlocks(index, image) == blocks); // The same coefficients, with the markers in between
+	}
+
+
+	void TestNoDcCode()
+	{
+		test::TestImage image = { 32, 32, 1, 1, 1, 0, true };
+		std::vector<test::Block> blocks = test::RandomBlocks(image, 3);
+		ByteVector jpeg = test::MakeJpeg(image, blocks);
+		GraphicsVector G;
+		JpegIndex index = test::ParseJpeg(jpeg, G);
+		CHECK(test::DecodeBlocks(index, image) == blocks);
+
+		// The first block after a marker codes its DC value as the difference, which has no code in the table
+		std::shared_ptr<JpegImageData> image_data = index.image_data.front();
+		size_t frame_size = index.frame.size();
+		CHECK(InsertRestartMarkers(index, 1) == RestartResult::NoDcCode);
+		CHECK(index.dri == nullptr);
+		CHECK(index.image_data.front() == image_data);
+		CHECK(index.frame.size() == frame_size);
+
+		// Converted without strips, and the warning is returned, not printed
+		ConversionOptions options;
+		options.restart_rows = 1;
+		ByteVector tiff;
+		std::vector<std::wstring> warnings;
+		ConvertJpegToTiff(jpeg.data(), jpeg.size(), tiff, warnings, options);
+		CHECK(!tiff.empty());
+		CHECK(warnings.size() == 1 && warnings.front().compare(0, 8, L"-restart") == 0);
+	}
+
+
+	void TestNotNeeded()
+	{
+		// Has restart markers already
+		test::TestImage image = { 40, 40, 1, 1, 1, 5, false };
+		std::vector<test::Block> blocks = test::RandomBlocks(image, 4);
+		ByteVector jpeg = test::MakeJpeg(image, blocks);
+		GraphicsVector G;
+		JpegIndex index = test::ParseJpeg(jpeg, G);
+		CHECK(vibo::size(index.image_data.front()->GetRestartOffsets()) == 4);
+		CHECK(test::DecodeBlocks(index, image) == blocks);
+
+		std::shared_ptr<JpegRestartInterval> dri = index.dri;
+		std::shared_ptr<JpegImageData> image_data = index.image_data.front();
+		CHECK(InsertRestartMarkers(index, 1) == RestartResult::NotNeeded);
+		CHECK(index.dri == dri);
+		CHECK(index.image_data.front() == image_data);
+
+		// One interval would be the whole image
+		test::TestImage single = { 40, 40, 1, 1, 1, 0, false };
+		ByteVector jpeg2 = test::MakeJpeg(single, test::RandomBlocks(single, 5));
+		GraphicsVector G2;
+		JpegIndex index2 = test::ParseJpeg(jpeg2, G2);
+		CHECK(InsertRestartMarkers(index2, 5) == RestartResult::NotNeeded);
+		CHECK(InsertRestartMarkers(index2, 0) == RestartResult::NotNeeded);
+		CHECK(index2.dri == nullptr);
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		TestJpegRestart()
+// --------------------------------------------------------------------------------------------------------------------
+
+void TestJpegRestart()
+{
+	// 4:2:0, 3 MCUs per row and 5 MCU rows: markers after MCU 6 and 12, and a short last interval
+	TestInserted(test::TestImage{ 45, 70, 3, 2, 2, 0, false }, 2, 3, 1);
+
+	// Grayscale, 2 MCUs per row and 20 MCU rows: 19 markers, so the numbers go round from d7 to d0 twice
+	TestInserted(test::TestImage{ 16, 160, 1, 1, 1, 0, false }, 1, 2, 2);
+
+	// 4:2:2, 4 MCUs per row and 6 MCU rows
+	TestInserted(test::TestImage{ 64, 48, 3, 2, 1, 0, false }, 4, 4, 6);
+
+	TestNoDcCode();
+	TestNotNeeded();
+}
+
+
+void BenchmarkJpegRestart()
+{
+	test::TestImage image = { 1024, 1024, 3, 2, 2, 0, false };
+	ByteVector jpeg = test::MakeJpeg(image, test::RandomBlocks(image, 7));
+	double seconds = test::BestTime(5, [&jpeg]()
+	{
+		GraphicsVector G;
+		JpegIndex index = test::ParseJpeg(jpeg, G);
+		InsertRestartMarkers(index, 1);
+	});
+	test::PrintThroughput("InsertRestartMarkers", jpeg.size(), seconds);
+}
@@ -0,0 +1,279 @@
+// File: JpegScannerTest.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "Test.h"
+#include "../Src/CpuFeatures.h"
+#include "../Src/JpegScanner.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace // anonymous
+{
+	typedef JpegScanResult(*ScanFunction)(const unsigned char*, size_t, Offset_t, std::vector<Offset_t>&);
+
+	struct ScanLevel
+	{
+		const char* name;
+		ScanFunction scan;
+	};
+
+	// The implementations this CPU can run
+	std::vector<ScanLevel> AvailableLevels()
+	{
+		std::vector<ScanLevel> levels;
+		levels.push_back(ScanLevel{ "Scalar", &ScanEntropyCodedDataScalar });
+		if (vibo::CpuHasSSE2())
+		{
+			levels.push_back(ScanLevel{ "SSE2", &ScanEntropyCodedDataSSE2 });
+		}
+		if (vibo::CpuHasAVX2())
+		{
+			levels.push_back(ScanLevel{ "AVX2", &ScanEntropyCodedDataAVX2 });
+		}
+		return levels;
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------------------
+	//		ScanReference()
+	//
+	//		One byte at a time, written out from the rules in JpegScanner.h.
+	// ----------------------------------------------------------------------------------------------------------------
+
+	JpegScanResult ScanReference(const unsigned char* data, size_t size, Offset_t base, std::vector<Offset_t>& restart_offsets)
+	{
+		size_t i = 0;
+		while (i < size)
+		{
+			if (data[i] != 0xff)
+			{
+				++i;
+				continue;
+			}
+			if (i + 1 == size)
+			{
+				return JpegScanResult{ i, JpegScanStop::NeedMoreData };
+			}
+			int b2 = data[i + 1];
+			if (b2 == 0)
+			{
+				i += 2;
+			}
+			else if (b2 >= 0xd0 && b2 <= 0xd7)
+			{
+				restart_offsets.push_back(base + i);
+				i += 2;
+			}
+			else if (b2 == 0xff)
+			{
+				i += 1;
+			}
+			else
+			{
+				return JpegScanResult{ i, (b2 == 0xd9) ? JpegScanStop::EndOfImage : JpegScanStop::UnexpectedMarker };
+			}
+		}
+		return JpegScanResult{ size, JpegScanStop::NeedMoreData };
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------------------
+	//		ScanOldLoop()
+	//
+	//		The loop that ScanEntropyCodedData() replaced, for the benchmark. It did not record the restart markers.
+	// ----------------------------------------------------------------------------------------------------------------
+
+	size_t ScanOldLoop(const unsigned char* p, size_t n, bool& eoi_marker_found)
+	{
+		size_t i = 0;
+		while (i + 1 < n) // p[i + 1] must be available when p[i] is ff
+		{
+			if (p[i] != 0xff)
+			{
+				++i;
+				continue;
+			}
+			int b2 = p[i + 1];
+			if (b2 == 0 || (b2 >= 0xd0 && b2 <= 0xd7))
+			{
+				i += 2; // ff 00 is the normal encoding of an ff data byte. Ignore sync markers.
+			}
+			else if (b2 == 0xd9)
+			{
+				eoi_marker_found = true; // ff d9 is End of image (and eof) marker!
+				break;
+			}
+			else if (b2 == 0xff)
+			{
+				++i; // Fill byte
+			}
+			else
+			{
+				i += 2;
+			}
+		}
+		return i;
+	}
+
+
+	// Scans data[0..size) with every level, and checks that they agree with the reference
+	void CheckAllLevels(const std::vector<ScanLevel>& levels, const unsigned char* data, size_t size)
+	{
+		const Offset_t base = 0x100000000ULL; // Restart offsets above 4 GB
+		std::vector<Offset_t> expected_offsets;
+		JpegScanResult expected = ScanReference(data, size, base, expected_offsets);
+		for (const ScanLevel& level : levels)
+		{
+			std::vector<Offset_t> offsets;
+			JpegScanResult result = level.scan(data, size, base, offsets);
+			CHECK(result.position == expected.position);
+			CHECK(result.stop == expected.stop);
+			CHECK(offsets == expected_offsets);
+		}
+	}
+
+
+	// Entropy-coded data: random bytes where every ff is stuffed, with a restart marker every restart_interval bytes
+	std::vector<unsigned char> MakeScan(size_t size, size_t restart_interval, std::mt19937& random)
+	{
+		std::vector<unsigned char> scan;
+		scan.reserve(size + 4);
+		int next_restart = 0;
+		while (scan.size() + 2 < size)
+		{
+			unsigned char b = static_cast<unsigned char>(random());
+			scan.push_back(b);
+			if (b == 0xff)
+			{
+				scan.push_back(0x00);
+			}
+			if (restart_interval != 0 && scan.size() % restart_interval == 0)
+			{
+				scan.push_back(0xff);
+				scan.push_back(static_cast<unsigned char>(0xd0 + next_restart));
+				next_restart = (next_restart + 1) % 8;
+			}
+		}
+		scan.push_back(0xff);
+		scan.push_back(0xd9);
+		return scan;
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		TestJpegScanner()
+// --------------------------------------------------------------------------------------------------------------------
+
+void TestJpegScanner()
+{
+	const std::vector<ScanLevel> levels = AvailableLevels();
+
+	// Every marker pattern at every position of a block of up to 80 bytes, at every alignment within 32 bytes.
+	// This puts ff, and the byte after it, on both sides of each 16 and 32 byte boundary, and in the partial
+	// block at the end; a block that ends in ff must stop there and ask for more data.
+	const unsigned char patterns[][3] =
+	{
+		{ 0xff, 0x00, 0x55 },   // Stuffed ff
+		{ 0xff, 0xd3, 0x55 },   // Restart marker
+		{ 0xff, 0xff, 0x00 },   // Fill byte before a stuffed ff
+		{ 0xff, 0xd9, 0x55 },   // End of image
+		{ 0xff, 0xc4, 0x55 },   // Marker that does not belong
+		{ 0xff, 0xff, 0xd7 },   // Fill byte before a restart marker
+	};
+	std::vector<unsigned char> buffer(32 + 80 + 3);
+	for (const auto& pattern : patterns)
+	{
+		for (size_t align = 0; align < 32; ++align)
+		{
+			for (size_t size = 0; size <= 80; ++size)
+			{
+				for (size_t pos = 0; pos < size; ++pos)
+				{
+					std::fill(buffer.begin(), buffer.end(), static_cast<unsigned char>(0x5a));
+					std::copy(pattern, pattern + 3, buffer.begin() + align + pos);
+					CheckAllLevels(levels, buffer.data() + align, size);
+				}
+			}
+		}
+	}
+
+	// Random blocks with many markers, at random alignments and sizes
+	std::mt19937 random(12345);
+	std::vector<unsigned char> data(4096 + 64);
+	for (int round = 0; round < 20000; ++round)
+	{
+		for (unsigned char& b : data)
+		{
+			switch (random() % 16)
+			{
+			case 0: case 1: case 2: b = 0xff; break;
+			case 3: b = 0x00; break;
+			case 4: b = static_cast<unsigned char>(0xd0 + random() % 8); break;
+			case 5: b = (random() % 8 == 0) ? 0xd9 : static_cast<unsigned char>(0xc0 + random() % 16); break;
+			default: b = static_cast<unsigned char>(random() % 0xff); break;
+			}
+		}
+		size_t align = random() % 64;
+		size_t size = random() % (data.size() - align + 1);
+		CheckAllLevels(levels, data.data() + align, size);
+	}
+
+	// A realistic scan ends at end of image, having recorded every restart marker
+	std::vector<unsigned char> scan = MakeScan(1 << 20, 4000, random);
+	CheckAllLevels(levels, scan.data(), scan.size());
+	std::vector<Offset_t> offsets;
+	JpegScanResult result = ScanEntropyCodedData(scan.data(), scan.size(), 0, offsets);
+	CHECK(result.stop == JpegScanStop::EndOfImage);
+	CHECK(result.position == scan.size() - 2);
+	CHECK(offsets.size() > 200);
+	for (Offset_t offset : offsets)
+	{
+		CHECK(scan[offset] == 0xff && (scan[offset + 1] & 0xf8) == 0xd0);
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		BenchmarkJpegScanner()
+//
+//		A 64 MB synthetic scan, with and without restart markers, through the old loop and every level.
+// --------------------------------------------------------------------------------------------------------------------
+
+void BenchmarkJpegScanner()
+{
+	const std::vector<ScanLevel> levels = AvailableLevels();
+	std::mt19937 random(54321);
+	const size_t restart_intervals[] = { 0, 4096 };
+	for (size_t restart_interval : restart_intervals)
+	{
+		std::vector<unsigned char> scan = MakeScan(64 << 20, restart_interval, random);
+		std::cout << "JpegScanner, " << (scan.size() >> 20) << " MB, restart interval " << restart_interval << ":" << std::endl;
+
+		size_t end = 0;
+		double seconds = test::BestTime(5, [&]()
+		{
+			bool eoi = false;
+			end = ScanOldLoop(scan.data(), scan.size(), eoi);
+		});
+		CHECK(end == scan.size() - 2);
+		test::PrintThroughput("Old loop", scan.size(), seconds);
+
+		for (const ScanLevel& level : levels)
+		{
+			JpegScanResult result = JpegScanResult{ 0, JpegScanStop::NeedMoreData };
+			std::vector<Offset_t> offsets;
+			seconds = test::BestTime(5, [&]()
+			{
+				offsets.clear();
+				result = level.scan(scan.data(), scan.size(), 0, offsets);
+			});
+			CHECK(result.position == end);
+			test::PrintThroughput(level.name, scan.size(), seconds);
+		}
+	}
+}
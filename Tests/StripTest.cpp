@@ -0,0 +1,168 @@
+// File: StripTest.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "Test.h"
+#include "TestJpeg.h"
+#include "../Src/ConvertJpegToTiff.h"
+#include "../Src/TiffLayout.h"
+#include <algorithm>
+#include <vector>
+
+namespace // anonymous
+{
+	bool operator==(const StripPlan& a, const StripPlan& b)
+	{
+		return a.num_strips == b.num_strips && a.intervals_per_strip == b.intervals_per_strip && a.rows_per_strip == b.rows_per_strip;
+	}
+
+
+	// Strip number s, as a reader decodes it: with the tables of JPEGTables after its SOI marker
+	ByteVector StripData(const JpegIndex& index, const StripPlan& plan, int s)
+	{
+		TiffLayout L(Endianness::Little);
+		AddJpegStrip(L, index, plan, s);
+		L.Plan();
+		ByteVector out;
+		WriteGraphicsVector(L.Materialize(), out);
+		ByteVector tables;
+		for (auto it = index.tables.begin(); it != index.tables.end(); ++it)
+		{
+			vibo::ByteSpan D = (*it)->Data();
+			tables.insert(tables.end(), D.begin(), D.end());
+		}
+		out.insert(out.begin() + 2, tables.begin(), tables.end());
+		return out;
+	}
+
+
+	// Plans the strips of the image, and checks the plan and each strip: its height, its restart markers (numbered from
+	// d0 again), and that its blocks are those of its rows in the source
+	void TestPlan(const test::TestImage& image, const StripPlan& expected, unsigned seed)
+	{
+		std::vector<test::Block> blocks = test::RandomBlocks(image, seed);
+		ByteVector jpeg = test::MakeJpeg(image, blocks);
+		GraphicsVector G;
+		JpegIndex index = test::ParseJpeg(jpeg, G);
+		StripPlan plan = PlanStrips(index);
+		CHECK(plan == expected);
+		if (!(plan == expected) || plan.num_strips == 1)
+		{
+			return;
+		}
+
+		int mcu_height = (image.components == 1) ? 8 : 8 * image.v;
+		long long mcus_per_row = test::NumMcus(test::TestImage{ image.width, mcu_height, image.components, image.h, image.v, 0, false });
+		size_t blocks_per_strip = static_cast<size_t>(plan.rows_per_strip / mcu_height * mcus_per_row * test::McuComponents(image).size());
+		long long num_intervals = (test::NumMcus(image) + image.restart_interval - 1) / image.restart_interval;
+		for (int s = 0; s < plan.num_strips; ++s)
+		{
+			ByteVector strip = StripData(index, plan, s);
+			GraphicsVector S;
+			JpegIndex strip_index = test::ParseJpeg(strip, S);
+			int length = std::min(plan.rows_per_strip, image.height - s * plan.rows_per_strip);
+			CHECK(strip_index.sof != nullptr && strip_index.sof->GetImageLength() == length);
+			CHECK(strip_index.dri != nullptr && strip_index.dri->GetRestartInterval() == image.restart_interval);
+
+			long long intervals = std::min<long long>(plan.intervals_per_strip, num_intervals - static_cast<long long>(s) * plan.intervals_per_strip);
+			CHECK(vibo::size(strip_index.image_data.front()->GetRestartOffsets()) == intervals - 1);
+
+			test::TestImage strip_image = image;
+			strip_image.height = length;
+			size_t first = s * blocks_per_strip;
+			size_t last = std::min(first + blocks_per_strip, blocks.size());
+			CHECK(test::DecodeBlocks(strip_index, strip_image) == std::vector<test::Block>(blocks.begin() + first, blocks.begin() + last));
+		}
+	}
+
+
+	// Makes the DRI segment say interval, whatever the markers in the data
+	void SetRestartInterval(ByteVector& jpeg, int interval)
+	{
+		const unsigned char dri[] = { 0xff, 0xdd, 0x00, 0x04 };
+		auto it = std::search(jpeg.begin(), jpeg.end(), dri, dri + 4);
+		CHECK(it != jpeg.end());
+		if (it != jpeg.end())
+		{
+			it[4] = static_cast<unsigned char>(interval >> 8);
+			it[5] = static_cast<unsigned char>(interval & 0xff);
+		}
+	}
+
+
+	// The image data is not cut when the markers are not where the DRI segment says
+	void TestMismatchedMarkers()
+	{
+		test::TestImage image = { 32, 40, 1, 1, 1, 4, false };
+		ByteVector jpeg = test::MakeJpeg(image, test::RandomBlocks(image, 9));
+		{
+			GraphicsVector G;
+			CHECK(PlanStrips(test::ParseJpeg(jpeg, G)).num_strips == 5);
+		}
+
+		SetRestartInterval(jpeg, 2); // Markers missing
+		{
+			GraphicsVector G;
+			CHECK(PlanStrips(test::ParseJpeg(jpeg, G)).num_strips == 1);
+		}
+
+		SetRestartInterval(jpeg, 8); // Extra markers
+		{
+			GraphicsVector G;
+			CHECK(PlanStrips(test::ParseJpeg(jpeg, G)).num_strips == 1);
+		}
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		TestStrips()
+// --------------------------------------------------------------------------------------------------------------------
+
+void TestStrips()
+{
+	// The interval is a row: a strip per MCU row, with no markers inside
+	TestPlan(test::TestImage{ 24, 80, 1, 1, 1, 3, false }, StripPlan{ 10, 1, 8 }, 1);
+
+	// A marker after every MCU, 4 MCUs per row. Strip 2 starts at interval 8, so its markers count from d0 already and
+	// the data is copied as it is; the others get new markers.
+	TestPlan(test::TestImage{ 32, 40, 1, 1, 1, 1, false }, StripPlan{ 5, 4, 8 }, 2);
+
+	// An interval of 2 MCUs, 3 MCUs per row: a strip ends at every other row. The last strip is one row, and its last
+	// interval one MCU.
+	TestPlan(test::TestImage{ 24, 72, 1, 1, 1, 2, false }, StripPlan{ 5, 3, 16 }, 3);
+
+	// 4:2:0, so the MCU rows are 16 pixels. An interval of 6 MCUs, 4 MCUs per row: gcd 2, so 2 intervals and 3 rows
+	// per strip. The last strip is 6 pixels high.
+	TestPlan(test::TestImage{ 64, 150, 3, 2, 2, 6, false }, StripPlan{ 4, 2, 48 }, 4);
+
+	// Not cut: no restart markers, or a strip would be the whole image
+	TestPlan(test::TestImage{ 24, 80, 1, 1, 1, 0, false }, StripPlan{ 1, 0, 0 }, 5);
+	TestPlan(test::TestImage{ 24, 80, 1, 1, 1, 30, false }, StripPlan{ 1, 0, 0 }, 6);
+
+	TestMismatchedMarkers();
+}
+
+
+void BenchmarkStrips()
+{
+	// A marker every MCU row, so 512 strips
+	test::TestImage image = { 4096, 4096, 1, 1, 1, 512, false };
+	ByteVector jpeg = test::MakeJpeg(image, test::RandomBlocks(image, 7));
+	GraphicsVector G;
+	JpegIndex index = test::ParseJpeg(jpeg, G);
+	double seconds = test::BestTime(5, [&index]()
+	{
+		StripPlan plan = PlanStrips(index);
+		TiffLayout L(Endianness::Little);
+		for (int s = 0; s < plan.num_strips; ++s)
+		{
+			AddJpegStrip(L, index, plan, s);
+		}
+		L.Plan();
+		ByteVector out;
+		WriteGraphicsVector(L.Materialize(), out);
+	});
+	test::PrintThroughput("AddJpegStrip", jpeg.size(), seconds);
+}
@@ -0,0 +1,57 @@
+// File: Test.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef TEST_H_INCLUDED
+#define TEST_H_INCLUDED
+
+#include <chrono>
+#include <stddef.h>
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Unit tests and benchmarks
+//
+//		A test is a function that calls CHECK() for each thing it verifies; a failed check is reported, and the test
+//		program returns nonzero. Benchmarks print their timings, and are only run with -benchmark.
+// --------------------------------------------------------------------------------------------------------------------
+
+namespace test
+{
+	void Check(bool ok, const char* expression, const char* file, int line);
+
+	// The fastest of num_runs calls of f(), in seconds
+	template<class F> double BestTime(int num_runs, F f)
+	{
+		double best = 0;
+		for (int run = 0; run < num_runs; ++run)
+		{
+			auto start = std::chrono::steady_clock::now();
+			f();
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (run == 0 || seconds < best)
+			{
+				best = seconds;
+			}
+		}
+		return best;
+	}
+
+	void PrintThroughput(const char* name, size_t bytes, double seconds);
+}
+
+#define CHECK(expression) test::Check((expression), #expression, __FILE__, __LINE__)
+
+// The tests and benchmarks, one pair per file
+void TestJpegScanner();
+void BenchmarkJpegScanner();
+void TestByteSwap();
+void BenchmarkByteSwap();
+void TestJpegRestart();
+void BenchmarkJpegRestart();
+void TestStrips();
+void BenchmarkStrips();
+void TestCheckedOffsets();
+void BenchmarkCheckedOffsets();
+
+#endif
@@ -0,0 +1,311 @@
+// File: TestJpeg.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "TestJpeg.h"
+#include "Test.h"
+#include "../Src/ByteReader.h"
+#include "../Src/JpegEntropy.h"
+#include <algorithm>
+#include <random>
+#include <stdlib.h>
+
+namespace // anonymous
+{
+	struct HuffmanSpec
+	{
+		unsigned char bits[16];              // The number of codes of each length, 1-16
+		std::vector<unsigned char> values;   // By code
+	};
+
+	// The DC table of Annex K.3, with a code for every category 0-11
+	const HuffmanSpec g_dc_full = { { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 }, { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 } };
+
+	// As an optimizing encoder makes it for an image whose DC differences are small: codes for categories 0-4 only
+	const HuffmanSpec g_dc_optimized = { { 0, 3, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, { 0, 1, 2, 3, 4 } };
+
+	// End of block, 16 zeros, and short runs of small coefficients
+	const HuffmanSpec g_ac = { { 0, 2, 2, 3, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, { 0x00, 0x01, 0x02, 0x11, 0x03, 0x21, 0x12, 0x31, 0xf0 } };
+
+	const int g_ac_symbols[] = { 0x01, 0x02, 0x11, 0x03, 0x21, 0x12, 0x31, 0xf0 }; // All but end of block
+
+
+	struct CodeTable
+	{
+		unsigned int code[256];
+		int size[256];
+	};
+
+	CodeTable MakeCodeTable(const HuffmanSpec& spec)
+	{
+		CodeTable table = {};
+		unsigned int code = 0;
+		size_t k = 0;
+		for (int l = 1; l <= 16; ++l)
+		{
+			for (int i = 0; i < spec.bits[l - 1]; ++i)
+			{
+				table.code[spec.values[k]] = code++;
+				table.size[spec.values[k]] = l;
+				++k;
+			}
+			code <<= 1;
+		}
+		return table;
+	}
+
+
+	void PutSegment(ByteVector& out, unsigned char marker, const ByteVector& data)
+	{
+		out.push_back(0xff);
+		out.push_back(marker);
+		out.push_back(static_cast<unsigned char>((data.size() + 2) >> 8));
+		out.push_back(static_cast<unsigned char>((data.size() + 2) & 0xff));
+		out.insert(out.end(), data.begin(), data.end());
+	}
+
+
+	void PutHuffmanTable(ByteVector& out, int table_class, const HuffmanSpec& spec)
+	{
+		ByteVector data(1, static_cast<unsigned char>(table_class << 4));
+		data.insert(data.end(), spec.bits, spec.bits + 16);
+		data.insert(data.end(), spec.values.begin(), spec.values.end());
+		PutSegment(out, 0xc4, data);
+	}
+}
+
+
+namespace test
+{
+	bool operator==(const Block& a, const Block& b)
+	{
+		if (a.dc != b.dc || a.ac.size() != b.ac.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < a.ac.size(); ++i)
+		{
+			if (a.ac[i].symbol != b.ac[i].symbol || a.ac[i].value != b.ac[i].value)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+
+	// The component of each block of an MCU, in the order of the scan
+	std::vector<int> McuComponents(const TestImage& image)
+	{
+		std::vector<int> mcu(image.h * image.v, 0);
+		for (int c = 1; c < image.components; ++c)
+		{
+			mcu.push_back(c);
+		}
+		return mcu;
+	}
+
+
+	long long NumMcus(const TestImage& image)
+	{
+		int mcu_width = (image.components == 1) ? 8 : 8 * image.h;
+		int mcu_height = (image.components == 1) ? 8 : 8 * image.v;
+		return static_cast<long long>((image.width + mcu_width - 1) / mcu_width) * ((image.height + mcu_height - 1) / mcu_height);
+	}
+
+
+	std::vector<Block> RandomBlocks(const TestImage& image, unsigned seed)
+	{
+		std::mt19937 random(seed);
+		std::vector<int> mcu = McuComponents(image);
+		std::vector<Block> blocks(NumMcus(image) * mcu.size());
+		std::vector<int> dc(image.components, 0);
+		for (size_t i = 0; i < blocks.size(); ++i)
+		{
+			Block& block = blocks[i];
+			int c = mcu[i % mcu.size()];
+			if (image.optimized)
+			{
+				dc[c] += 4 + static_cast<int>(random() % 12); // Categories 3 and 4, so the DC values soon need more
+			}
+			else
+			{
+				int difference = static_cast<int>(random() % 401) - 200;
+				dc[c] += (std::abs(dc[c] + difference) < 1024) ? difference : -difference;
+			}
+			block.dc = dc[c];
+
+			int k = 1;
+			while (k < 64)
+			{
+				int symbol = g_ac_symbols[random() % 8];
+				int step = (symbol == 0xf0) ? 16 : (symbol >> 4) + 1;
+				if (random() % 8 == 0 || k + step > 64)
+				{
+					block.ac.push_back(Coefficient{ 0x00, 0 }); // End of block
+					break;
+				}
+				int size = symbol & 15;
+				int value = 0;
+				if (size > 0)
+				{
+					value = (1 << (size - 1)) + static_cast<int>(random() % (1u << (size - 1)));
+					value = (random() % 2 == 0) ? value : -value;
+				}
+				block.ac.push_back(Coefficient{ symbol, value });
+				k += step;
+			}
+		}
+		return blocks;
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------------------
+	//		MakeJpeg()
+	// ----------------------------------------------------------------------------------------------------------------
+
+	ByteVector MakeJpeg(const TestImage& image, const std::vector<Block>& blocks)
+	{
+		ByteVector out{ 0xff, 0xd8 };
+		ByteVector dqt(65, 1);
+		dqt[0] = 0;
+		PutSegment(out, 0xdb, dqt);
+
+		ByteVector sof{ 8, static_cast<unsigned char>(image.height >> 8), static_cast<unsigned char>(image.height & 0xff),
+			static_cast<unsigned char>(image.width >> 8), static_cast<unsigned char>(image.width & 0xff), static_cast<unsigned char>(image.components) };
+		ByteVector sos{ static_cast<unsigned char>(image.components) };
+		for (int c = 0; c < image.components; ++c)
+		{
+			int sampling = (c == 0) ? (image.h << 4) | image.v : 0x11;
+			sof.insert(sof.end(), { static_cast<unsigned char>(c + 1), static_cast<unsigned char>(sampling), 0 });
+			sos.insert(sos.end(), { static_cast<unsigned char>(c + 1), 0x00 });
+		}
+		sos.insert(sos.end(), { 0, 63, 0 });
+		PutSegment(out, 0xc0, sof);
+
+		const HuffmanSpec& dc_spec = image.optimized ? g_dc_optimized : g_dc_full;
+		PutHuffmanTable(out, 0, dc_spec);
+		PutHuffmanTable(out, 1, g_ac);
+		if (image.restart_interval > 0)
+		{
+			PutSegment(out, 0xdd, ByteVector{ static_cast<unsigned char>(image.restart_interval >> 8), static_cast<unsigned char>(image.restart_interval & 0xff) });
+		}
+		PutSegment(out, 0xda, sos);
+
+		CodeTable dc = MakeCodeTable(dc_spec);
+		CodeTable ac = MakeCodeTable(g_ac);
+		std::vector<int> mcu = McuComponents(image);
+		std::vector<int> predictor(image.components, 0);
+		BitWriter w(out);
+		int markers = 0;
+		for (size_t i = 0; i < blocks.size(); ++i)
+		{
+			size_t m = i / mcu.size();
+			if (image.restart_interval > 0 && m > 0 && i % mcu.size() == 0 && m % image.restart_interval == 0)
+			{
+				w.PadToByte();
+				out.push_back(0xff);
+				out.push_back(static_cast<unsigned char>(0xd0 + markers++ % 8));
+				std::fill(predictor.begin(), predictor.end(), 0);
+			}
+			int c = mcu[i % mcu.size()];
+			int difference = blocks[i].dc - predictor[c];
+			predictor[c] = blocks[i].dc;
+			int s = Category(difference);
+			w.Put(dc.code[s], dc.size[s]);
+			w.Put(ExtraBits(difference, s), s);
+			for (auto it = blocks[i].ac.begin(); it != blocks[i].ac.end(); ++it)
+			{
+				w.Put(ac.code[it->symbol], ac.size[it->symbol]);
+				int size = it->symbol & 15;
+				w.Put(ExtraBits(it->value, size), size);
+			}
+		}
+		w.PadToByte();
+		out.push_back(0xff);
+		out.push_back(0xd9);
+		return out;
+	}
+
+
+	JpegIndex ParseJpeg(const ByteVector& jpeg, GraphicsVector& G)
+	{
+		JpegIndex index;
+		vibo::ByteReader r(vibo::ByteSpan(jpeg), nullptr, 0);
+		ReadJpegFileOrEmbeddedSection(r, G, 0, jpeg.size(), L"Test image", &index);
+		return index;
+	}
+
+
+	// ----------------------------------------------------------------------------------------------------------------
+	//		DecodeBlocks()
+	//
+	//		Decodes the image data of index with DecodeSymbol() and Extend(), with the tables of the file, and checks
+	//		each restart marker on the way.
+	// ----------------------------------------------------------------------------------------------------------------
+
+	std::vector<Block> DecodeBlocks(const JpegIndex& index, const TestImage& image)
+	{
+		std::vector<Block> blocks;
+		ScanLayout layout;
+		CHECK(GetScanLayout(index, layout));
+		ByteVector buffer;
+		vibo::ByteSpan data = GetEntropyCodedData(*index.image_data.front(), buffer);
+		const std::vector<Offset_t>& restart_offsets = index.image_data.front()->GetRestartOffsets();
+		long long interval = (index.dri != nullptr) ? index.dri->GetRestartInterval() : 0;
+
+		std::vector<int> mcu = McuComponents(image);
+		std::vector<int> predictor(image.components, 0);
+		BitReader r(data);
+		long long num_mcus = layout.mcus_per_row * layout.mcu_rows;
+		CHECK(num_mcus == NumMcus(image));
+		for (long long m = 0; m < num_mcus; ++m)
+		{
+			if (interval > 0 && m > 0 && m % interval == 0)
+			{
+				size_t n = static_cast<size_t>(m / interval - 1);
+				CHECK(n < restart_offsets.size());
+				if (n >= restart_offsets.size())
+				{
+					return blocks;
+				}
+				Offset_t offset = restart_offsets[n];
+				CHECK(offset + 1 < data.size() && data.data()[offset] == 0xff && data.data()[offset + 1] == 0xd0 + n % 8);
+				r.Restart(static_cast<size_t>(offset + 2));
+				std::fill(predictor.begin(), predictor.end(), 0);
+			}
+			for (size_t b = 0; b < mcu.size(); ++b)
+			{
+				int c = mcu[b];
+				const HuffmanCode& dc = layout.codes[layout.components[c].dc];
+				const HuffmanCode& ac = layout.codes[layout.components[c].ac];
+				Block block;
+				int s = DecodeSymbol(r, dc);
+				CHECK(s >= 0 && s <= 11);
+				predictor[c] += Extend(r.Get(s), s);
+				block.dc = predictor[c];
+				int k = 1;
+				while (k < 64)
+				{
+					int rs = DecodeSymbol(r, ac);
+					CHECK(rs >= 0);
+					if (rs < 0)
+					{
+						return blocks;
+					}
+					int size = rs & 15;
+					block.ac.push_back(Coefficient{ rs, Extend(r.Get(size), size) });
+					if (rs == 0x00)
+					{
+						break;
+					}
+					k += (rs == 0xf0) ? 16 : (rs >> 4) + 1;
+				}
+				blocks.push_back(block);
+			}
+		}
+		CHECK(!r.Overrun());
+		return blocks;
+	}
+}
@@ -0,0 +1,59 @@
+// File: TestJpeg.h
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#ifndef TESTJPEG_H_INCLUDED
+#define TESTJPEG_H_INCLUDED
+
+#include "../Src/JpegSegments.h"
+#include <vector>
+
+// --------------------------------------------------------------------------------------------------------------------
+//		Test images
+//
+//		Small baseline JPEG images, made in memory from random coefficients that are coded with small Huffman tables.
+//		Only the entropy-coded data matters; the image itself is noise.
+// --------------------------------------------------------------------------------------------------------------------
+
+namespace test
+{
+	struct TestImage
+	{
+		int width;
+		int height;
+		int components;         // 1 or 3
+		int h;                  // Sampling factors of the first component; the others are 1x1
+		int v;
+		int restart_interval;   // In MCUs. 0: no restart markers.
+		bool optimized;         // The DC table only has codes for the small DC differences of the image, as an optimized one
+	};
+
+
+	struct Coefficient
+	{
+		int symbol;   // Run and size
+		int value;
+	};
+
+	struct Block
+	{
+		int dc;
+		std::vector<Coefficient> ac;
+	};
+
+	bool operator==(const Block& a, const Block& b);
+
+	std::vector<int> McuComponents(const TestImage& image); // The component of each block of an MCU, in the order of the scan
+	long long NumMcus(const TestImage& image);
+
+	std::vector<Block> RandomBlocks(const TestImage& image, unsigned seed); // In the order of the scan
+	ByteVector MakeJpeg(const TestImage& image, const std::vector<Block>& blocks);
+	JpegIndex ParseJpeg(const ByteVector& jpeg, GraphicsVector& G);
+
+	// Decodes the image data of index with DecodeSymbol() and Extend(), with the tables of the file, and checks each
+	// restart marker on the way
+	std::vector<Block> DecodeBlocks(const JpegIndex& index, const TestImage& image);
+}
+
+#endif
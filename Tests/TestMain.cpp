@@ -0,0 +1,81 @@
+// File: TestMain.cpp
+// This file is part of the project: Rewrap-jpeg-as-tiff -- Rewraps a jpeg file into a TIFF container, without loss of information (no re-encoding).
+// Copyright(c) 2018 Vidar Bosnes
+// This software is licenced under the GNU GENERAL PUBLIC LICENSE Version 3
+
+#include "Test.h"
+#include "../Src/Exception.h"
+#include <iostream>
+#include <string.h>
+
+namespace // anonymous
+{
+	int g_failures = 0;
+
+	struct TestCase
+	{
+		const char* name;
+		void(*test)();
+		void(*benchmark)();
+	};
+
+	const TestCase g_tests[] =
+	{
+		{ "JpegScanner", &TestJpegScanner, &BenchmarkJpegScanner },
+		{ "ByteSwap", &TestByteSwap, &BenchmarkByteSwap },
+		{ "JpegRestart", &TestJpegRestart, &BenchmarkJpegRestart },
+		{ "Strips", &TestStrips, &BenchmarkStrips },
+		{ "CheckedOffsets", &TestCheckedOffsets, &BenchmarkCheckedOffsets },
+	};
+}
+
+
+namespace test
+{
+	void Check(bool ok, const char* expression, const char* file, int line)
+	{
+		if (!ok)
+		{
+			++g_failures;
+			std::cout << file << "(" << line << "): CHECK(" << expression << ") failed" << std::endl;
+		}
+	}
+
+
+	void PrintThroughput(const char* name, size_t bytes, double seconds)
+	{
+		std::cout << "  " << name << ": " << seconds * 1000 << " ms, " << bytes / seconds / (1 << 20) << " MB/s" << std::endl;
+	}
+}
+
+
+// --------------------------------------------------------------------------------------------------------------------
+//		main()
+//
+//		Tests [-benchmark]
+// --------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	bool benchmark = (argc > 1 && strcmp(argv[1], "-benchmark") == 0);
+	for (const TestCase& t : g_tests)
+	{
+		int failures_before = g_failures;
+		try
+		{
+			t.test();
+		}
+		catch (const vibo::Exception& e)
+		{
+			++g_failures;
+			std::cout << e.what() << std::endl;
+		}
+		std::cout << t.name << ": " << ((g_failures == failures_before) ? "ok" : "FAILED") << std::endl;
+
+		if (benchmark)
+		{
+			t.benchmark();
+		}
+	}
+	return (g_failures == 0) ? 0 : 1;
+}